@@ -0,0 +1,479 @@
+#include "client.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <core/client.h>
+#include <core/hash.h>
+
+static constexpr uint64_t CONNECTION_KEY = 0;
+static constexpr uint64_t WAKE_KEY = 1;
+
+class AsyncClient::EchoOperation final : public Operation {
+public:
+    std::promise<std::string> result;
+
+    bool Handle(const Msg::Packet::Header& header, const char* data) override {
+        // The echo is sent back together with the string terminator.
+        const size_t size = (header.dataSize > 0) ? header.dataSize - 1 : 0;
+        result.set_value(std::string(data, size));
+        return true;
+    }
+
+    void Fail() override { result.set_value({}); }
+};
+
+class AsyncClient::TimeOperation final : public Operation {
+public:
+    std::promise<std::time_t> result;
+
+    bool Handle(const Msg::Packet::Header& header, const char* data) override {
+        std::time_t time = 0;
+        if (header.dataSize == sizeof(time)) [[likely]] std::memcpy(&time, data, sizeof(time));
+
+        result.set_value(time);
+        return true;
+    }
+
+    void Fail() override { result.set_value(0); }
+};
+
+class AsyncClient::DownloadOperation final : public Operation {
+    std::filesystem::path filePath;
+    File file;
+    size_t totalSize = 0;
+    size_t received = 0;
+    bool isStarted = false;
+    LoadResult status = Client::Success;
+
+    bool Finish(const LoadResult finalStatus) {
+        file.Close();
+        if (finalStatus != Client::Success && isStarted) std::filesystem::remove(filePath);
+
+        result.set_value(finalStatus);
+        return true;
+    }
+
+public:
+    std::promise<LoadResult> result;
+
+    DownloadOperation(std::filesystem::path&& filePath) : Operation(true), filePath(std::move(filePath)) {}
+
+    bool Handle(const Msg::Packet::Header& header, const char* data) override {
+        if (header.opcode == Msg::Opcodes::Data) {
+            if (!isStarted) [[unlikely]] return Finish(Client::NetworkError);
+
+            // The file that can't be saved is still received.
+            if (status == Client::Success && file.Write(data, header.dataSize, received) != header.dataSize) {
+                status = Client::InvalidSavePath;
+            }
+
+            received += header.dataSize;
+            return (received >= totalSize) ? Finish(status) : false;
+        }
+
+        Msg::Response::Download response;
+        if (header.dataSize < sizeof(response)) [[unlikely]] return Finish(Client::NetworkError);
+        std::memcpy(&response, data, sizeof(response));
+
+        switch (response.status) {
+            case Msg::Response::Download::Ready:
+                break;
+            case Msg::Response::Download::IsNotFile:
+                return Finish(Client::NotRegularFile);
+            case Msg::Response::Download::NoSuchFile:
+                return Finish(Client::NoSuchFile);
+            case Msg::Response::Download::Busy:
+                return Finish(Client::Busy);
+            default:
+                return Finish(Client::NetworkError);
+        }
+
+        isStarted = true;
+        totalSize = response.totalSize;
+
+        if (!file.Open(filePath, File::Mode::Write) || !file.Reserve(totalSize)) status = Client::InvalidSavePath;
+
+        return (totalSize == 0) ? Finish(status) : false;
+    }
+
+    void Fail() override { Finish(Client::NetworkError); }
+};
+
+class AsyncClient::UploadOperation final : public Operation {
+public:
+    std::promise<LoadResult> result;
+
+    bool Handle(const Msg::Packet::Header& header, const char* data) override {
+        Msg::Response::Upload response;
+        if (header.dataSize < sizeof(response)) [[unlikely]] {
+            result.set_value(Client::NetworkError);
+            return true;
+        }
+        std::memcpy(&response, data, sizeof(response));
+
+        switch (response.status) {
+            case Msg::Response::Upload::Committed:
+                result.set_value(Client::Success);
+                break;
+            case Msg::Response::Upload::Corrupted:
+                result.set_value(Client::Corrupted);
+                break;
+            default:
+                result.set_value(Client::InvalidSavePath);
+        }
+        return true;
+    }
+
+    void Fail() override { result.set_value(Client::NetworkError); }
+};
+
+bool AsyncClient::Connect(const std::string& address, unsigned short port) {
+    Disconnect();
+
+    connection = Net::TcpClient::Connect(Net::Address::FromDomain(address.c_str(), port));
+    if (Net::Status status = connection->Fail()) {
+        failure = status;
+        return false;
+    }
+
+    const Net::MacAddress macAddress = Net::GetMacAddress();
+    if (connection->Send(macAddress) == 0) [[unlikely]] {
+        failure = connection->Fail();
+        return false;
+    }
+
+    // The server answers the handshake with the recovery stamps ended by the empty packet,
+    // the interrupted downloads aren't resumed here.
+    Msg::Packet::Header header;
+    do {
+        if (connection->ReceiveAll(header) < sizeof(header)) [[unlikely]] {
+            failure = connection->Fail();
+            return false;
+        }
+        if (header.dataSize > 0) {
+            std::vector<char> stamp(header.dataSize);
+            if (connection->ReceiveAll(stamp.data(), stamp.size()) < stamp.size()) [[unlikely]] {
+                failure = connection->Fail();
+                return false;
+            }
+        }
+    } while (header.opcode != Msg::Opcodes::None);
+
+    wakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    Net::Socket* socket = connection->GetSocket();
+    if (
+        wakeEvent < 0 ||
+        !poller.IsValid() ||
+        !socket->SetBlocking(false) ||
+        !poller.Add(*socket, CONNECTION_KEY, Net::Poller::Readable | Net::Poller::Writable | Net::Poller::Closed) ||
+        !poller.Add(wakeEvent, WAKE_KEY, Net::Poller::Readable)
+    ) [[unlikely]] {
+        failure = Net::Status::Failed;
+        Disconnect();
+        return false;
+    }
+
+    failure = Net::Status::Success;
+    isStopping = false;
+    isRunning = true;
+    input.resize(RECEIVE_BUFFER_SIZE);
+    inputSize = 0;
+
+    loopThread = std::thread(&AsyncClient::RunLoop, this);
+    return true;
+}
+
+void AsyncClient::Disconnect() {
+    if (loopThread.joinable()) {
+        isStopping = true;
+
+        const uint64_t wake = 1;
+        write(wakeEvent, &wake, sizeof(wake));
+
+        loopThread.join();
+    }
+
+    if (wakeEvent >= 0) {
+        close(wakeEvent);
+        wakeEvent = -1;
+    }
+
+    // Closing the socket also removes it from the poller.
+    connection.reset();
+}
+
+uint32_t AsyncClient::TakeRequestId() {
+    const std::lock_guard lock(submissionsMutex);
+
+    const uint32_t requestId = nextRequestId++;
+    if (nextRequestId == Msg::Packet::UNTAGGED) [[unlikely]] ++nextRequestId;
+
+    return requestId;
+}
+
+void AsyncClient::Submit(Submission&& submission) {
+    {
+        const std::lock_guard lock(submissionsMutex);
+
+        if (isRunning) [[likely]] {
+            submissions.push_back(std::move(submission));
+        } else {
+            if (submission.operation) submission.operation->Fail();
+            return;
+        }
+    }
+
+    const uint64_t wake = 1;
+    write(wakeEvent, &wake, sizeof(wake));
+}
+
+std::future<std::string> AsyncClient::Echo(const std::string_view message) {
+    auto operation = std::make_unique<EchoOperation>();
+    std::future<std::string> result = operation->result.get_future();
+
+    Submission submission;
+    submission.requestId = TakeRequestId();
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::Echo);
+    const auto* packet = builder.Tag(submission.requestId).Append(message).Complete();
+
+    submission.output.bytes.assign(packet->RawPtr(), packet->RawPtr() + packet->GetSize());
+    submission.operation = std::move(operation);
+
+    Submit(std::move(submission));
+    return result;
+}
+
+std::future<std::time_t> AsyncClient::Time() {
+    auto operation = std::make_unique<TimeOperation>();
+    std::future<std::time_t> result = operation->result.get_future();
+
+    Submission submission;
+    submission.requestId = TakeRequestId();
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::Time);
+    const auto* packet = builder.Tag(submission.requestId).Complete();
+
+    submission.output.bytes.assign(packet->RawPtr(), packet->RawPtr() + packet->GetSize());
+    submission.operation = std::move(operation);
+
+    Submit(std::move(submission));
+    return result;
+}
+
+std::future<AsyncClient::LoadResult> AsyncClient::Download(const std::string_view fileName) {
+    auto operation = std::make_unique<DownloadOperation>(downloadPath / fileName);
+    std::future<LoadResult> result = operation->result.get_future();
+
+    Submission submission;
+    submission.requestId = TakeRequestId();
+
+    const Msg::Request::Download request = { 0, Msg::Codec::None };
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::Download);
+    const auto* packet = builder.Tag(submission.requestId).Append(request).Append(fileName).Complete();
+
+    submission.output.bytes.assign(packet->RawPtr(), packet->RawPtr() + packet->GetSize());
+    submission.operation = std::move(operation);
+
+    Submit(std::move(submission));
+    return result;
+}
+
+std::future<AsyncClient::LoadResult> AsyncClient::Upload(const std::filesystem::path& filePath) {
+    auto operation = std::make_unique<UploadOperation>();
+    std::future<LoadResult> result = operation->result.get_future();
+
+    Submission submission;
+    Output& output = submission.output;
+
+    std::error_code error;
+    output.fileSize = std::filesystem::file_size(filePath, error);
+
+    Msg::Request::Upload request {};
+    request.fileSize = output.fileSize;
+
+    if (error || !output.file.Open(filePath, File::Mode::Read) || !Hash::Xxh64(output.file, output.fileSize, request.hash)) {
+        operation->result.set_value(Client::NoSuchFile);
+        return result;
+    }
+
+    submission.requestId = TakeRequestId();
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::Upload);
+    const auto* packet = builder.Tag(submission.requestId).Append(request).Append(filePath.filename().c_str()).Complete();
+
+    output.bytes.assign(packet->RawPtr(), packet->RawPtr() + packet->GetSize());
+    submission.operation = std::move(operation);
+
+    Submit(std::move(submission));
+    return result;
+}
+
+void AsyncClient::Start(Submission&& submission) {
+    if (submission.operation && submission.operation->isDownload) {
+        if (runningDownloads >= MAX_RUNNING_DOWNLOADS) {
+            waitingDownloads.push_back(std::move(submission));
+            return;
+        }
+
+        ++runningDownloads;
+    }
+
+    if (submission.operation) operations.emplace(submission.requestId, std::move(submission.operation));
+    outputs.push_back(std::move(submission.output));
+}
+
+void AsyncClient::RunLoop() {
+    std::vector<Submission> taken;
+    Net::Poller::Event events[2];
+
+    while (!isStopping) {
+        {
+            const std::lock_guard lock(submissionsMutex);
+            taken.swap(submissions);
+        }
+
+        for (Submission& submission : taken) Start(std::move(submission));
+        taken.clear();
+
+        if (!FlushOutputs() || !ReceiveFrames()) [[unlikely]] break;
+
+        // Finished downloads let the waiting ones run.
+        while (!waitingDownloads.empty() && runningDownloads < MAX_RUNNING_DOWNLOADS) {
+            Submission submission = std::move(waitingDownloads.front());
+            waitingDownloads.pop_front();
+
+            Start(std::move(submission));
+        }
+        if (!outputs.empty() && !FlushOutputs()) [[unlikely]] break;
+
+        const int count = poller.Wait(events, std::size(events));
+        if (count < 0) [[unlikely]] {
+            if (errno == EINTR) continue;
+
+            failure = Net::Status::Failed;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (events[i].key != WAKE_KEY) continue;
+
+            uint64_t wakes;
+            read(wakeEvent, &wakes, sizeof(wakes));
+        }
+    }
+
+    FailAll();
+}
+
+bool AsyncClient::FlushOutputs() {
+    while (!outputs.empty()) {
+        Output& output = outputs.front();
+
+        if (output.offset == output.bytes.size()) {
+            if (output.filePosition == output.fileSize) {
+                outputs.pop_front();
+                continue;
+            }
+
+            // The next chunk of the uploaded file replaces the sent bytes.
+            const size_t chunkSize = std::min(UPLOAD_CHUNK_SIZE, output.fileSize - output.filePosition);
+            output.bytes.resize(chunkSize);
+
+            if (output.file.Read(output.bytes.data(), chunkSize, output.filePosition) != chunkSize) [[unlikely]] {
+                failure = Net::Status::Failed;
+                return false;
+            }
+
+            output.filePosition += chunkSize;
+            output.offset = 0;
+        }
+
+        const size_t size = output.bytes.size() - output.offset;
+        const uint sent = connection->Send(output.bytes.data() + output.offset, size);
+
+        if (sent == 0) {
+            const Net::Status status = connection->Fail();
+            if (status == Net::Status::WouldBlock || status == Net::Status::TryAgain) return true;
+
+            failure = (status == Net::Status::Success) ? Net::Status::ConnectionReset : status;
+            return false;
+        }
+
+        output.offset += sent;
+    }
+
+    return true;
+}
+
+bool AsyncClient::ReceiveFrames() {
+    while (true) {
+        const uint received = connection->Receive(input.data() + inputSize, input.size() - inputSize);
+
+        if (received == 0) {
+            const Net::Status status = connection->Fail();
+            if (status == Net::Status::WouldBlock || status == Net::Status::TryAgain) return true;
+
+            // Closed by the server.
+            failure = (status == Net::Status::Success) ? Net::Status::ConnectionReset : status;
+            return false;
+        }
+
+        inputSize += received;
+
+        // Handle the complete frames, the incomplete one is moved to the start of the buffer.
+        size_t offset = 0;
+        while (inputSize - offset >= sizeof(Msg::Packet::Header)) {
+            Msg::Packet::Header header;
+            std::memcpy(&header, input.data() + offset, sizeof(header));
+
+            const size_t frameSize = sizeof(header) + header.dataSize;
+            if (inputSize - offset < frameSize) break;
+
+            const auto it = operations.find(header.requestId);
+            if (it == operations.end()) [[unlikely]] {
+                failure = Net::Status::Failed;
+                return false;
+            }
+
+            if (it->second->Handle(header, input.data() + offset + sizeof(header))) {
+                if (it->second->isDownload) --runningDownloads;
+                operations.erase(it);
+            }
+
+            offset += frameSize;
+        }
+
+        std::memmove(input.data(), input.data() + offset, inputSize - offset);
+        inputSize -= offset;
+    }
+}
+
+void AsyncClient::FailAll() {
+    std::vector<Submission> taken;
+    {
+        const std::lock_guard lock(submissionsMutex);
+
+        isRunning = false;
+        taken.swap(submissions);
+    }
+
+    for (Submission& submission : taken) waitingDownloads.push_back(std::move(submission));
+
+    for (Submission& submission : waitingDownloads) {
+        if (submission.operation) submission.operation->Fail();
+    }
+    for (auto& [requestId, operation] : operations) operation->Fail();
+
+    waitingDownloads.clear();
+    outputs.clear();
+    operations.clear();
+    runningDownloads = 0;
+}
@@ -1,18 +1,34 @@
 #include "client.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
 
 #include <core/client.h>
+#include <core/compression.h>
+#include <core/hash.h>
 #include <core/packet.h>
 #include <core/net.h>
 
-static void TakeBitrate(const std::chrono::system_clock::time_point begin, const uint bytes) {
+static void TakeBitrate(
+    const std::chrono::system_clock::time_point begin, const uint bytes, const Net::BufferTuner* tuner = nullptr
+) {
     const auto end = std::chrono::system_clock::now();
 
     const size_t timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
     const float bitrate = ((double)bytes / 125000) / ((double)timeNs / 1e+9);
 
-    std::cout << "Bitrate: " << bitrate << " Mb/s.\n";
+    std::cout << "Bitrate: " << bitrate << " Mb/s";
+    if (tuner != nullptr && tuner->IsTuned()) {
+        std::cout << ", RTT: " << tuner->GetRtt() << " us, chunk: " << tuner->GetChunkSize() / 1024
+            << " KiB, socket buffer: " << tuner->GetBufferSize() / 1024 << " KiB";
+    }
+    std::cout << ".\n";
 }
 
 const char* Client::GetLoadResultName(const LoadResult result) {
@@ -21,34 +37,54 @@ const char* Client::GetLoadResultName(const LoadResult result) {
         case NetworkError: return "network error";
         case NoSuchFile: return "no such file";
         case NotRegularFile: return "not a regular file";
+        case Corrupted: return "file corrupted in transfer";
+        case Busy: return "server busy";
         default: return "unknown";
     }
 }
 
-Client::LoadResult Client::HandleDownloadRecovery(std::string& outFileName) {
-    Msg::Packet packet {};
-    if (connection->ReceiveAll(packet) < sizeof(packet)) [[unlikely]] return NetworkError;
-    if (!packet.Is(Msg::Opcodes::DownloadRecovery)) return NoSuchFile;
+Client::LoadResult Client::HandleDownloadRecovery(std::vector<std::string>& outFileNames) {
+    outFileNames.clear();
 
-    if (connection->ReceiveAll(buffer.data(), packet.GetDataSize()) < packet.GetDataSize()) [[unlikely]] return NetworkError;
+    while (true) {
+        Msg::Packet packet {};
+        if (connection->ReceiveAll(packet) < sizeof(packet)) [[unlikely]] return NetworkError;
+        if (!packet.Is(Msg::Opcodes::DownloadRecovery)) break;
 
-    const auto response = reinterpret_cast<Msg::Response::DownloadRecovery*>(buffer.data());
-    outFileName = response->fileName;
+        if (connection->ReceiveAll(buffer.data(), packet.GetDataSize()) < packet.GetDataSize()) [[unlikely]] return NetworkError;
 
-    return Success;
+        const auto response = reinterpret_cast<Msg::Response::DownloadRecovery*>(buffer.data());
+        outFileNames.emplace_back(response->fileName);
+    }
+
+    return outFileNames.empty() ? NoSuchFile : Success;
+}
+
+bool Client::SendPacket(const Msg::Packet* packet, const void* data, const unsigned int dataSize) {
+    iovec buffers[] = {
+        { const_cast<char*>(packet->RawPtr()), packet->GetSize() },
+        { const_cast<void*>(data), dataSize }
+    };
+
+    const unsigned int totalSize = packet->GetSize() + dataSize;
+    return connection->SendV(buffers, (dataSize > 0) ? 2 : 1) == totalSize;
 }
 
 bool Client::Connect(const Net::Protocol protocol, const std::string& address, unsigned short port) {
-    const Net::Address serverAddress = Net::Address::FromDomain(address.c_str(), port);
+    return Connect(protocol, Net::Address::FromDomain(address.c_str(), port));
+}
 
-    if (protocol == Net::Protocol::TCP) {
-        connection = Net::TcpClient::Connect(serverAddress);
-    } else {
-        connection = Net::UdpClient::Connect(serverAddress);
-    }
+bool Client::Connect(const Net::Protocol protocol, const Net::Address& address) {
+    this->protocol = protocol;
+    serverAddress = address;
 
+    connection = Net::Client::Connect(address, protocol);
     if (connection->Fail()) return false;
 
+    // The transfers are tuned to the link of the connection, if the os measures it.
+    sendTuner.Attach(connection->GetSocket());
+    receiveTuner.Attach(connection->GetSocket());
+
     std::cout << "Send mac address.\n";
 
     const Net::MacAddress macAddress = Net::GetMacAddress();
@@ -57,12 +93,18 @@ bool Client::Connect(const Net::Protocol protocol, const std::string& address, u
     return true;
 }
 
+uint32_t Client::TakeRequestId() {
+    const uint32_t requestId = nextRequestId++;
+    if (nextRequestId == Msg::Packet::UNTAGGED) [[unlikely]] ++nextRequestId;
+
+    return requestId;
+}
+
 std::string_view Client::Echo(const std::string_view message) {
     auto builder = Msg::Packet::Build(Msg::Opcodes::Echo);
     const auto* packet = builder.Append(message.begin(), message.size() + 1).Complete();
 
-    if (!connection->Send(packet->RawPtr(), sizeof(Msg::Packet::Header))) [[unlikely]] return {};
-    if (!connection->Send(packet->RawPtr() + sizeof(Msg::Packet::Header), packet->GetDataSize())) [[unlikely]] return {};
+    if (!SendPacket(packet)) [[unlikely]] return {};
 
     if (!connection->ReceiveAll(buffer.data(), message.size() + 1)) [[unlikely]] return {};
 
@@ -73,110 +115,735 @@ std::time_t Client::Time() {
     auto builder = Msg::Packet::Build(Msg::Opcodes::Time);
     const auto* packet = builder.Complete();
 
-    if (!connection->Send(packet->RawPtr(), packet->GetSize())) [[unlikely]] return 0;
+    if (!SendPacket(packet)) [[unlikely]] return 0;
     if (!connection->ReceiveAll(buffer.data(), sizeof(std::time_t))) [[unlikely]] return 0;
 
     return *reinterpret_cast<const std::time_t*>(buffer.data());
 }
 
-Client::LoadResult Client::Download(const std::string_view fileName, const size_t startPos) {    
+Client::LoadResult Client::Download(const std::string_view fileName, const size_t startPos) {
     const std::filesystem::path filePath = downloadPath / fileName;
-    std::ofstream fileStream(
-        filePath,
-        std::ios_base::binary | ((startPos > 0) ? std::ios_base::app : std::ios_base::out)
-    );
-    if (!fileStream.is_open()) [[unlikely]] return InvalidSavePath;
+
+    File file;
+    if (!file.Open(filePath, (startPos > 0) ? File::Mode::Update : File::Mode::Write)) [[unlikely]] return InvalidSavePath;
 
     LoadResult result = NetworkError;
 
-    const Msg::Request::Download request = { startPos };
+    const Msg::Request::Download request = { startPos, codec };
 
     auto builder = Msg::Packet::Build(Msg::Opcodes::Download);
     const auto* packet = builder.Append(request).Append(fileName).Complete();
 
-    if (!connection->Send(packet->RawPtr(), sizeof(Msg::Packet::Header))) [[unlikely]] goto ret;
-    if (!connection->Send(packet->RawPtr() + sizeof(Msg::Packet::Header), packet->GetDataSize())) [[unlikely]] goto ret;
-
-    if (!connection->ReceiveAll(buffer.data(), sizeof(Msg::Response::Download))) [[unlikely]] goto ret;
+    if (!SendPacket(packet)) [[unlikely]] goto ret;
 
     {
-        const Msg::Response::Download* response = reinterpret_cast<Msg::Response::Download*>(buffer.data());
-        if (response->status != Msg::Response::Download::Ready) {
-            result = (response->status == Msg::Response::Download::NoSuchFile) ? NoSuchFile : NotRegularFile;
-            goto ret;
+        // Nothing but the file follows the response, so its first chunk can be received at once.
+        Msg::Response::Download response;
+        iovec buffers[] = {
+            { &response, sizeof(response) },
+            { transferBuffer.data(), transferBuffer.size() }
+        };
+
+        const uint received = connection->ReceiveV(buffers, 2);
+        if (received == 0) [[unlikely]] goto ret;
+        if (received < sizeof(response)) {
+            char* responseTail = reinterpret_cast<char*>(&response) + received;
+            if (!connection->ReceiveAll(responseTail, sizeof(response) - received)) [[unlikely]] goto ret;
         }
 
-        // Receive file by chunks.
-        {
-            if (startPos != 0) fileStream.seekp(startPos);
+        if (response.status != Msg::Response::Download::Ready) {
+            result = (response.status == Msg::Response::Download::NoSuchFile) ? NoSuchFile : NotRegularFile;
+            goto ret;
+        }
 
-            const size_t dataSize = response->totalSize;
-            const auto beginTime = std::chrono::system_clock::now();
+        const size_t dataSize = response.totalSize;
+        const auto beginTime = std::chrono::system_clock::now();
 
-            size_t bytesToReceive = response->totalSize;
-            while (bytesToReceive > 0) {
-                const size_t chunkSize = std::min(buffer.size(), bytesToReceive);
-                const uint received = connection->Receive(buffer.data(), chunkSize);
-    
-                if (received == 0) goto ret;
+        const size_t firstChunkSize = (received > sizeof(response)) ? received - sizeof(response) : 0;
 
-                fileStream.write(buffer.data(), received);
-                bytesToReceive -= received;
-            }
+        std::vector<size_t> damagedChunks;
+        result = ReceiveContent(
+            file, startPos, dataSize, response.codec, transferBuffer.data(), firstChunkSize, damagedChunks
+        );
+        if (result != Success) goto ret;
 
-            TakeBitrate(beginTime, dataSize);
-        }
+        TakeBitrate(beginTime, dataSize, &receiveTuner);
 
-        result = Success;
+        if (!damagedChunks.empty()) [[unlikely]] result = RepairChunks(fileName, file, startPos, dataSize, damagedChunks);
     }
 
 ret:
     if (result != Success) {
-        fileStream.close();
+        file.Close();
         std::filesystem::remove(filePath);
     }
 
     return result;
 }
 
+Client::LoadResult Client::RequestRange(
+    const std::string_view fileName, const size_t position, const size_t size,
+    Msg::Response::Download& outResponse
+) {
+    const Msg::Request::DownloadRange request = { position, size };
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::DownloadRange);
+    const auto* packet = builder.Append(request).Append(fileName).Complete();
+
+    if (!SendPacket(packet)) [[unlikely]] return NetworkError;
+    if (connection->ReceiveAll(outResponse) < sizeof(outResponse)) [[unlikely]] return NetworkError;
+
+    switch (outResponse.status) {
+        case Msg::Response::Download::Ready: return Success;
+        case Msg::Response::Download::NoSuchFile: return NoSuchFile;
+        default: return NotRegularFile;
+    }
+}
+
+Client::LoadResult Client::ReceiveContent(
+    const File& file, const size_t position, const size_t size, const Msg::Codec codec,
+    const char* received, const size_t receivedSize, std::vector<size_t>& outDamagedChunks
+) {
+    Hash::ChunkChecksums checksums(Msg::CHECKSUM_CHUNK_SIZE);
+    checksums.Reset(position);
+    size_t receivedOffset = 0;
+    receiveTuner.Begin();
+
+    // The bytes received along with the response are taken first.
+    const auto receiveAll = [&](void* data, const size_t dataSize) {
+        const size_t taken = std::min(dataSize, receivedSize - receivedOffset);
+        if (taken > 0) std::memcpy(data, received + receivedOffset, taken);
+        receivedOffset += taken;
+
+        const size_t left = dataSize - taken;
+        return left == 0 || connection->ReceiveAll(static_cast<char*>(data) + taken, left) == left;
+    };
+    const auto write = [&](const char* data, const size_t dataSize, const size_t offset) {
+        checksums.Update(data, dataSize);
+        return file.Write(data, dataSize, position + offset) == dataSize;
+    };
+
+    if (codec != Msg::Codec::None) {
+        std::vector<char> packed(Compression::MAX_BLOCK_SIZE);
+        std::vector<char> block(Compression::MAX_BLOCK_SIZE);
+
+        for (size_t unpacked = 0; unpacked < size;) {
+            Compression::BlockHeader header;
+            if (!receiveAll(&header, sizeof(header))) [[unlikely]] return NetworkError;
+
+            const size_t payloadSize = Compression::GetPayloadSize(header);
+            if (payloadSize == 0 || payloadSize > Compression::MAX_BLOCK_SIZE) [[unlikely]] return NetworkError;
+            if (!receiveAll(packed.data(), payloadSize)) [[unlikely]] return NetworkError;
+
+            const size_t blockSize = Compression::UnpackBlock(codec, header, packed.data(), block.data());
+            if (blockSize == 0 || blockSize > size - unpacked) [[unlikely]] return NetworkError;
+
+            if (!write(block.data(), blockSize, unpacked)) [[unlikely]] return InvalidSavePath;
+            unpacked += blockSize;
+        }
+    } else {
+        // The received bytes are written in place, the checksums may follow them as well.
+        size_t written = std::min(size, receivedSize);
+        if (written > 0 && !write(received, written, 0)) [[unlikely]] return InvalidSavePath;
+        receivedOffset = written;
+
+        while (written < size) {
+            const size_t chunkSize = std::min<size_t>(receiveTuner.GetChunkSize(), size - written);
+            if (chunkSize > transferBuffer.size()) transferBuffer.resize(chunkSize);
+
+            const uint chunkReceived = connection->Receive(transferBuffer.data(), chunkSize);
+            if (chunkReceived == 0) [[unlikely]] return NetworkError;
+
+            if (!write(transferBuffer.data(), chunkReceived, written)) [[unlikely]] return InvalidSavePath;
+            written += chunkReceived;
+            receiveTuner.Update(chunkReceived);
+        }
+    }
+
+    const std::vector<uint32_t>& computed = checksums.Finish();
+    std::vector<uint32_t> expected(computed.size());
+    if (!receiveAll(expected.data(), expected.size() * sizeof(expected[0]))) [[unlikely]] return NetworkError;
+
+    outDamagedChunks.clear();
+    for (size_t i = 0; i < computed.size(); ++i) {
+        if (computed[i] != expected[i]) [[unlikely]] outDamagedChunks.push_back(i);
+    }
+    return Success;
+}
+
+Client::LoadResult Client::RepairChunks(
+    const std::string_view fileName, const File& file, const size_t position, const size_t size,
+    const std::vector<size_t>& damagedChunks
+) {
+    std::vector<size_t> stillDamaged;
+
+    // The chunks are aligned within the file, the first and the last ones are cut by the content.
+    const size_t firstChunkPos = position - position % Msg::CHECKSUM_CHUNK_SIZE;
+
+    for (const size_t chunk : damagedChunks) {
+        const size_t chunkPos = std::max(position, firstChunkPos + chunk * Msg::CHECKSUM_CHUNK_SIZE);
+        const size_t chunkSize = std::min(firstChunkPos + (chunk + 1) * Msg::CHECKSUM_CHUNK_SIZE, position + size) - chunkPos;
+
+        std::cerr << "Chunk at " << chunkPos << " is damaged, downloading it again.\n";
+
+        unsigned int attempt = 0;
+        for (; attempt < MAX_REPAIR_ATTEMPTS; ++attempt) {
+            Msg::Response::Download response;
+            if (LoadResult result = RequestRange(fileName, chunkPos, chunkSize, response)) return result;
+            // The file is changed since the download.
+            if (response.totalSize != chunkSize) [[unlikely]] return Corrupted;
+
+            if (LoadResult result = ReceiveContent(
+                file, chunkPos, chunkSize, Msg::Codec::None, nullptr, 0, stillDamaged
+            )) return result;
+
+            if (stillDamaged.empty()) break;
+        }
+
+        if (attempt == MAX_REPAIR_ATTEMPTS) [[unlikely]] return Corrupted;
+    }
+
+    return Success;
+}
+
+Client::LoadResult Client::ReceiveRange(
+    const std::string_view fileName, const File& file, const size_t position, const size_t size
+) {
+    std::vector<size_t> damagedChunks;
+    if (LoadResult result = ReceiveContent(file, position, size, Msg::Codec::None, nullptr, 0, damagedChunks)) {
+        return result;
+    }
+
+    if (damagedChunks.empty()) [[likely]] return Success;
+    return RepairChunks(fileName, file, position, size, damagedChunks);
+}
+
+Client::LoadResult Client::FetchRange(
+    const Client& origin, const std::string_view fileName,
+    const size_t position, const size_t size, const File& file
+) {
+    if (!Connect(origin.protocol, origin.serverAddress)) [[unlikely]] return NetworkError;
+
+    // The server answers the handshake with the recovery stamps, they're of no use here.
+    std::vector<std::string> recoveryFileNames;
+    if (HandleDownloadRecovery(recoveryFileNames) == NetworkError) [[unlikely]] return NetworkError;
+
+    Msg::Response::Download response;
+    if (LoadResult result = RequestRange(fileName, position, size, response)) return result;
+    // The file is changed since its size was taken.
+    if (response.totalSize != size) [[unlikely]] return NetworkError;
+
+    if (LoadResult result = ReceiveRange(fileName, file, position, size)) return result;
+
+    Close();
+    return Success;
+}
+
+Client::LoadResult Client::DownloadParallel(const std::string_view fileName, const unsigned int connections) {
+    if (protocol != Net::Protocol::TCP) return Download(fileName, 0);
+
+    // Empty range only reports the file size.
+    Msg::Response::Download response;
+    if (LoadResult result = RequestRange(fileName, 0, 0, response)) return result;
+
+    const size_t fileSize = response.fileSize;
+    const std::filesystem::path filePath = downloadPath / fileName;
+
+    File file;
+    if (!file.Open(filePath, File::Mode::Write) || !file.Reserve(fileSize)) [[unlikely]] return InvalidSavePath;
+
+    const size_t rangesCount = std::clamp<size_t>((fileSize + MIN_RANGE_SIZE - 1) / MIN_RANGE_SIZE, 1, connections);
+    const auto getRangeStart = [&](const size_t index) { return fileSize * index / rangesCount; };
+
+    const auto beginTime = std::chrono::system_clock::now();
+
+    // The first range goes over the current connection, the others over the extra ones.
+    std::vector<std::unique_ptr<Client>> workers;
+    std::vector<LoadResult> results(rangesCount, Success);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < rangesCount; ++i) {
+        Client& worker = *workers.emplace_back(std::make_unique<Client>());
+        const size_t position = getRangeStart(i);
+        const size_t size = getRangeStart(i + 1) - position;
+
+        threads.emplace_back([&, i, position, size]() {
+            results[i] = worker.FetchRange(*this, fileName, position, size, file);
+        });
+    }
+
+    const size_t firstSize = getRangeStart(1);
+    results[0] = RequestRange(fileName, 0, firstSize, response);
+    if (results[0] == Success) results[0] = ReceiveRange(fileName, file, 0, firstSize);
+
+    for (auto& thread : threads) thread.join();
+
+    for (const LoadResult result : results) {
+        if (result == Success) continue;
+
+        file.Close();
+        std::filesystem::remove(filePath);
+        return result;
+    }
+
+    TakeBitrate(beginTime, fileSize);
+    return Success;
+}
+
+Client::LoadResult Client::DownloadRange(const std::string_view fileName, const size_t position, const size_t size) {
+    const std::filesystem::path filePath = downloadPath / fileName;
+    const bool isNewFile = !std::filesystem::exists(filePath);
+
+    File file;
+    if (!file.Open(filePath, File::Mode::Update)) [[unlikely]] return InvalidSavePath;
+
+    Msg::Response::Download response;
+    LoadResult result = RequestRange(fileName, position, size, response);
+
+    // The range is cut at the end of the file.
+    const auto beginTime = std::chrono::system_clock::now();
+    if (result == Success) result = ReceiveRange(fileName, file, position, response.totalSize);
+
+    if (result != Success) {
+        file.Close();
+        if (isNewFile) std::filesystem::remove(filePath);
+        return result;
+    }
+
+    TakeBitrate(beginTime, response.totalSize, &receiveTuner);
+    return Success;
+}
+
+Client::LoadResult Client::DownloadPipelined(const std::vector<std::string_view>& fileNames) {
+    struct PendingDownload {
+        std::filesystem::path filePath;
+        std::string_view fileName;
+        File file;
+        size_t totalSize = 0;
+        size_t received = 0;
+        bool isStarted = false;
+    };
+
+    std::unordered_map<uint32_t, PendingDownload> downloads;
+    std::deque<std::string_view> waiting(fileNames.begin(), fileNames.end());
+    // Shrinks if the server streams fewer downloads at once.
+    size_t maxRunning = MAX_PIPELINED_DOWNLOADS;
+
+    LoadResult result = Success;
+    size_t totalSize = 0;
+    const auto beginTime = std::chrono::system_clock::now();
+
+    for (;;) {
+        while (downloads.size() < maxRunning && !waiting.empty()) {
+            const std::string_view fileName = waiting.front();
+            const uint32_t requestId = TakeRequestId();
+            const Msg::Request::Download request = { 0, Msg::Codec::None };
+
+            auto builder = Msg::Packet::Build(Msg::Opcodes::Download);
+            const auto* packet = builder.Tag(requestId).Append(request).Append(fileName).Complete();
+
+            if (!SendPacket(packet)) [[unlikely]] goto broken;
+
+            PendingDownload& download = downloads[requestId];
+            download.fileName = fileName;
+            download.filePath = downloadPath / fileName;
+            waiting.pop_front();
+        }
+        if (downloads.empty()) break;
+
+        Msg::Packet::Header header;
+        if (connection->ReceiveAll(header) < sizeof(header)) [[unlikely]] goto broken;
+
+        const auto it = downloads.find(header.requestId);
+        if (it == downloads.end() || header.dataSize == 0 || header.dataSize > transferBuffer.size()) [[unlikely]] goto broken;
+        if (connection->ReceiveAll(transferBuffer.data(), header.dataSize) < header.dataSize) [[unlikely]] goto broken;
+
+        PendingDownload& download = it->second;
+
+        if (header.opcode == Msg::Opcodes::Download) {
+            Msg::Response::Download response;
+            if (header.dataSize < sizeof(response)) [[unlikely]] goto broken;
+            std::memcpy(&response, transferBuffer.data(), sizeof(response));
+
+            // The file is requested again once another download finishes.
+            if (response.status == Msg::Response::Download::Busy) {
+                waiting.push_front(download.fileName);
+                downloads.erase(it);
+
+                maxRunning = downloads.size();
+                if (maxRunning == 0) [[unlikely]] {
+                    if (result == Success) result = Busy;
+                    waiting.clear();
+                }
+                continue;
+            }
+            if (response.status != Msg::Response::Download::Ready) {
+                if (result == Success) {
+                    result = (response.status == Msg::Response::Download::IsNotFile) ? NotRegularFile : NoSuchFile;
+                }
+                downloads.erase(it);
+                continue;
+            }
+
+            // The file that can't be saved is still received.
+            if (!download.file.Open(download.filePath, File::Mode::Write) || !download.file.Reserve(response.totalSize)) {
+                if (result == Success) result = InvalidSavePath;
+                download.file.Close();
+            }
+
+            download.isStarted = true;
+            download.totalSize = response.totalSize;
+            totalSize += response.totalSize;
+        } else if (header.opcode == Msg::Opcodes::Data && download.isStarted) {
+            if (download.file.IsOpen()) {
+                const size_t written = download.file.Write(transferBuffer.data(), header.dataSize, download.received);
+                if (written != header.dataSize) [[unlikely]] {
+                    if (result == Success) result = InvalidSavePath;
+                    download.file.Close();
+                }
+            }
+            download.received += header.dataSize;
+        } else [[unlikely]] {
+            goto broken;
+        }
+
+        if (download.isStarted && download.received >= download.totalSize) {
+            const bool isSaved = download.file.IsOpen();
+            download.file.Close();
+
+            if (!isSaved) std::filesystem::remove(download.filePath);
+            downloads.erase(it);
+        }
+    }
+
+    TakeBitrate(beginTime, totalSize);
+    return result;
+
+broken:
+    // The files that aren't received completely are dropped.
+    for (auto& [requestId, download] : downloads) {
+        download.file.Close();
+        if (download.isStarted) std::filesystem::remove(download.filePath);
+    }
+    return NetworkError;
+}
+
+Client::LoadResult Client::SendBlocks(const File& file, size_t position, const size_t size, const Msg::Codec codec) {
+    std::vector<char> packed(Compression::MAX_PACKED_BLOCK_SIZE);
+
+    for (const size_t endPosition = position + size; position < endPosition;) {
+        const size_t blockSize = std::min(Compression::MAX_BLOCK_SIZE, endPosition - position);
+        if (file.Read(transferBuffer.data(), blockSize, position) != blockSize) [[unlikely]] return NoSuchFile;
+
+        const size_t packedSize = Compression::PackBlock(codec, transferBuffer.data(), blockSize, packed.data());
+        if (connection->Send(packed.data(), packedSize) != packedSize) [[unlikely]] return NetworkError;
+
+        position += blockSize;
+    }
+
+    return Success;
+}
+
 Client::LoadResult Client::Upload(const std::string_view filePathStr) {
     const std::filesystem::path filePath = filePathStr;
 
-    std::ifstream fileStream(filePath, std::ios::binary);
-    if (!fileStream.is_open()) [[unlikely]] return NoSuchFile;
+    File file;
+    if (!file.Open(filePath, File::Mode::Read)) [[unlikely]] return NoSuchFile;
+
+    const size_t fileSize = std::filesystem::file_size(filePath);
+
+    uint64_t hash;
+    if (!Hash::Xxh64(file, fileSize, hash)) [[unlikely]] return NoSuchFile;
+
+    size_t position;
+    if (LoadResult result = RequestUploadRecovery(filePath.filename(), fileSize, hash, position)) return result;
+
+    if (position > 0) std::cout << "Continue upload from " << position << " bytes.\n";
+
+    LoadResult result = SendUpload(file, filePath.filename(), fileSize, hash, position);
+
+    // The kept part is discarded by the server if it's damaged, the file is sent as a whole then.
+    if (result == Corrupted && position > 0) result = SendUpload(file, filePath.filename(), fileSize, hash, 0);
+
+    return result;
+}
+
+Client::LoadResult Client::List(
+    const std::string_view prefix, const std::string_view after, const unsigned int maxCount,
+    std::vector<FileEntry>& outEntries, bool& outHasMore
+) {
+    using Entry = Msg::Response::ListEntry;
+
+    outEntries.clear();
+    outHasMore = false;
+
+    const Msg::Request::List request = { maxCount };
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::List);
+    const auto* packet = builder.Append(request).Append(prefix).Append(after).Complete();
+
+    if (!SendPacket(packet)) [[unlikely]] return NetworkError;
+
+    Msg::Response::List response;
+    if (connection->ReceiveAll(response) < sizeof(response)) [[unlikely]] return NetworkError;
+    if (response.size > transferBuffer.size()) [[unlikely]] return NetworkError;
+    if (response.size > 0 && connection->ReceiveAll(transferBuffer.data(), response.size) < response.size) [[unlikely]] {
+        return NetworkError;
+    }
+
+    // The entries aren't aligned, each ends by its path.
+    const char* data = transferBuffer.data();
+    const char* end = data + response.size;
+
+    for (uint32_t i = 0; i < response.count; ++i) {
+        Entry entry;
+        if (static_cast<size_t>(end - data) < sizeof(entry)) [[unlikely]] return NetworkError;
+        std::memcpy(&entry, data, sizeof(entry));
+
+        const char* path = data + sizeof(entry);
+        const size_t pathSize = strnlen(path, end - path);
+        if (pathSize == static_cast<size_t>(end - path)) [[unlikely]] return NetworkError;
+
+        outEntries.push_back({ std::string(path, pathSize), entry.fileSize, entry.modifyTime });
+        data = path + pathSize + 1;
+    }
+
+    outHasMore = response.hasMore;
+    return Success;
+}
+
+Client::LoadResult Client::RequestUploadRecovery(
+    const std::filesystem::path& fileName, const size_t fileSize, const uint64_t hash, size_t& outPosition
+) {
+    const Msg::Request::UploadRecovery request = { fileSize, hash };
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::UploadRecovery);
+    const auto* packet = builder.Append(request).Append(fileName.c_str()).Complete();
+
+    if (!SendPacket(packet)) [[unlikely]] return NetworkError;
 
+    Msg::Response::UploadRecovery response;
+    if (connection->ReceiveAll(response) < sizeof(response)) [[unlikely]] return NetworkError;
+    if (response.position >= fileSize) [[unlikely]] return NetworkError;
+
+    outPosition = response.position;
+    return Success;
+}
+
+Client::LoadResult Client::SendUpload(
+    const File& file, const std::filesystem::path& fileName,
+    const size_t fileSize, const uint64_t hash, const size_t position
+) {
     Msg::Request::Upload request;
-    request.fileSize = std::filesystem::file_size(filePath);
+    request.fileSize = fileSize;
+    request.position = position;
+    request.hash = hash;
+    request.codec = Compression::Choose(codec, file, position, fileSize - position);
 
     auto builder = Msg::Packet::Build(Msg::Opcodes::Upload);
     const auto* packet = builder
         .Append(request)
-        .Append(filePath.filename().c_str())
+        .Append(fileName.c_str())
         .Complete();
 
-    if (!connection->Send(packet->RawPtr(), sizeof(Msg::Packet::Header))) [[unlikely]] return NetworkError;
-    if (!connection->Send(packet->RawPtr() + sizeof(Msg::Packet::Header), packet->GetDataSize())) [[unlikely]] return NetworkError;
+    const auto beginTime = std::chrono::system_clock::now();
+
+    if (request.codec != Msg::Codec::None) {
+        if (!SendPacket(packet)) [[unlikely]] return NetworkError;
+        if (LoadResult result = SendBlocks(file, position, fileSize - position, request.codec)) return result;
+    } else {
+        // The request goes along with the first chunk of the file.
+        const size_t firstChunkSize = std::min<size_t>(buffer.size(), fileSize - position);
+        if (file.Read(buffer.data(), firstChunkSize, position) != firstChunkSize) [[unlikely]] return NoSuchFile;
+
+        if (!SendPacket(packet, buffer.data(), firstChunkSize)) [[unlikely]] return NetworkError;
+        sendTuner.Begin();
+
+        for (size_t chunkPosition = position + firstChunkSize; chunkPosition < fileSize;) {
+            const size_t chunkSize = std::min<size_t>(sendTuner.GetChunkSize(), fileSize - chunkPosition);
+            if (chunkSize > transferBuffer.size()) transferBuffer.resize(chunkSize);
+
+            if (file.Read(transferBuffer.data(), chunkSize, chunkPosition) != chunkSize) [[unlikely]] return NoSuchFile;
+
+            if (connection->Send(transferBuffer.data(), chunkSize) != chunkSize) [[unlikely]] return NetworkError;
+
+            chunkPosition += chunkSize;
+            sendTuner.Update(chunkSize);
+        }
+    }
+
+    // The server answers once the stored file is checked.
+    Msg::Response::Upload response;
+    if (connection->ReceiveAll(response) < sizeof(response)) [[unlikely]] return NetworkError;
+
+    TakeBitrate(beginTime, fileSize - position, &sendTuner);
+
+    switch (response.status) {
+        case Msg::Response::Upload::Committed: return Success;
+        case Msg::Response::Upload::Corrupted: return Corrupted;
+        default: return InvalidSavePath;
+    }
+}
+
+Client::LoadResult Client::UploadDelta(const std::string_view filePathStr) {
+    using Command = Msg::Request::DeltaCommand;
+
+    const std::filesystem::path filePath = filePathStr;
+
+    File file;
+    if (!file.Open(filePath, File::Mode::Read)) [[unlikely]] return NoSuchFile;
+
+    const size_t fileSize = std::filesystem::file_size(filePath);
+    if (fileSize == 0) return Upload(filePathStr);
+
+    Msg::Request::DeltaUpload request = { fileSize, 0 };
+    if (!Hash::Xxh64(file, fileSize, request.hash)) [[unlikely]] return NoSuchFile;
+
+    auto builder = Msg::Packet::Build(Msg::Opcodes::DeltaUpload);
+    const auto* packet = builder.Append(request).Append(filePath.filename().c_str()).Complete();
+
+    if (!SendPacket(packet)) [[unlikely]] return NetworkError;
+
+    Msg::Response::DeltaUpload response;
+    if (connection->ReceiveAll(response) < sizeof(response)) [[unlikely]] return NetworkError;
+
+    switch (response.status) {
+        case Msg::Response::DeltaUpload::Ready: break;
+        case Msg::Response::DeltaUpload::NoBase: return Upload(filePathStr);
+        default: return InvalidSavePath;
+    }
+    if (response.blockSize == 0 || response.blockCount == 0) [[unlikely]] return NetworkError;
 
     const auto beginTime = std::chrono::system_clock::now();
 
-    size_t bytesToSend = request.fileSize;
-    while (bytesToSend > 0) {
-        const size_t chunkSize = std::min(buffer.size(), bytesToSend);
-        fileStream.read(buffer.data(), chunkSize);
+    std::vector<Msg::Response::BlockSignature> signatures(response.blockCount);
+    const size_t signaturesSize = signatures.size() * sizeof(signatures[0]);
+    if (connection->ReceiveAll(signatures.data(), signaturesSize) < signaturesSize) [[unlikely]] return NetworkError;
+
+    // Blocks of the server copy by their weak checksums, the short last block can't match the window.
+    const size_t blockSize = response.blockSize;
+    const uint32_t fullBlocks = response.blockCount - ((response.lastBlockSize == blockSize) ? 0 : 1);
+
+    std::unordered_multimap<uint32_t, uint32_t> blocks;
+    blocks.reserve(fullBlocks);
+    for (uint32_t i = 0; i < fullBlocks; ++i) blocks.emplace(signatures[i].weak, i);
+
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file.GetDescriptor(), 0);
+    if (mapping == MAP_FAILED) [[unlikely]] return NoSuchFile;
+
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+    const auto* data = static_cast<const uint8_t*>(mapping);
+
+    // Commands are gathered, the literals of the full buffer size are sent right from the file.
+    std::vector<char> output;
+    output.reserve(transferBuffer.size());
+    size_t sentSize = 0;
+
+    const auto flush = [&]() {
+        if (output.empty()) return true;
+
+        const bool isSent = connection->Send(output.data(), output.size()) == output.size();
+        sentSize += output.size();
+        output.clear();
+        return isSent;
+    };
+    const auto append = [&](const void* bytes, const size_t size) {
+        if (output.size() + size > transferBuffer.size() && !flush()) return false;
+
+        const char* begin = static_cast<const char*>(bytes);
+        output.insert(output.end(), begin, begin + size);
+        return true;
+    };
+    const auto sendLiteral = [&](const uint8_t* literal, size_t size) {
+        while (size > 0) {
+            const uint32_t pieceSize = std::min<size_t>(size, transferBuffer.size());
+            const Command command = { Command::Literal, pieceSize };
+
+            if (!append(&command, sizeof(command))) return false;
+
+            if (pieceSize < transferBuffer.size()) {
+                if (!append(literal, pieceSize)) return false;
+            } else {
+                if (!flush() || connection->Send(literal, pieceSize) != pieceSize) return false;
+                sentSize += pieceSize;
+            }
+
+            literal += pieceSize;
+            size -= pieceSize;
+        }
+        return true;
+    };
+
+    LoadResult result = NetworkError;
+    Hash::Rolling rolling;
+    bool isRolling = false;
+    size_t literalStart = 0;
+    size_t position = 0;
+
+    while (position + blockSize <= fileSize) {
+        if (!isRolling) {
+            rolling.Reset(data + position, blockSize);
+            isRolling = true;
+        }
+
+        int64_t matchedBlock = -1;
+        const auto [candidate, candidatesEnd] = blocks.equal_range(rolling.Get());
+
+        if (candidate != candidatesEnd) {
+            const uint64_t strong = Hash::Xxh64(data + position, blockSize);
+            for (auto it = candidate; it != candidatesEnd; ++it) {
+                if (signatures[it->second].strong != strong) continue;
+
+                matchedBlock = it->second;
+                break;
+            }
+        }
 
-        if (!connection->Send(buffer.data(), chunkSize)) [[unlikely]] return NetworkError;
+        if (matchedBlock >= 0) {
+            const Command command = { Command::Copy, static_cast<uint32_t>(matchedBlock) };
+            if (!sendLiteral(data + literalStart, position - literalStart) || !append(&command, sizeof(command))) goto ret;
 
-        bytesToSend -= chunkSize;
+            position += blockSize;
+            literalStart = position;
+            isRolling = false;
+            continue;
+        }
+
+        if (position + blockSize < fileSize) rolling.Roll(data[position], data[position + blockSize]);
+        ++position;
     }
 
-    TakeBitrate(beginTime, request.fileSize);
+    if (!sendLiteral(data + literalStart, fileSize - literalStart) || !flush()) goto ret;
 
-    return Success;
+    {
+        // The server answers once the rebuilt file is checked.
+        Msg::Response::Upload commit;
+        if (connection->ReceiveAll(commit) < sizeof(commit)) [[unlikely]] goto ret;
+
+        std::cout << "Delta: " << sentSize << " of " << fileSize << " bytes sent.\n";
+        TakeBitrate(beginTime, fileSize);
+
+        switch (commit.status) {
+            case Msg::Response::Upload::Committed: result = Success; break;
+            case Msg::Response::Upload::Corrupted: result = Corrupted; break;
+            default: result = InvalidSavePath; break;
+        }
+    }
+
+ret:
+    munmap(mapping, fileSize);
+
+    // The blocks of the server copy may match by chance or change while they're copied, the whole file is sent then.
+    if (result == Corrupted) {
+        std::cout << "Rebuilt file doesn't match, upload the whole file.\n";
+        return Upload(filePathStr);
+    }
+    return result;
 }
 
 bool Client::Close() {
     auto builder = Msg::Packet::Build(Msg::Opcodes::Close);
     const auto* packet = builder.Complete();
 
-    return connection->Send(packet->RawPtr(), packet->GetSize()) == packet->GetSize();
+    return SendPacket(packet);
 }
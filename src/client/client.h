@@ -2,21 +2,44 @@
 #define _CLIENT_H
 
 #include <array>
+#include <atomic>
 #include <ctime>
+#include <deque>
 #include <filesystem>
+#include <future>
+#include <mutex>
 #include <string>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #define LIBPOG_LOGS false
 
 #include <core/net.h>
 #include <core/connection.h>
+#include <core/file.h>
 #include <core/socket.h>
+#include <core/packet.h>
+#include <core/message.h>
+#include <core/poller.h>
+#include <core/bufferTuner.h>
 
 class Client {
 public:
     static constexpr unsigned int DEFAULT_BUFFER_SIZE = 4096 * 2;
+    /// Size of the file chunks moved by one call until the link of the connection is measured,
+    /// datagram connections move them by batches of datagrams.
+    static constexpr unsigned int TRANSFER_BUFFER_SIZE = 128 * 1024;
     static constexpr const char* DEFAULT_DOWNLOAD_DIRECTORY = "downloads";
+    /// Parallel downloads don't split the file into smaller ranges.
+    static constexpr size_t MIN_RANGE_SIZE = 1024 * 1024;
+    /// Damaged chunk is downloaded again at most that many times.
+    static constexpr unsigned int MAX_REPAIR_ATTEMPTS = 3;
+    /// Max number of the pipelined downloads requested at once, the server streams that many per connection.
+    static constexpr unsigned int MAX_PIPELINED_DOWNLOADS = 16;
+    /// Number of the files asked by one page of the list.
+    static constexpr unsigned int LIST_PAGE_COUNT = 256;
 
     enum LoadResult {
         Success,
@@ -24,16 +47,81 @@ public:
         NoSuchFile,
         NotRegularFile,
         NetworkError,
+        /// The file the server received doesn't match the sent one.
+        Corrupted,
+        /// The server runs as many downloads of the connection as it can.
+        Busy,
+    };
+
+    /// Hosted file, its path is relative to the host directory.
+    struct FileEntry {
+        std::string path;
+        size_t size = 0;
+        /// Nanoseconds since epoch.
+        int64_t modifyTime = 0;
     };
 
     static const char* GetLoadResultName(const LoadResult result);
 
 private:
     Net::Ptr<Net::Connection> connection;
+    Net::Protocol protocol = Net::Protocol::None;
+    Net::Address serverAddress;
+    uint32_t nextRequestId = Msg::Packet::UNTAGGED + 1;
+
     std::array<char, DEFAULT_BUFFER_SIZE> buffer;
+    /// Grows along with the chunks chosen by the tuners.
+    std::vector<char> transferBuffer = std::vector<char>(TRANSFER_BUFFER_SIZE);
+    Net::BufferTuner sendTuner { Net::BufferTuner::Direction::Send, TRANSFER_BUFFER_SIZE };
+    Net::BufferTuner receiveTuner { Net::BufferTuner::Direction::Receive, TRANSFER_BUFFER_SIZE };
+
+    /// Sends the packet together with the data that follows it within one call.
+    bool SendPacket(const Msg::Packet* packet, const void* data = nullptr, const unsigned int dataSize = 0);
+
+    bool Connect(const Net::Protocol protocol, const Net::Address& address);
+    uint32_t TakeRequestId();
+
+    /// Requests at most `size` bytes of the file starting at `position`, only the response is received.
+    LoadResult RequestRange(
+        const std::string_view fileName, const size_t position, const size_t size,
+        Msg::Response::Download& outResponse
+    );
+    /// Sends `size` bytes of the `file` starting at `position` as the blocks compressed by the `codec`.
+    LoadResult SendBlocks(const File& file, const size_t position, const size_t size, const Msg::Codec codec);
+    /// Asks for the number of bytes of the file the server kept from the interrupted upload.
+    LoadResult RequestUploadRecovery(
+        const std::filesystem::path& fileName, const size_t fileSize, const uint64_t hash, size_t& outPosition
+    );
+    /// Sends the content of the file starting at `position` and waits for the server to check it.
+    LoadResult SendUpload(
+        const File& file, const std::filesystem::path& fileName,
+        const size_t fileSize, const uint64_t hash, const size_t position
+    );
+    /// Receives `size` bytes of the downloaded content, raw or as the blocks compressed by the `codec`,
+    /// and writes them into the `file` at `position`. The `received` bytes that are already taken
+    /// from the connection go first. The checksums of the chunks follow the content, the indices
+    /// of the chunks that don't match them are put into `outDamagedChunks`.
+    LoadResult ReceiveContent(
+        const File& file, const size_t position, const size_t size, const Msg::Codec codec,
+        const char* received, const size_t receivedSize, std::vector<size_t>& outDamagedChunks
+    );
+    /// Downloads the damaged chunks of the content written at `position` again, each by its own range.
+    LoadResult RepairChunks(
+        const std::string_view fileName, const File& file, const size_t position, const size_t size,
+        const std::vector<size_t>& damagedChunks
+    );
+    /// Receives `size` bytes that follow the range response and writes them into the `file` at `position`.
+    LoadResult ReceiveRange(const std::string_view fileName, const File& file, const size_t position, const size_t size);
+    /// Fetches the range of the file over own connection to the server the `origin` is connected to.
+    LoadResult FetchRange(
+        const Client& origin, const std::string_view fileName,
+        const size_t position, const size_t size, const File& file
+    );
 
 public:
     std::filesystem::path downloadPath;
+    /// Codec offered for the downloads and used for the uploads, the incompressible files are sent raw.
+    Msg::Codec codec = Msg::Codec::Lz4;
 
     bool Connect(const Net::Protocol protocol, const std::string& address, unsigned short port);
     void Disconnect();
@@ -41,11 +129,143 @@ public:
     std::string_view Echo(const std::string_view message);
     std::time_t Time();
     LoadResult Download(const std::string_view fileName, const size_t startPos);
+    /// Splits the file into ranges and downloads them by at most `connections` connections at once,
+    /// the current one and the extra ones opened to the same server. Each of them writes its range
+    /// straight into its place within the preallocated file.
+    /// The UDP server serves its clients one by one, so datagram connections download the file as a whole.
+    LoadResult DownloadParallel(const std::string_view fileName, const unsigned int connections);
+    /// Downloads at most `size` bytes of the file starting at `position` into the same place of the local file,
+    /// the rest of which is kept. Fetches a part of a huge file or repairs a damaged region of a downloaded one.
+    LoadResult DownloadRange(const std::string_view fileName, const size_t position, const size_t size);
+    /// Requests the files by the tagged requests over the current connection, the server streams them interleaved.
+    /// At most `MAX_PIPELINED_DOWNLOADS` files are requested at once, the next file is requested as soon as one
+    /// is received. Returns the first failure, the files received completely are kept.
+    LoadResult DownloadPipelined(const std::vector<std::string_view>& fileNames);
+    /// Uploads the file, the server keeps it only if the hash of the received content matches.
+    /// The upload interrupted by the connection loss is continued from the part the server kept.
     LoadResult Upload(const std::string_view filePath);
-    LoadResult HandleDownloadRecovery(std::string& outFileName);
+    /// Uploads only the changes of the file against the copy the server has. The server sends the signatures
+    /// of the blocks of its copy, the blocks found within the file by the rolling checksum are sent
+    /// as references, the rest as literal data. Uploads the whole file if the server has no copy
+    /// or the file it rebuilt doesn't match.
+    LoadResult UploadDelta(const std::string_view filePath);
+    /// Takes the page of at most `maxCount` hosted files whose paths start with the `prefix` and follow the `after` one
+    /// in order, the first page follows the empty one. `outHasMore` tells if more of such files follow the page.
+    LoadResult List(
+        const std::string_view prefix, const std::string_view after, const unsigned int maxCount,
+        std::vector<FileEntry>& outEntries, bool& outHasMore
+    );
+    /// Takes the names of the files whose downloads were interrupted, the server sends them after the handshake.
+    LoadResult HandleDownloadRecovery(std::vector<std::string>& outFileNames);
     bool Close();
 
     inline Net::Status GetStatus() const { return connection->Fail(); }
 };
 
+/// Client that runs any number of requests at once over one connection. Each request is tagged,
+/// so the server answers them independently and streams the downloads interleaved. The responses
+/// are handled by the internal event loop thread, the methods may be called from any thread
+/// and return futures of the results. Failed requests resolve as the `Client` methods fail.
+class AsyncClient {
+public:
+    using LoadResult = Client::LoadResult;
+
+    /// Max number of downloads the server streams at once, the others wait for their turn.
+    static constexpr unsigned int MAX_RUNNING_DOWNLOADS = 16;
+    static constexpr size_t RECEIVE_BUFFER_SIZE = 256 * 1024;
+    /// Max size of the file chunk read by one turn of the upload.
+    static constexpr size_t UPLOAD_CHUNK_SIZE = 128 * 1024;
+
+private:
+    /// Request waiting for its response frames.
+    class Operation {
+    public:
+        /// Downloads are limited by `MAX_RUNNING_DOWNLOADS`.
+        const bool isDownload;
+
+        Operation(const bool isDownload = false) : isDownload(isDownload) {}
+        virtual ~Operation() = default;
+
+        /// Handles the response frame of the request. Returns `true` when the request is complete.
+        virtual bool Handle(const Msg::Packet::Header& header, const char* data) = 0;
+        /// The connection is lost before the request is complete.
+        virtual void Fail() = 0;
+    };
+
+    class EchoOperation;
+    class TimeOperation;
+    class DownloadOperation;
+    class UploadOperation;
+
+    /// Data queued to be sent: the packet followed by the part of the file.
+    struct Output {
+        std::vector<char> bytes;
+        size_t offset = 0;
+
+        File file;
+        size_t filePosition = 0;
+        size_t fileSize = 0;
+    };
+
+    struct Submission {
+        uint32_t requestId;
+        std::unique_ptr<Operation> operation;
+        Output output;
+    };
+
+    Net::Ptr<Net::Connection> connection;
+    Net::Poller poller;
+    int wakeEvent = -1;
+    std::thread loopThread;
+    std::atomic<bool> isStopping = false;
+    std::atomic<Net::Status> failure = Net::Status::Success;
+
+    // Shared with the callers.
+    std::mutex submissionsMutex;
+    std::vector<Submission> submissions;
+    bool isRunning = false;
+    uint32_t nextRequestId = Msg::Packet::UNTAGGED + 1;
+
+    // Owned by the loop thread.
+    std::unordered_map<uint32_t, std::unique_ptr<Operation>> operations;
+    std::deque<Submission> waitingDownloads;
+    unsigned int runningDownloads = 0;
+    std::deque<Output> outputs;
+    std::vector<char> input;
+    size_t inputSize = 0;
+
+    uint32_t TakeRequestId();
+    void Submit(Submission&& submission);
+    void Start(Submission&& submission);
+    void RunLoop();
+    /// Sends the queued outputs until the connection would block. Returns `false` if the connection is lost.
+    bool FlushOutputs();
+    /// Receives and handles the response frames until the connection would block. Returns `false` if the connection is lost.
+    bool ReceiveFrames();
+    void FailAll();
+
+public:
+    std::filesystem::path downloadPath;
+
+    AsyncClient() = default;
+    AsyncClient(const AsyncClient&) = delete;
+    ~AsyncClient() { Disconnect(); }
+
+    /// Connects to the server over TCP and starts the event loop, datagram connections can't be polled.
+    bool Connect(const std::string& address, unsigned short port);
+    /// Stops the event loop, the requests that aren't complete fail.
+    void Disconnect();
+
+    std::future<std::string> Echo(const std::string_view message);
+    std::future<std::time_t> Time();
+    std::future<LoadResult> Download(const std::string_view fileName);
+    /// Uploads occupy the connection until the file is sent, the other requests are sent after it.
+    /// The file is hashed by the calling thread first, the upload resolves when the server checks it.
+    /// The file is always sent whole, the part kept by the server from the interrupted upload is replaced.
+    std::future<LoadResult> Upload(const std::filesystem::path& filePath);
+
+    /// Returns the failure that broke the connection.
+    inline Net::Status GetStatus() const { return failure; }
+};
+
 #endif // _CLIENT_H
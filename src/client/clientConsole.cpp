@@ -1,5 +1,8 @@
 #include "clientConsole.h"
 
+#include <ctime>
+#include <iomanip>
+
 Client ClientConsole::client = {};
 CommandSet ClientConsole::commandSet = {};
 
@@ -8,19 +11,26 @@ const CommandSet& ClientConsole::GetCommandSet() {
     if (isInitialized) return commandSet;
 
     commandSet.RegisterCommand("close",     "\tSending close command to the server",          CloseCmd);
+    commandSet.RegisterCommand("compress",   "Compressing compressible transfers by <none|lz4> codec", CompressCmd);
     commandSet.RegisterCommand("connect",    "Connecting to the server with <ip> and <port>", ConnectCmd);
-    commandSet.RegisterCommand("download",   "Downloading file <name> from srver",            DownloadCmd);
+    commandSet.RegisterCommand("download",   "Downloading file [-j <connections>] <name> or files <name>... at once from srver", DownloadCmd);
     commandSet.RegisterCommand("disconnect", "Close connection on the client side",           DisconnectCmd);
     commandSet.RegisterCommand("echo",      "\tReturns <msg> from server",                    EchoCmd);
+    commandSet.RegisterCommand("fetch",     "\tDownloading part of file <name> from <position> of <size> bytes", FetchCmd);
+    commandSet.RegisterCommand("list",      "\tListing hosted files [prefix] with their sizes and modification times", ListCmd);
     commandSet.RegisterCommand("time",      "\tReturns current server time",                  TimeCmd);
-    commandSet.RegisterCommand("upload",     "Uploading file <name> to server",               UploadCmd);
+    commandSet.RegisterCommand("upload",     "Uploading file [-d] <name> to server, only its changes with -d", UploadCmd);
 
     isInitialized = true;
     return commandSet;
 }
 
-void ClientConsole::Download(const std::string_view fileName, const size_t startPos) {
-    if (Client::LoadResult result = client.Download(fileName, startPos)) {
+void ClientConsole::Download(const std::string_view fileName, const size_t startPos, const unsigned int connections) {
+    const Client::LoadResult result = (connections > 1)
+        ? client.DownloadParallel(fileName, connections)
+        : client.Download(fileName, startPos);
+
+    if (result != Client::Success) {
         std::cerr << "Download failed: " <<
             ((result == Client::NetworkError) ? Net::GetStatusName(client.GetStatus()) : Client::GetLoadResultName(result))
             << ".\n";
@@ -36,6 +46,19 @@ void ClientConsole::CloseCmd() {
     }
 }
 
+void ClientConsole::CompressCmd(const std::string_view codecStr) {
+    if (codecStr == "none") {
+        client.codec = Msg::Codec::None;
+    } else if (codecStr == "lz4") {
+        client.codec = Msg::Codec::Lz4;
+    } else {
+        std::cerr << "Invalid codec: " << codecStr << ".\ncompress <none|lz4>\n";
+        return;
+    }
+
+    std::cout << "Transfers are compressed by " << codecStr << ".\n";
+}
+
 void ClientConsole::ConnectCmd(const std::string_view protocolStr, std::string hostAddress, unsigned short port) {
     Net::Protocol protocol = (
         protocolStr == "tcp" ? Net::Protocol::TCP :
@@ -53,9 +76,9 @@ void ClientConsole::ConnectCmd(const std::string_view protocolStr, std::string h
 
     std::cout << "Connected succefully.\n";
 
-    // Recovery invalid download.
-    std::string fileName;
-    const Client::LoadResult result = client.HandleDownloadRecovery(fileName);
+    // Recovery invalid downloads.
+    std::vector<std::string> fileNames;
+    const Client::LoadResult result = client.HandleDownloadRecovery(fileNames);
 
     if (result == Client::NoSuchFile) return;
     if (result == Client::NetworkError) [[unlikely]] {
@@ -63,8 +86,8 @@ void ClientConsole::ConnectCmd(const std::string_view protocolStr, std::string h
         return;
     }
 
-    // Ask to continue.
-    {
+    for (const std::string& fileName : fileNames) {
+        // Ask to continue.
         std::cout << "The download of file \'" << fileName << "\' was not completed, do you want to continue? [y/n]:\n";
 
         std::string answer;
@@ -72,13 +95,13 @@ void ClientConsole::ConnectCmd(const std::string_view protocolStr, std::string h
             std::getline(std::cin, answer);
         } while (answer.empty());
 
-        if (answer.size() != 1 || (answer[0] != 'y' && answer[0] != 'Y')) return;
-    }
+        if (answer.size() != 1 || (answer[0] != 'y' && answer[0] != 'Y')) continue;
 
-    const std::filesystem::path filePath = client.downloadPath / fileName;
-    const size_t downloadedSize = std::filesystem::exists(filePath) ? std::filesystem::file_size(filePath) : 0;
+        const std::filesystem::path filePath = client.downloadPath / fileName;
+        const size_t downloadedSize = std::filesystem::exists(filePath) ? std::filesystem::file_size(filePath) : 0;
 
-    Download(fileName, downloadedSize);
+        Download(fileName, downloadedSize);
+    }
 }
 
 void ClientConsole::EchoCmd(std::string_view message) {
@@ -101,11 +124,101 @@ void ClientConsole::TimeCmd() {
     std::cout << "Server time: " << std::ctime(&response);
 }
 
-void ClientConsole::DownloadCmd(std::string_view fileName) {
-    Download(fileName, 0);
+void ClientConsole::DownloadCmd(Console::ArgIterator args) {
+    unsigned int connections = 1;
+    std::string_view fileName = args.Next();
+
+    if (fileName == "-j") {
+        const std::string_view value = args.Next();
+        const std::from_chars_result result = std::from_chars(value.begin(), value.end(), connections);
+
+        if (value.empty() || result.ptr != value.end() || connections == 0) {
+            std::cerr << "Expected number of connections: download -j <connections> <name>.\n";
+            return;
+        }
+        fileName = args.Next();
+    }
+
+    if (fileName.empty()) {
+        std::cerr << "Expected file name: download [-j <connections>] <name>.\n";
+        return;
+    }
+
+    std::vector<std::string_view> fileNames = { fileName };
+    for (std::string_view name = args.Next(); !name.empty(); name = args.Next()) fileNames.push_back(name);
+
+    if (fileNames.size() == 1) {
+        Download(fileName, 0, connections);
+        return;
+    }
+    if (connections > 1) {
+        std::cerr << "Files are downloaded by parallel connections one at a time.\n";
+        return;
+    }
+
+    // Several files are pipelined over the current connection.
+    if (Client::LoadResult result = client.DownloadPipelined(fileNames)) {
+        std::cerr << "Download failed: " <<
+            ((result == Client::NetworkError) ? Net::GetStatusName(client.GetStatus()) : Client::GetLoadResultName(result))
+            << ".\n";
+        return;
+    }
+
+    std::cout << "Files saved at " << client.downloadPath << ".\n";
+}
+
+void ClientConsole::FetchCmd(std::string_view fileName, size_t position, size_t size) {
+    if (Client::LoadResult result = client.DownloadRange(fileName, position, size)) {
+        std::cerr << "Fetch failed: " <<
+            ((result == Client::NetworkError) ? Net::GetStatusName(client.GetStatus()) : Client::GetLoadResultName(result))
+            << ".\n";
+        return;
+    }
+
+    std::cout << "Range saved at " << client.downloadPath << ".\n";
+}
+
+void ClientConsole::ListCmd(Console::ArgIterator args) {
+    const std::string_view prefix = args.Next();
+
+    std::vector<Client::FileEntry> entries;
+    std::string after;
+    size_t count = 0;
+    bool hasMore = true;
+
+    // The pages are taken one by one, each follows the last path of the previous one.
+    while (hasMore) {
+        if (Client::LoadResult result = client.List(prefix, after, Client::LIST_PAGE_COUNT, entries, hasMore)) {
+            std::cerr << "List failed: " <<
+                ((result == Client::NetworkError) ? Net::GetStatusName(client.GetStatus()) : Client::GetLoadResultName(result))
+                << ".\n";
+            return;
+        }
+        if (entries.empty()) break;
+
+        for (const Client::FileEntry& entry : entries) {
+            const std::time_t time = entry.modifyTime / 1'000'000'000;
+            std::cout << std::put_time(std::localtime(&time), "%F %T") << '\t' << entry.size << '\t' << entry.path << '\n';
+        }
+
+        count += entries.size();
+        after = entries.back().path;
+    }
+
+    std::cout << count << " files.\n";
 }
 
-void ClientConsole::UploadCmd(std::string_view fileName) {
+void ClientConsole::UploadCmd(Console::ArgIterator args) {
+    std::string_view fileName = args.Next();
+
+    const bool isDelta = (fileName == "-d");
+    if (isDelta) fileName = args.Next();
+
+    if (fileName.empty()) {
+        std::cerr << "Expected file name: upload [-d] <name>.\n";
+        return;
+    }
+
     if (!std::filesystem::exists(fileName)) {
         std::cerr << "No such file.\n";
         return;
@@ -115,7 +228,8 @@ void ClientConsole::UploadCmd(std::string_view fileName) {
         return;
     }
 
-    if (Client::LoadResult result = client.Upload(fileName)) {
+    const Client::LoadResult result = isDelta ? client.UploadDelta(fileName) : client.Upload(fileName);
+    if (result != Client::Success) {
         std::cerr << "Uploading failed: " <<
             ((result == Client::NetworkError) ? Net::GetStatusName(client.GetStatus()) : Client::GetLoadResultName(result))
             << ".\n";
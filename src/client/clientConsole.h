@@ -13,15 +13,19 @@ private:
 
     static const CommandSet& GetCommandSet();
 
-    static void Download(const std::string_view fileName, const size_t startPos);
+    /// Downloads the file by `connections` parallel connections if there are more than one.
+    static void Download(const std::string_view fileName, const size_t startPos, const unsigned int connections = 1);
 
     static void CloseCmd();
+    static void CompressCmd(const std::string_view codecStr);
     static void ConnectCmd(const std::string_view protocolStr, std::string hostAddress, unsigned short port);
     static void DisconnectCmd();
-    static void DownloadCmd(std::string_view fileName);
+    static void DownloadCmd(Console::ArgIterator args);
+    static void FetchCmd(std::string_view fileName, size_t position, size_t size);
+    static void ListCmd(Console::ArgIterator args);
     static void EchoCmd(std::string_view message);
     static void TimeCmd();
-    static void UploadCmd(std::string_view filePath);
+    static void UploadCmd(Console::ArgIterator args);
 public:
     ClientConsole(StdIoConsoleStream& stream) : Console(stream, GetCommandSet()) {}
 };
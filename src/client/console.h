@@ -63,10 +63,8 @@ struct ParseHelper;
 template<typename TupleT, std::size_t Idx, std::size_t... Is>
 struct ParseHelper<TupleT, Idx, Is...> {
     template<typename T>
-    static bool ParseArg(Console::ArgIterator& iter, const std::string_view& argStr, T& outValue) {
-        if constexpr (std::is_same_v<Console::ArgIterator, T>) {
-            outValue = iter;
-        } else if constexpr (std::is_same_v<std::string_view, T> || std::is_same_v<std::string, T>) {
+    static bool ParseArg(const std::string_view& argStr, T& outValue) {
+        if constexpr (std::is_same_v<std::string_view, T> || std::is_same_v<std::string, T>) {
             outValue = argStr;
         } else {
             const std::from_chars_result result = std::from_chars(argStr.begin(), argStr.end(), outValue);
@@ -76,20 +74,27 @@ struct ParseHelper<TupleT, Idx, Is...> {
     }
 
     static bool ParseArg(ConsoleStream& stream, Console::ArgIterator& iter, TupleT& tp) {
-        const auto argStr = iter.Next();
-        if (argStr.empty()) {
-            stream.Write("Too few agruments for command call.\n");
-            return false;
-        }
-
         auto& argValue = std::get<Idx>(tp);
-        if (ParseArg(iter, argStr, argValue) == false) {
-            stream.Write("Invalid argument format: \"");
-            stream.Write(argStr);
-            stream.Write("\".\n");
-            return false;
+
+        // The rest of the arguments, possibly none, is parsed by the command itself.
+        if constexpr (std::is_same_v<Console::ArgIterator, std::decay_t<decltype(argValue)>>) {
+            argValue = iter;
+            return true;
+        } else {
+            const auto argStr = iter.Next();
+            if (argStr.empty()) {
+                stream.Write("Too few agruments for command call.\n");
+                return false;
+            }
+
+            if (ParseArg(argStr, argValue) == false) {
+                stream.Write("Invalid argument format: \"");
+                stream.Write(argStr);
+                stream.Write("\".\n");
+                return false;
+            }
+            return ParseHelper<TupleT, Is...>::ParseArg(stream, iter, tp);
         }
-        return ParseHelper<TupleT, Is...>::ParseArg(stream, iter, tp);
     }
 };
 
@@ -0,0 +1,116 @@
+#include "bufferTuner.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <climits>
+#include <string_view>
+
+#include "file.h"
+
+using namespace Net;
+
+namespace {
+    /// Limits of the socket buffer sizes as reported by the os.
+    struct BufferLimits {
+        /// Max size the os grows the buffer to by itself.
+        int automatic = INT_MAX;
+        /// Max size the buffer can be set to.
+        int settable = 0;
+    };
+}
+
+/// Returns the last of the numbers of the os setting, `0` if there is no such setting.
+static int ReadSetting(const char* path) {
+    File file;
+    char text[128];
+
+    if (!file.Open(path, File::Mode::Read)) return 0;
+    const size_t size = file.Read(text, sizeof(text), 0);
+
+    std::string_view view(text, size);
+    while (!view.empty() && (view.back() == '\n' || view.back() == ' ')) view.remove_suffix(1);
+
+    const size_t begin = view.find_last_of(" \t");
+    if (begin != std::string_view::npos) view.remove_prefix(begin + 1);
+
+    int value = 0;
+    std::from_chars(view.data(), view.data() + view.size(), value);
+    return value;
+}
+
+static BufferLimits ReadLimits(const char* automaticPath, const char* settablePath) {
+    BufferLimits limits;
+
+    // The buffer isn't taken from the os if its limits are unknown.
+    const int automatic = ReadSetting(automaticPath);
+    if (automatic > 0) limits.automatic = automatic;
+
+    // The set size is doubled by the os.
+    limits.settable = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(ReadSetting(settablePath)) * 2, INT_MAX));
+    return limits;
+}
+
+void BufferTuner::Attach(Socket* socket) {
+    this->socket = socket;
+    chunkSize = initialChunkSize;
+    bufferSize = 0;
+    rtt = 0;
+    isOwned = false;
+}
+
+void BufferTuner::Begin() {
+    periodBytes = 0;
+    periodBegin = std::chrono::steady_clock::now();
+}
+
+void BufferTuner::Update(const size_t bytes) {
+    if (socket == nullptr) return;
+
+    periodBytes += bytes;
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto period = std::max<std::chrono::microseconds>(MIN_PERIOD, std::chrono::microseconds(PERIOD_RTTS * rtt));
+    if (now - periodBegin < period) return;
+
+    Socket::LinkInfo info;
+    if (socket->GetLinkInfo(info)) [[likely]] {
+        // The receiving side sends little, its own estimate is more accurate.
+        const uint32_t measured = (direction == Direction::Receive && info.receiveRtt != 0) ? info.receiveRtt : info.rtt;
+
+        if (measured != 0) {
+            rtt = measured;
+            Tune(periodBytes / std::chrono::duration<double>(now - periodBegin).count());
+        }
+    }
+
+    periodBytes = 0;
+    periodBegin = now;
+}
+
+void BufferTuner::Tune(const double bandwidth) {
+    static const BufferLimits sendLimits = ReadLimits("/proc/sys/net/ipv4/tcp_wmem", "/proc/sys/net/core/wmem_max");
+    static const BufferLimits receiveLimits = ReadLimits("/proc/sys/net/ipv4/tcp_rmem", "/proc/sys/net/core/rmem_max");
+
+    const bool isSending = (direction == Direction::Send);
+    const BufferLimits& limits = isSending ? sendLimits : receiveLimits;
+    const Socket::Option option = isSending ? Socket::Option::SendBuffer : Socket::Option::ReceiveBuffer;
+
+    if (!socket->GetOption(option, bufferSize)) [[unlikely]] return;
+
+    // Half of the buffer is taken by the bookkeeping of the os, and the other half is doubled,
+    // so the buffer that limits the transfer keeps growing.
+    const double product = bandwidth * rtt / 1e6;
+    const int maxSize = std::min(MAX_BUFFER_SIZE, limits.settable);
+    const int target = static_cast<int>(std::clamp<double>(4 * product, MIN_BUFFER_SIZE, std::max(maxSize, MIN_BUFFER_SIZE)));
+
+    const bool isGrown = target > (isOwned ? bufferSize : std::max(bufferSize, limits.automatic));
+    const bool isShrunk = isOwned && target * SHRINK_RATIO < bufferSize;
+
+    if ((isGrown || isShrunk) && target <= maxSize && socket->SetOption<int>(option, target / 2)) {
+        isOwned = true;
+        socket->GetOption(option, bufferSize);
+    }
+
+    chunkSize = std::clamp(std::bit_floor(static_cast<size_t>(bufferSize) / 2), MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+}
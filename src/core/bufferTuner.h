@@ -0,0 +1,73 @@
+#ifndef _NET_BUFFER_TUNER_H
+#define _NET_BUFFER_TUNER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "socket.h"
+
+namespace Net {
+    /// Sizes the socket buffer of one direction of the stream connection and the chunks moved by one call
+    /// to the bandwidth-delay product, the round-trip time is taken from the os and the bandwidth is measured
+    /// by the moved bytes. The measurements are taken over each period of a few round trips.
+    ///
+    /// The os grows the buffer by itself up to its own limit, it stops once the buffer is set. So the buffer is set
+    /// only when the product outgrows that limit, then it's grown and shrunk by the tuner for the rest of the connection.
+    /// The chunk follows the buffer the os has, the call can't move more than that anyway.
+    /// The connections the os doesn't measure keep the initial chunk size.
+    class BufferTuner {
+    public:
+        enum class Direction : uint8_t {
+            Send,
+            Receive
+        };
+
+        static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+        static constexpr size_t MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+        /// Bounds of the socket buffer size as reported by the os, which counts its bookkeeping as well.
+        static constexpr int MIN_BUFFER_SIZE = 128 * 1024;
+        static constexpr int MAX_BUFFER_SIZE = 64 * 1024 * 1024;
+        static constexpr std::chrono::milliseconds MIN_PERIOD { 10 };
+        /// Number of the round trips measured by one period.
+        static constexpr unsigned int PERIOD_RTTS = 4;
+        /// Buffer set by the tuner is shrunk only when it's that many times larger than needed.
+        static constexpr int SHRINK_RATIO = 4;
+
+    private:
+        Socket* socket = nullptr;
+        Direction direction;
+        size_t initialChunkSize;
+        size_t chunkSize;
+        int bufferSize = 0;
+        uint32_t rtt = 0;
+        /// The buffer is set by the tuner, the os doesn't tune it anymore.
+        bool isOwned = false;
+
+        size_t periodBytes = 0;
+        std::chrono::steady_clock::time_point periodBegin;
+
+        /// Sizes the buffer and the chunk to the product of the `bandwidth` in bytes per second and the round-trip time.
+        void Tune(const double bandwidth);
+
+    public:
+        BufferTuner(const Direction direction, const size_t initialChunkSize)
+            : direction(direction), initialChunkSize(initialChunkSize), chunkSize(initialChunkSize) {}
+
+        /// Starts tuning the new connection by its `socket`, `nullptr` if it has none.
+        void Attach(Socket* socket);
+        /// Starts measuring the transfer, the sizes chosen by the previous transfers over the connection are kept.
+        void Begin();
+        /// Accounts the bytes moved by one call, the sizes are tuned once per period.
+        void Update(const size_t bytes);
+
+        inline bool IsTuned() const { return socket != nullptr && rtt != 0; }
+        inline size_t GetChunkSize() const { return chunkSize; }
+        /// Returns the socket buffer size as reported by the os.
+        inline int GetBufferSize() const { return bufferSize; }
+        /// Returns the round-trip time in microseconds.
+        inline uint32_t GetRtt() const { return rtt; }
+    };
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "lz4.h"
+
+namespace Compression {
+    size_t PackBlock(const Msg::Codec codec, const char* data, const size_t size, char* output) {
+        char* payload = output + sizeof(BlockHeader);
+        BlockHeader header;
+
+        // Only the block that shrinks is worth unpacking.
+        const size_t packedSize = (codec == Msg::Codec::Lz4) ? Lz4::Compress(data, size, payload, size - 1) : 0;
+
+        if (packedSize > 0) {
+            header.size = static_cast<uint32_t>(packedSize);
+        } else {
+            std::memcpy(payload, data, size);
+            header.size = static_cast<uint32_t>(size) | RAW_BLOCK;
+        }
+
+        std::memcpy(output, &header, sizeof(header));
+        return sizeof(header) + GetPayloadSize(header);
+    }
+
+    size_t UnpackBlock(const Msg::Codec codec, const BlockHeader header, const char* payload, char* output) {
+        const size_t size = GetPayloadSize(header);
+        if (size > MAX_BLOCK_SIZE) [[unlikely]] return 0;
+
+        if (header.size & RAW_BLOCK) {
+            std::memcpy(output, payload, size);
+            return size;
+        }
+
+        if (codec == Msg::Codec::Lz4) return Lz4::Decompress(payload, size, output, MAX_BLOCK_SIZE);
+        return 0;
+    }
+
+    Msg::Codec Choose(const Msg::Codec offered, const File& file, const size_t position, const size_t size) {
+        if (offered == Msg::Codec::None || size == 0) return Msg::Codec::None;
+
+        const auto block = std::make_unique<char[]>(MAX_BLOCK_SIZE);
+        const auto packed = std::make_unique<char[]>(MAX_PACKED_BLOCK_SIZE);
+
+        size_t sampledSize = 0;
+        size_t packedSize = 0;
+
+        for (unsigned int i = 0; i < SAMPLE_BLOCKS && sampledSize < size; ++i) {
+            const size_t blockSize = std::min(MAX_BLOCK_SIZE, size - sampledSize);
+            if (file.Read(block.get(), blockSize, position + sampledSize) != blockSize) [[unlikely]] return Msg::Codec::None;
+
+            sampledSize += blockSize;
+            packedSize += PackBlock(offered, block.get(), blockSize, packed.get());
+        }
+
+        return (packedSize <= sampledSize * MAX_SAMPLE_RATIO) ? offered : Msg::Codec::None;
+    }
+}
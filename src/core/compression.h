@@ -0,0 +1,43 @@
+#ifndef _COMPRESSION_H
+#define _COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "file.h"
+#include "message.h"
+
+/// Compressed transfer content: the file is split into blocks compressed independently, so they
+/// are produced and consumed in a streaming way. Each block is preceded by the `BlockHeader`,
+/// the blocks that don't shrink are stored raw.
+namespace Compression {
+    static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+    struct BlockHeader {
+        /// Size of the payload that follows, marked by `RAW_BLOCK` if the payload isn't compressed.
+        uint32_t size;
+    };
+
+    static constexpr uint32_t RAW_BLOCK = 1u << 31;
+    static constexpr size_t MAX_PACKED_BLOCK_SIZE = sizeof(BlockHeader) + MAX_BLOCK_SIZE;
+
+    /// Number of the leading blocks compressed to decide whether the content is worth compressing.
+    static constexpr unsigned int SAMPLE_BLOCKS = 4;
+    /// Max ratio of the compressed samples size to their size, the content that shrinks less is sent raw.
+    static constexpr double MAX_SAMPLE_RATIO = 0.9;
+
+    /// Packs at most `MAX_BLOCK_SIZE` bytes of `data` with the header into `output` of `MAX_PACKED_BLOCK_SIZE` bytes.
+    /// Returns the size of the packed block.
+    size_t PackBlock(const Msg::Codec codec, const char* data, const size_t size, char* output);
+    /// Unpacks the payload of the block into `output` of `MAX_BLOCK_SIZE` bytes.
+    /// Returns the unpacked size, `0` if the block is malformed.
+    size_t UnpackBlock(const Msg::Codec codec, const BlockHeader header, const char* payload, char* output);
+
+    inline size_t GetPayloadSize(const BlockHeader header) { return header.size & ~RAW_BLOCK; }
+
+    /// Compresses the leading blocks of `size` bytes of the `file` starting at `position` by the `offered` codec.
+    /// Returns the `offered` codec if the samples shrink enough, `None` otherwise.
+    Msg::Codec Choose(const Msg::Codec offered, const File& file, const size_t position, const size_t size);
+}
+
+#endif
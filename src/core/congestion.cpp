@@ -0,0 +1,160 @@
+#include "congestion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+using namespace Net;
+
+const char* Net::GetCongestionAlgorithmName(const CongestionAlgorithm algorithm) {
+    switch (algorithm) {
+        case CongestionAlgorithm::Aimd:
+            return "AIMD";
+        case CongestionAlgorithm::Bbr:
+            return "BBR";
+        default:
+            break;
+    }
+    return "Unknown";
+}
+
+std::unique_ptr<CongestionControl> CongestionControl::Create(const CongestionAlgorithm algorithm) {
+    if (algorithm == CongestionAlgorithm::Bbr) return std::make_unique<BbrControl>();
+    return std::make_unique<AimdControl>();
+}
+
+void AimdControl::OnAck(const AckSample& sample) {
+    if (sample.rtt > 0) {
+        smoothedRtt = (smoothedRtt == 0) ? sample.rtt : (7 * smoothedRtt + sample.rtt) / 8;
+    }
+
+    // The window isn't the limit, don't let it grow without a check.
+    if (sample.inFlight + sample.acked < window / 2) return;
+
+    if (window < threshold) {
+        window += sample.acked;
+    } else {
+        window += sample.acked / window;
+    }
+}
+
+void AimdControl::OnLoss([[maybe_unused]] const uint64_t now, [[maybe_unused]] const uint32_t inFlight) {
+    threshold = std::max(window / 2, static_cast<double>(MIN_WINDOW));
+    window = threshold;
+}
+
+void AimdControl::OnTimeout([[maybe_unused]] const uint64_t now) {
+    threshold = std::max(window / 2, static_cast<double>(MIN_WINDOW));
+    window = MIN_WINDOW;
+}
+
+uint32_t AimdControl::GetWindow() const {
+    return static_cast<uint32_t>(window);
+}
+
+double AimdControl::GetPacingRate() const {
+    if (smoothedRtt == 0) return 0;
+
+    const double gain = (window < threshold) ? SLOW_START_PACING_GAIN : PACING_GAIN;
+    return gain * window * 1e6 / smoothedRtt;
+}
+
+double BbrControl::GetBandwidth() const {
+    return *std::max_element(std::begin(roundBandwidth), std::end(roundBandwidth));
+}
+
+double BbrControl::GetBdp() const {
+    return GetBandwidth() * minRtt / 1e6;
+}
+
+void BbrControl::StartRound(const uint64_t now) {
+    ++round;
+    roundStart = now;
+    roundBandwidth[round % BANDWIDTH_ROUNDS] = 0;
+}
+
+void BbrControl::OnAck(const AckSample& sample) {
+    const uint64_t now = sample.now;
+    isRecovering = false;
+
+    const bool isMinRttExpired = minRtt > 0 && now - minRttTime > MIN_RTT_LIFETIME;
+    if (sample.rtt > 0 && (minRtt == 0 || sample.rtt <= minRtt || isMinRttExpired)) {
+        minRtt = sample.rtt;
+        minRttTime = now;
+    }
+
+    if (roundStart == 0) roundStart = now;
+
+    // Rounds are measured by the min round trip, the bandwidth is filtered over them.
+    bool isRoundEnd = false;
+    if (minRtt > 0 && now - roundStart >= minRtt) {
+        isRoundEnd = true;
+        StartRound(now);
+    }
+    if (sample.deliveryRate > 0) {
+        double& bandwidth = roundBandwidth[round % BANDWIDTH_ROUNDS];
+        bandwidth = std::max(bandwidth, sample.deliveryRate);
+    }
+
+    switch (state) {
+        case State::Startup: {
+            if (!isRoundEnd) break;
+
+            const double bandwidth = GetBandwidth();
+            if (bandwidth >= fullBandwidth * FULL_BANDWIDTH_GROWTH) {
+                fullBandwidth = bandwidth;
+                fullBandwidthRounds = 0;
+            } else if (++fullBandwidthRounds >= FULL_BANDWIDTH_ROUNDS) {
+                state = State::Drain;
+                pacingGain = 1.0 / STARTUP_GAIN;
+            }
+        } break;
+        case State::Drain: {
+            if (sample.inFlight > GetBdp()) break;
+
+            state = State::ProbeBw;
+            // Don't start from the probing phases.
+            probePhase = 2;
+            probePhaseStart = now;
+            pacingGain = PROBE_GAINS[probePhase];
+            windowGain = WINDOW_GAIN;
+        } break;
+        case State::ProbeBw: {
+            if (now - probePhaseStart < minRtt) break;
+
+            probePhase = (probePhase + 1) % PROBE_PHASES;
+            probePhaseStart = now;
+            pacingGain = PROBE_GAINS[probePhase];
+        } break;
+        case State::ProbeRtt: {
+            if (now < probeRttEnd) break;
+
+            minRttTime = now;
+            state = State::ProbeBw;
+            probePhaseStart = now;
+            pacingGain = PROBE_GAINS[probePhase];
+        } break;
+        default:
+            break;
+    }
+
+    if (isMinRttExpired && state == State::ProbeBw) {
+        state = State::ProbeRtt;
+        probeRttEnd = now + std::max(PROBE_RTT_DURATION, minRtt);
+        pacingGain = 1.0;
+    }
+}
+
+uint32_t BbrControl::GetWindow() const {
+    if (isRecovering) return MIN_WINDOW;
+    if (state == State::ProbeRtt) return PROBE_RTT_WINDOW;
+
+    const double bdp = GetBdp();
+    if (bdp == 0) return INITIAL_WINDOW;
+
+    return std::max(static_cast<uint32_t>(std::ceil(windowGain * bdp)), 2 * MIN_WINDOW);
+}
+
+double BbrControl::GetPacingRate() const {
+    return pacingGain * GetBandwidth();
+}
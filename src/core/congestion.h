@@ -0,0 +1,131 @@
+#ifndef _NET_CONGESTION_H
+#define _NET_CONGESTION_H
+
+#include <cstdint>
+#include <memory>
+
+namespace Net {
+    enum class CongestionAlgorithm : uint8_t {
+        Aimd,
+        Bbr
+    };
+
+    const char* GetCongestionAlgorithmName(const CongestionAlgorithm algorithm);
+
+    /// Decides how many segments the sender may keep in flight and how fast it sends them.
+    /// Time is measured in microseconds, rates in segments per second.
+    class CongestionControl {
+    public:
+        struct AckSample {
+            uint64_t now;
+            /// Number of the newly acknowledged segments.
+            uint32_t acked;
+            /// Number of the segments still in flight.
+            uint32_t inFlight;
+            /// Round-trip time of the acknowledged segment, `0` if not measured.
+            uint64_t rtt;
+            /// Delivery rate measured over the acknowledged segment flight, `0` if not measured.
+            double deliveryRate;
+        };
+
+        /// Segments the sender may send before any feedback.
+        static constexpr uint32_t INITIAL_WINDOW = 10;
+        static constexpr uint32_t MIN_WINDOW = 2;
+
+        virtual ~CongestionControl() = default;
+
+        virtual void OnAck(const AckSample& sample) = 0;
+        /// A segment is lost, called once per round trip of losses.
+        virtual void OnLoss(const uint64_t now, const uint32_t inFlight) = 0;
+        /// Nothing is acknowledged within the retransmission timeout.
+        virtual void OnTimeout(const uint64_t now) = 0;
+
+        /// Returns max number of segments in flight.
+        virtual uint32_t GetWindow() const = 0;
+        /// Returns the rate segments are paced at, `0` if they aren't paced.
+        virtual double GetPacingRate() const = 0;
+
+        static std::unique_ptr<CongestionControl> Create(const CongestionAlgorithm algorithm);
+    };
+
+    /// Additive increase, multiplicative decrease: the window grows exponentially until the first loss
+    /// (slow start), then by one segment per round trip and halves on each loss.
+    class AimdControl final : public CongestionControl {
+        static constexpr double SLOW_START_PACING_GAIN = 2.0;
+        static constexpr double PACING_GAIN = 1.25;
+
+        double window = INITIAL_WINDOW;
+        double threshold = UINT32_MAX;
+        uint64_t smoothedRtt = 0;
+
+    public:
+        void OnAck(const AckSample& sample) override;
+        void OnLoss(const uint64_t now, const uint32_t inFlight) override;
+        void OnTimeout(const uint64_t now) override;
+
+        uint32_t GetWindow() const override;
+        double GetPacingRate() const override;
+    };
+
+    /// Model based control in the manner of BBR: sends at the estimated bottleneck bandwidth
+    /// (max delivery rate over the recent rounds) and keeps in flight about twice the
+    /// bandwidth-delay product (bandwidth by min round-trip time), regardless of losses.
+    class BbrControl final : public CongestionControl {
+        enum class State : uint8_t {
+            Startup,  // Doubles the rate each round until the bandwidth stops growing.
+            Drain,    // Drains the queue built in startup.
+            ProbeBw,  // Cycles the rate around the bandwidth to track its changes.
+            ProbeRtt  // Shrinks the flight to measure the round trip without queues.
+        };
+
+        static constexpr double STARTUP_GAIN = 2.885;
+        static constexpr double WINDOW_GAIN = 2.0;
+        static constexpr double PROBE_GAINS[] = { 1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+        static constexpr unsigned int PROBE_PHASES = sizeof(PROBE_GAINS) / sizeof(PROBE_GAINS[0]);
+
+        /// Number of rounds the bandwidth filter covers.
+        static constexpr unsigned int BANDWIDTH_ROUNDS = 10;
+        /// Startup ends after this number of rounds without significant bandwidth growth.
+        static constexpr unsigned int FULL_BANDWIDTH_ROUNDS = 3;
+        static constexpr double FULL_BANDWIDTH_GROWTH = 1.25;
+
+        static constexpr uint64_t MIN_RTT_LIFETIME = 10 * 1000 * 1000;
+        static constexpr uint64_t PROBE_RTT_DURATION = 200 * 1000;
+        static constexpr uint32_t PROBE_RTT_WINDOW = 4;
+
+        State state = State::Startup;
+
+        double roundBandwidth[BANDWIDTH_ROUNDS] = { 0 };
+        unsigned int round = 0;
+        uint64_t roundStart = 0;
+
+        double fullBandwidth = 0;
+        unsigned int fullBandwidthRounds = 0;
+
+        uint64_t minRtt = 0;
+        uint64_t minRttTime = 0;
+        uint64_t probeRttEnd = 0;
+
+        unsigned int probePhase = 0;
+        uint64_t probePhaseStart = 0;
+
+        double pacingGain = STARTUP_GAIN;
+        double windowGain = STARTUP_GAIN;
+        /// The window is cut after the timeout until the flight is acknowledged.
+        bool isRecovering = false;
+
+        double GetBandwidth() const;
+        double GetBdp() const;
+        void StartRound(const uint64_t now);
+
+    public:
+        void OnAck(const AckSample& sample) override;
+        void OnLoss([[maybe_unused]] const uint64_t now, [[maybe_unused]] const uint32_t inFlight) override {}
+        void OnTimeout([[maybe_unused]] const uint64_t now) override { isRecovering = true; }
+
+        uint32_t GetWindow() const override;
+        double GetPacingRate() const override;
+    };
+}
+
+#endif
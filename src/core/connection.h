@@ -13,8 +13,31 @@ namespace Net {
         virtual uint Receive(void* buffer, const unsigned int size) = 0;
         virtual uint ReceiveAll(void* buffer, const unsigned int size) = 0;
 
+        /// Sends data of all the `buffers` at once, e.g. packet header and its payload.
+        virtual uint SendV(const iovec* buffers, const unsigned int count) = 0;
+        /// Receives data scattering it over the `buffers` in order, may fill them partially.
+        virtual uint ReceiveV(iovec* buffers, const unsigned int count) = 0;
+
         virtual Status Fail() = 0;
 
+        /// Sends `size` bytes of the os file starting at `offset` without copying them through the user space.
+        /// Returns number of bytes sent, `0` on failure. Available only if `CanSendFile()`.
+        virtual uint SendFile(
+            [[maybe_unused]] const int osFile, [[maybe_unused]] const size_t offset, [[maybe_unused]] const unsigned int size
+        ) { return 0; }
+        virtual bool CanSendFile() const { return false; }
+
+        /// Receives at most `size` bytes into the os file at `offset` without copying them through the user space.
+        /// Returns number of bytes received, `0` on failure. Available only if `CanReceiveFile()`.
+        virtual uint ReceiveFile(
+            [[maybe_unused]] const int osFile, [[maybe_unused]] const size_t offset, [[maybe_unused]] const unsigned int size
+        ) { return 0; }
+        virtual bool CanReceiveFile() const { return false; }
+
+        /// Returns the socket owned exclusively by this connection, used to poll connection readiness.
+        /// `nullptr` if the connection has no dedicated socket and can be served in blocking mode only.
+        virtual Socket* GetSocket() { return nullptr; }
+
         template<typename T>
         uint Send(const T& object) {
             return Send(reinterpret_cast<const void*>(&object), sizeof(T));
@@ -37,11 +60,10 @@ namespace Net {
         void Close() override { socket.Close(); }
 
         friend class TcpClient;
-        friend class UdpClient;
         friend class TcpServer;
     public:
         uint Send(const void* buffer, const unsigned int size) override {
-            return socket.Send(reinterpret_cast<const char*>(buffer), size);
+            return socket.Send(reinterpret_cast<const char*>(buffer), size, Net::Socket::NoSignal);
         }
 
         uint Receive(void* buffer, const unsigned int size) override {
@@ -52,8 +74,28 @@ namespace Net {
             return socket.Receive(reinterpret_cast<char*>(buffer), size, Net::Socket::WaitAll);
         }
 
+        uint SendV(const iovec* buffers, const unsigned int count) override {
+            return socket.SendV(buffers, count, Net::Socket::NoSignal);
+        }
+
+        uint ReceiveV(iovec* buffers, const unsigned int count) override {
+            return socket.ReceiveV(buffers, count);
+        }
+
         Status Fail() override { return socket.Fail(); }
+
+        uint SendFile(const int osFile, const size_t offset, const unsigned int size) override {
+            return socket.SendFile(osFile, offset, size);
+        }
+        bool CanSendFile() const override { return true; }
+
+        uint ReceiveFile(const int osFile, const size_t offset, const unsigned int size) override {
+            return socket.ReceiveFile(osFile, offset, size);
+        }
+        bool CanReceiveFile() const override { return true; }
+
+        Socket* GetSocket() override { return &socket; }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,93 @@
+#ifndef _FILE_H
+#define _FILE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/// Owning wrapper of os file descriptor with positional access, so the same file
+/// can be shared by the transfers and submitted to the os asynchronous I/O.
+class File {
+public:
+    enum class Mode : uint8_t {
+        Read,
+        Write, // Creates the file or truncates the existing one.
+        Update // Creates the file or keeps the content of the existing one.
+    };
+
+private:
+    int osFile = -1;
+
+public:
+    File() = default;
+    File(File&& other) noexcept : osFile(other.osFile) { other.osFile = -1; }
+    File(const File&) = delete;
+
+    ~File() { Close(); }
+
+    File& operator=(File&& other) noexcept {
+        if (this != &other) {
+            Close();
+            osFile = other.osFile;
+            other.osFile = -1;
+        }
+        return *this;
+    }
+
+    bool Open(const std::filesystem::path& path, const Mode mode) {
+        Close();
+
+        int flags = O_RDONLY;
+        if (mode == Mode::Write) flags = O_WRONLY | O_CREAT | O_TRUNC;
+        else if (mode == Mode::Update) flags = O_WRONLY | O_CREAT;
+
+        osFile = open(path.c_str(), flags | O_CLOEXEC, 0644);
+        return IsOpen();
+    }
+
+    /// Opens another descriptor of the open file, it's kept open when the other one is closed.
+    bool Duplicate(const File& other) {
+        Close();
+
+        osFile = fcntl(other.osFile, F_DUPFD_CLOEXEC, 0);
+        return IsOpen();
+    }
+
+    void Close() {
+        if (IsOpen() == false) return;
+
+        close(osFile);
+        osFile = -1;
+    }
+
+    /// Reads up to `size` bytes at `offset`. Returns number of read bytes, `0` at the end of file or on failure.
+    size_t Read(void* buffer, const size_t size, const size_t offset) const {
+        const ssize_t ret = pread(osFile, buffer, size, offset);
+        return (ret < 0) ? 0 : static_cast<size_t>(ret);
+    }
+
+    /// Writes `size` bytes at `offset`. Returns number of written bytes, `0` on failure.
+    size_t Write(const void* buffer, const size_t size, const size_t offset) const {
+        const ssize_t ret = pwrite(osFile, buffer, size, offset);
+        return (ret < 0) ? 0 : static_cast<size_t>(ret);
+    }
+
+    /// Allocates disk space for the first `size` bytes of the file, so the writes don't fail for the lack
+    /// of space and the file isn't fragmented. Returns `false` only if the space can't be allocated,
+    /// file systems without preallocation support are ignored.
+    bool Reserve(const size_t size) const {
+        if (fallocate(osFile, 0, 0, static_cast<off_t>(size)) == 0) return true;
+        return errno == EOPNOTSUPP || errno == ENOSYS;
+    }
+
+    /// Flushes the written data to the storage, so it survives the crash of the os.
+    bool Sync() const { return fdatasync(osFile) == 0; }
+
+    inline int GetDescriptor() const { return osFile; }
+    inline bool IsOpen() const { return osFile >= 0; }
+};
+
+#endif
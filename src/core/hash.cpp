@@ -0,0 +1,384 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Hash {
+    static constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ull;
+
+    static inline uint64_t Read64(const uint8_t* ptr) {
+        uint64_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t Read32(const uint8_t* ptr) {
+        uint32_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    static inline uint64_t Round(uint64_t accumulator, const uint64_t input) {
+        accumulator += input * PRIME_2;
+        accumulator = std::rotl(accumulator, 31);
+        return accumulator * PRIME_1;
+    }
+
+    static inline uint64_t MergeRound(uint64_t accumulator, const uint64_t value) {
+        accumulator ^= Round(0, value);
+        return accumulator * PRIME_1 + PRIME_4;
+    }
+
+    uint64_t Xxh64(const void* data, const size_t size, const uint64_t seed) {
+        Xxh64State state(seed);
+        state.Update(data, size);
+        return state.Digest();
+    }
+
+    Xxh64State::Xxh64State(const uint64_t seed) : seed(seed) {
+        accumulators[0] = seed + PRIME_1 + PRIME_2;
+        accumulators[1] = seed + PRIME_2;
+        accumulators[2] = seed;
+        accumulators[3] = seed - PRIME_1;
+    }
+
+    void Xxh64State::Update(const void* data, const size_t size) {
+        const uint8_t* input = static_cast<const uint8_t*>(data);
+        const uint8_t* const end = input + size;
+
+        totalSize += size;
+
+        const auto consume = [this](const uint8_t* stripe) {
+            for (unsigned int i = 0; i < 4; ++i) accumulators[i] = Round(accumulators[i], Read64(stripe + i * 8));
+        };
+
+        if (stripeSize > 0) {
+            const size_t taken = std::min<size_t>(sizeof(stripe) - stripeSize, size);
+            std::memcpy(stripe + stripeSize, input, taken);
+            stripeSize += taken;
+            input += taken;
+
+            if (stripeSize < sizeof(stripe)) return;
+
+            consume(stripe);
+            stripeSize = 0;
+        }
+
+        for (; end - input >= static_cast<ptrdiff_t>(sizeof(stripe)); input += sizeof(stripe)) consume(input);
+
+        stripeSize = static_cast<unsigned int>(end - input);
+        std::memcpy(stripe, input, stripeSize);
+    }
+
+    uint64_t Xxh64State::Digest() const {
+        uint64_t hash;
+
+        if (totalSize >= sizeof(stripe)) {
+            const uint64_t* v = accumulators;
+
+            hash = std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18);
+            for (unsigned int i = 0; i < 4; ++i) hash = MergeRound(hash, v[i]);
+        } else {
+            hash = seed + PRIME_5;
+        }
+
+        hash += totalSize;
+
+        const uint8_t* input = stripe;
+        const uint8_t* const end = stripe + stripeSize;
+
+        for (; input + 8 <= end; input += 8) {
+            hash ^= Round(0, Read64(input));
+            hash = std::rotl(hash, 27) * PRIME_1 + PRIME_4;
+        }
+        if (input + 4 <= end) {
+            hash ^= Read32(input) * PRIME_1;
+            hash = std::rotl(hash, 23) * PRIME_2 + PRIME_3;
+            input += 4;
+        }
+        for (; input < end; ++input) {
+            hash ^= *input * PRIME_5;
+            hash = std::rotl(hash, 11) * PRIME_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME_2;
+        hash ^= hash >> 29;
+        hash *= PRIME_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    bool Xxh64(const File& file, const size_t size, uint64_t& outHash) {
+        static constexpr size_t CHUNK_SIZE = 256 * 1024;
+        const auto chunk = std::make_unique<char[]>(CHUNK_SIZE);
+
+        Xxh64State state;
+        for (size_t position = 0; position < size;) {
+            const size_t chunkSize = std::min(CHUNK_SIZE, size - position);
+            if (file.Read(chunk.get(), chunkSize, position) != chunkSize) [[unlikely]] return false;
+
+            state.Update(chunk.get(), chunkSize);
+            position += chunkSize;
+        }
+
+        outHash = state.Digest();
+        return true;
+    }
+
+    /// Reflected CRC32C polynomial.
+    static constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+    /// Lengths of the interleaved streams, the long ones for the bulk of the data, the short ones for the rest.
+    static constexpr size_t CRC_LONG_BLOCK = 8192;
+    static constexpr size_t CRC_SHORT_BLOCK = 256;
+    /// Shorter data isn't worth folding.
+    static constexpr size_t CRC_FOLDED_SIZE = 512;
+
+    /// Multipliers moving 128 bits of the data forward by the number of bits: the low half by `x^(bits + 63)`,
+    /// the high one by `x^(bits - 1)`, as the reflected carry-less product is one bit longer.
+    struct alignas(16) FoldConstants {
+        uint64_t low;
+        uint64_t high;
+    };
+
+    /// Tables of the CRC32C register update: byte by byte and shifting it over the zeros of the stream length.
+    struct CrcTables {
+        uint32_t bytes[256];
+        uint32_t longShift[4][256];
+        uint32_t shortShift[4][256];
+        FoldConstants fold2048, fold1536, fold1024, fold512, fold384, fold256, fold128;
+
+        /// Product of the polynomials modulo the CRC32C polynomial, in the reflected bit order.
+        static uint32_t MultiplyModPoly(uint32_t a, uint32_t b) {
+            uint32_t product = 0;
+            for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+                if (a & bit) product ^= b;
+                b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+            }
+            return product;
+        }
+
+        /// `x` raised to the `exponent`, modulo the CRC32C polynomial.
+        static uint32_t PowerPoly(size_t exponent) {
+            uint32_t result = 1u << 31; // `1`
+            uint32_t square = 1u << 30; // `x`
+            for (; exponent != 0; exponent >>= 1) {
+                if (exponent & 1) result = MultiplyModPoly(result, square);
+                square = MultiplyModPoly(square, square);
+            }
+            return result;
+        }
+
+        static FoldConstants MakeFold(const size_t bits) {
+            return { static_cast<uint64_t>(PowerPoly(bits + 63)) << 32, static_cast<uint64_t>(PowerPoly(bits - 1)) << 32 };
+        }
+
+        static void FillShift(uint32_t (&table)[4][256], const size_t size) {
+            const uint32_t shift = PowerPoly(size * 8);
+            for (unsigned int i = 0; i < 4; ++i) {
+                for (uint32_t value = 0; value < 256; ++value) table[i][value] = MultiplyModPoly(value << (i * 8), shift);
+            }
+        }
+
+        CrcTables() {
+            for (uint32_t value = 0; value < 256; ++value) {
+                uint32_t crc = value;
+                for (unsigned int bit = 0; bit < 8; ++bit) crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                bytes[value] = crc;
+            }
+
+            FillShift(longShift, CRC_LONG_BLOCK);
+            FillShift(shortShift, CRC_SHORT_BLOCK);
+
+            fold2048 = MakeFold(2048);
+            fold1536 = MakeFold(1536);
+            fold1024 = MakeFold(1024);
+            fold512 = MakeFold(512);
+            fold384 = MakeFold(384);
+            fold256 = MakeFold(256);
+            fold128 = MakeFold(128);
+        }
+    };
+
+    static const CrcTables crcTables;
+
+    /// Register of the stream followed by the zeros of the table length, it's linear so the table is taken bytewise.
+    static inline uint32_t ShiftCrc(const uint32_t (&table)[4][256], const uint32_t crc) {
+        return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+    }
+
+    static uint32_t Crc32cSoftware(uint32_t crc, const uint8_t* input, const size_t size) {
+        for (size_t i = 0; i < size; ++i) crc = crcTables.bytes[(crc ^ input[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    /// Three streams of the `block` length each are computed at once, as the instruction latency is
+    /// three times longer than its throughput. The first ones are shifted over the next ones and merged.
+    template<size_t block>
+    __attribute__((target("sse4.2")))
+    static inline uint64_t Crc32cStreams(uint64_t crc, const uint8_t*& input, size_t& size, const uint32_t (&table)[4][256]) {
+        for (; size >= block * 3; input += block * 3, size -= block * 3) {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+
+            for (size_t i = 0; i < block; i += 8) {
+                crc = _mm_crc32_u64(crc, Read64(input + i));
+                crc1 = _mm_crc32_u64(crc1, Read64(input + block + i));
+                crc2 = _mm_crc32_u64(crc2, Read64(input + block * 2 + i));
+            }
+
+            crc = ShiftCrc(table, ShiftCrc(table, static_cast<uint32_t>(crc)) ^ static_cast<uint32_t>(crc1)) ^ crc2;
+        }
+        return crc;
+    }
+
+    __attribute__((target("sse4.2")))
+    static uint32_t Crc32cHardware(const uint32_t crc, const uint8_t* input, size_t size) {
+        uint64_t crc64 = crc;
+
+        crc64 = Crc32cStreams<CRC_LONG_BLOCK>(crc64, input, size, crcTables.longShift);
+        crc64 = Crc32cStreams<CRC_SHORT_BLOCK>(crc64, input, size, crcTables.shortShift);
+
+        for (; size >= 8; input += 8, size -= 8) crc64 = _mm_crc32_u64(crc64, Read64(input));
+
+        uint32_t crc32 = static_cast<uint32_t>(crc64);
+        for (; size > 0; ++input, --size) crc32 = _mm_crc32_u8(crc32, *input);
+        return crc32;
+    }
+
+    __attribute__((target("pclmul")))
+    static inline __m128i Fold(const __m128i value, const FoldConstants& constants) {
+        const __m128i multipliers = _mm_load_si128(reinterpret_cast<const __m128i*>(&constants));
+        return _mm_xor_si128(_mm_clmulepi64_si128(value, multipliers, 0x00), _mm_clmulepi64_si128(value, multipliers, 0x11));
+    }
+
+    __attribute__((target("avx512f,vpclmulqdq")))
+    static inline __m512i Fold(const __m512i value, const __m512i multipliers) {
+        return _mm512_xor_si512(_mm512_clmulepi64_epi128(value, multipliers, 0x00), _mm512_clmulepi64_epi128(value, multipliers, 0x11));
+    }
+
+    __attribute__((target("avx512f,vpclmulqdq")))
+    static inline __m512i BroadcastFold(const FoldConstants& constants) {
+        return _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(&constants)));
+    }
+
+    /// The data is folded by the carry-less multiplication, 256 bytes at once by four registers of four 128-bit lanes.
+    /// Each lane is moved forward over the next 256 bytes and they are added to it, so the value of the data modulo
+    /// the polynomial is kept. The lanes are folded into one at the end, whose remainder is taken by the `crc32`.
+    __attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.2")))
+    static uint32_t Crc32cFolding(const uint32_t crc, const uint8_t* input, size_t size) {
+        const __m512i fold2048 = BroadcastFold(crcTables.fold2048);
+
+        // The register is added to the first bits of the data.
+        __m512i value0 = _mm512_xor_si512(_mm512_loadu_si512(input), _mm512_zextsi128_si512(_mm_cvtsi32_si128(crc)));
+        __m512i value1 = _mm512_loadu_si512(input + 64);
+        __m512i value2 = _mm512_loadu_si512(input + 128);
+        __m512i value3 = _mm512_loadu_si512(input + 192);
+
+        for (input += 256, size -= 256; size >= 256; input += 256, size -= 256) {
+            value0 = _mm512_xor_si512(Fold(value0, fold2048), _mm512_loadu_si512(input));
+            value1 = _mm512_xor_si512(Fold(value1, fold2048), _mm512_loadu_si512(input + 64));
+            value2 = _mm512_xor_si512(Fold(value2, fold2048), _mm512_loadu_si512(input + 128));
+            value3 = _mm512_xor_si512(Fold(value3, fold2048), _mm512_loadu_si512(input + 192));
+        }
+
+        const __m512i lanes = _mm512_ternarylogic_epi64(
+            Fold(value0, BroadcastFold(crcTables.fold1536)),
+            Fold(value1, BroadcastFold(crcTables.fold1024)),
+            _mm512_xor_si512(Fold(value2, BroadcastFold(crcTables.fold512)), value3),
+            0x96 // a ^ b ^ c
+        );
+        __m128i value = _mm_xor_si128(
+            _mm_xor_si128(Fold(_mm512_extracti32x4_epi32(lanes, 0), crcTables.fold384), Fold(_mm512_extracti32x4_epi32(lanes, 1), crcTables.fold256)),
+            _mm_xor_si128(Fold(_mm512_extracti32x4_epi32(lanes, 2), crcTables.fold128), _mm512_extracti32x4_epi32(lanes, 3))
+        );
+
+        for (; size >= 16; input += 16, size -= 16) {
+            value = _mm_xor_si128(Fold(value, crcTables.fold128), _mm_loadu_si128(reinterpret_cast<const __m128i*>(input)));
+        }
+
+        uint64_t crc64 = _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(value)));
+        crc64 = _mm_crc32_u64(crc64, static_cast<uint64_t>(_mm_extract_epi64(value, 1)));
+        return Crc32cHardware(static_cast<uint32_t>(crc64), input, size);
+    }
+
+    // The cpu model may be not detected yet while the statics are initialized.
+    static const bool hasCrcInstruction = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    static const bool hasFoldInstructions = hasCrcInstruction &&
+        __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+#endif
+
+    uint32_t Crc32c(const void* data, const size_t size, const uint32_t crc) {
+        const uint8_t* input = static_cast<const uint8_t*>(data);
+
+#if defined(__x86_64__)
+        if (hasFoldInstructions && size >= CRC_FOLDED_SIZE) [[likely]] return ~Crc32cFolding(~crc, input, size);
+        if (hasCrcInstruction) [[likely]] return ~Crc32cHardware(~crc, input, size);
+#endif
+        return ~Crc32cSoftware(~crc, input, size);
+    }
+
+    void ChunkChecksums::Reset(const size_t position) {
+        chunkLeft = chunkSize - position % chunkSize;
+        passed = 0;
+        crc = 0;
+        checksums.clear();
+    }
+
+    void ChunkChecksums::Update(const void* data, size_t size) {
+        const char* input = static_cast<const char*>(data);
+
+        while (size > 0) {
+            const size_t taken = std::min(chunkLeft, size);
+            crc = Crc32c(input, taken, crc);
+
+            input += taken;
+            size -= taken;
+            passed += taken;
+            chunkLeft -= taken;
+
+            if (chunkLeft == 0) {
+                checksums.push_back(crc);
+                chunkLeft = chunkSize;
+                passed = 0;
+                crc = 0;
+            }
+        }
+    }
+
+    const std::vector<uint32_t>& ChunkChecksums::Finish() {
+        if (passed > 0) {
+            checksums.push_back(crc);
+            chunkLeft = chunkSize;
+            passed = 0;
+            crc = 0;
+        }
+        return checksums;
+    }
+
+    void Rolling::Reset(const uint8_t* data, const size_t size) {
+        a = 0;
+        b = 0;
+        length = static_cast<uint32_t>(size);
+
+        for (size_t i = 0; i < size; ++i) {
+            a += data[i];
+            b += (size - i) * data[i];
+        }
+
+        a &= 0xffff;
+        b &= 0xffff;
+    }
+}
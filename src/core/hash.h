@@ -0,0 +1,88 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "file.h"
+
+namespace Hash {
+    /// 64-bit `xxHash` (XXH64) of the data, compatible with the reference implementation.
+    uint64_t Xxh64(const void* data, const size_t size, const uint64_t seed = 0);
+
+    /// XXH64 of the data passed by parts, equals to `Xxh64` of the whole data.
+    class Xxh64State {
+        uint64_t accumulators[4];
+        uint64_t seed;
+        uint64_t totalSize = 0;
+        /// Tail of the data that doesn't fill the stripe yet.
+        uint8_t stripe[32];
+        unsigned int stripeSize = 0;
+
+    public:
+        explicit Xxh64State(const uint64_t seed = 0);
+
+        void Update(const void* data, const size_t size);
+        uint64_t Digest() const;
+    };
+
+    /// XXH64 of the first `size` bytes of the file. Returns `false` if the file can't be read.
+    bool Xxh64(const File& file, const size_t size, uint64_t& outHash);
+
+    /// CRC32C (Castagnoli) of the data continuing the `crc` of the data preceding it. The cpu that supports
+    /// AVX-512 VPCLMULQDQ folds the data by the carry-less multiplication, the one that supports only SSE 4.2
+    /// computes it by the `crc32` instruction over three interleaved streams.
+    uint32_t Crc32c(const void* data, const size_t size, const uint32_t crc = 0);
+
+    /// CRC32C of each of the chunks of the data passed by parts. The chunks are aligned to the multiples
+    /// of their size within the file, so the first and the last ones of the range may be shorter.
+    class ChunkChecksums {
+        size_t chunkSize;
+        /// Number of the bytes left to the end of the current chunk and passed within it.
+        size_t chunkLeft;
+        size_t passed = 0;
+        uint32_t crc = 0;
+        std::vector<uint32_t> checksums;
+
+    public:
+        explicit ChunkChecksums(const size_t chunkSize) : chunkSize(chunkSize), chunkLeft(chunkSize) {}
+
+        /// Starts over from the `position` of the file.
+        void Reset(const size_t position = 0);
+        void Update(const void* data, size_t size);
+        /// Takes the checksum of the whole chunk computed before, the current one must be just started.
+        void Append(const uint32_t checksum) { checksums.push_back(checksum); }
+        /// Completes the last chunk, even if it's shorter. Returns the checksums of all of the chunks.
+        const std::vector<uint32_t>& Finish();
+    };
+
+    /// Weak checksum of the `rsync` algorithm. The window of the fixed length slides over
+    /// the data byte by byte, each step updates the checksum in constant time.
+    class Rolling {
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t length = 0;
+
+    public:
+        /// Starts the window over the `size` bytes of `data`.
+        void Reset(const uint8_t* data, const size_t size);
+
+        /// Slides the window by one byte: `out` leaves it, `in` enters it.
+        inline void Roll(const uint8_t out, const uint8_t in) {
+            a = (a - out + in) & 0xffff;
+            b = (b - length * out + a) & 0xffff;
+        }
+
+        inline uint32_t Get() const { return a | (b << 16); }
+
+        /// Checksum of the `size` bytes of `data`.
+        static uint32_t Of(const uint8_t* data, const size_t size) {
+            Rolling rolling;
+            rolling.Reset(data, size);
+            return rolling.Get();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "lz4.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace Lz4 {
+    static constexpr size_t MIN_MATCH = 4;
+    /// The block ends with literals, and the last match starts before them at this distance.
+    static constexpr size_t LAST_LITERALS = 5;
+    static constexpr size_t MATCH_FIND_LIMIT = 12;
+    static constexpr size_t MAX_OFFSET = UINT16_MAX;
+
+    static constexpr unsigned int HASH_LOG = 14;
+    static constexpr unsigned int RUN_MASK = 15;
+
+    static inline uint32_t Read32(const uint8_t* ptr) {
+        uint32_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t Hash(const uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - HASH_LOG);
+    }
+
+    /// Writes the remainder of the length that doesn't fit the token.
+    static inline uint8_t* WriteLength(uint8_t* output, size_t length) {
+        for (; length >= 255; length -= 255) *output++ = 255;
+        *output++ = static_cast<uint8_t>(length);
+        return output;
+    }
+
+    static inline bool ReadLength(const uint8_t*& input, const uint8_t* inputEnd, size_t& length) {
+        uint8_t byte;
+        do {
+            if (input >= inputEnd) [[unlikely]] return false;
+            byte = *input++;
+            length += byte;
+        } while (byte == 255);
+
+        return true;
+    }
+
+    size_t Compress(const char* source, const size_t size, char* destination, const size_t capacity) {
+        const uint8_t* const begin = reinterpret_cast<const uint8_t*>(source);
+        const uint8_t* const end = begin + size;
+        const uint8_t* input = begin;
+        const uint8_t* anchor = begin;
+
+        uint8_t* output = reinterpret_cast<uint8_t*>(destination);
+        uint8_t* const outputEnd = output + capacity;
+
+        if (size > MATCH_FIND_LIMIT) {
+            const uint8_t* const matchLimit = end - LAST_LITERALS;
+            const uint8_t* const findLimit = end - MATCH_FIND_LIMIT;
+
+            // Positions of the recent sequences, the stale ones are rejected by comparing the bytes.
+            uint32_t table[1u << HASH_LOG] = {};
+            // Incompressible data is skipped faster the longer no match is found.
+            size_t misses = 0;
+
+            while (input < findLimit) {
+                const uint32_t sequence = Read32(input);
+                const uint32_t hash = Hash(sequence);
+                const uint8_t* match = begin + table[hash];
+                table[hash] = static_cast<uint32_t>(input - begin);
+
+                if (match >= input || size_t(input - match) > MAX_OFFSET || Read32(match) != sequence) {
+                    input += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+
+                while (input > anchor && match > begin && input[-1] == match[-1]) {
+                    --input;
+                    --match;
+                }
+
+                const uint8_t* matchEnd = input + MIN_MATCH;
+                for (const uint8_t* reference = match + MIN_MATCH; matchEnd < matchLimit && *matchEnd == *reference; ++reference) {
+                    ++matchEnd;
+                }
+
+                const size_t literals = input - anchor;
+                const size_t matchLength = matchEnd - input - MIN_MATCH;
+
+                const size_t sequenceBound = 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1;
+                if (size_t(outputEnd - output) < sequenceBound) [[unlikely]] return 0;
+
+                uint8_t* token = output++;
+                if (literals >= RUN_MASK) {
+                    *token = RUN_MASK << 4;
+                    output = WriteLength(output, literals - RUN_MASK);
+                } else {
+                    *token = static_cast<uint8_t>(literals << 4);
+                }
+
+                std::memcpy(output, anchor, literals);
+                output += literals;
+
+                const size_t offset = input - match;
+                *output++ = static_cast<uint8_t>(offset);
+                *output++ = static_cast<uint8_t>(offset >> 8);
+
+                if (matchLength >= RUN_MASK) {
+                    *token |= RUN_MASK;
+                    output = WriteLength(output, matchLength - RUN_MASK);
+                } else {
+                    *token |= static_cast<uint8_t>(matchLength);
+                }
+
+                input = matchEnd;
+                anchor = input;
+            }
+        }
+
+        const size_t literals = end - anchor;
+        if (size_t(outputEnd - output) < 1 + literals / 255 + 1 + literals) [[unlikely]] return 0;
+
+        uint8_t* token = output++;
+        if (literals >= RUN_MASK) {
+            *token = RUN_MASK << 4;
+            output = WriteLength(output, literals - RUN_MASK);
+        } else {
+            *token = static_cast<uint8_t>(literals << 4);
+        }
+
+        std::memcpy(output, anchor, literals);
+        output += literals;
+
+        return output - reinterpret_cast<uint8_t*>(destination);
+    }
+
+    size_t Decompress(const char* source, const size_t size, char* destination, const size_t capacity) {
+        const uint8_t* input = reinterpret_cast<const uint8_t*>(source);
+        const uint8_t* const inputEnd = input + size;
+
+        uint8_t* const begin = reinterpret_cast<uint8_t*>(destination);
+        uint8_t* output = begin;
+        uint8_t* const outputEnd = begin + capacity;
+
+        while (input < inputEnd) {
+            const uint8_t token = *input++;
+
+            size_t literals = token >> 4;
+            if (literals == RUN_MASK && !ReadLength(input, inputEnd, literals)) [[unlikely]] return 0;
+
+            if (size_t(inputEnd - input) < literals || size_t(outputEnd - output) < literals) [[unlikely]] return 0;
+            std::memcpy(output, input, literals);
+            input += literals;
+            output += literals;
+
+            // The last sequence has no match.
+            if (input == inputEnd) break;
+
+            if (inputEnd - input < 2) [[unlikely]] return 0;
+            const size_t offset = input[0] | (input[1] << 8);
+            input += 2;
+
+            if (offset == 0 || offset > size_t(output - begin)) [[unlikely]] return 0;
+
+            size_t matchLength = token & RUN_MASK;
+            if (matchLength == RUN_MASK && !ReadLength(input, inputEnd, matchLength)) [[unlikely]] return 0;
+            matchLength += MIN_MATCH;
+
+            if (size_t(outputEnd - output) < matchLength) [[unlikely]] return 0;
+
+            const uint8_t* match = output - offset;
+            if (offset >= matchLength) {
+                std::memcpy(output, match, matchLength);
+                output += matchLength;
+            } else {
+                // Overlapping match repeats the recent bytes.
+                for (size_t i = 0; i < matchLength; ++i) *output++ = *match++;
+            }
+        }
+
+        return output - begin;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#include <cstddef>
+
+/// Compressor of the LZ4 block format, the blocks are compatible with the reference implementation
+/// (`LZ4_compress_default/LZ4_decompress_safe`). Favours speed: greedy matching over a small hash table.
+namespace Lz4 {
+    /// Max size of the compressed block of `size` bytes.
+    constexpr size_t CompressBound(const size_t size) { return size + size / 255 + 16; }
+
+    /// Compresses `size` bytes of `source` into `destination` of `capacity` bytes.
+    /// Returns the compressed size, `0` if it doesn't fit the `capacity`.
+    size_t Compress(const char* source, const size_t size, char* destination, const size_t capacity);
+    /// Decompresses the block of `size` bytes into `destination` of `capacity` bytes.
+    /// Returns the decompressed size, `0` if the block is malformed or doesn't fit the `capacity`.
+    size_t Decompress(const char* source, const size_t size, char* destination, const size_t capacity);
+}
+
+#endif
@@ -1,11 +1,15 @@
 #ifndef _MESSAGE_H
 #define _MESSAGE_H
 
+#include <cstddef>
 #include <cstdint>
 #include <chrono>
 
 namespace Msg {
     static constexpr uint16_t DEFAULT_SERVER_PORT = 5252;
+    /// Size of the chunks of the downloaded content that are checksummed. The chunks are aligned within the file,
+    /// so the ones the content starts and ends with may be shorter.
+    static constexpr size_t CHECKSUM_CHUNK_SIZE = 64 * 1024;
 
     enum class Opcodes : uint8_t {
         None,
@@ -16,19 +20,78 @@ namespace Msg {
         Close,
 
         DownloadRecovery,
+        DownloadRange,
+        /// Part of the file streamed in response to the tagged download request.
+        Data,
+        /// Upload of the file the server has an older copy of, only the changes are sent.
+        /// The rebuilt file is checked as the whole uploaded one, `Response::Upload` follows the delta.
+        DeltaUpload,
+        /// Query of the part of the file the server kept from the interrupted upload.
+        UploadRecovery,
+        /// Page of the files within the host directory.
+        List,
 
         MAX
     };
 
+    /// Compression of the transfered file content.
+    enum class Codec : uint8_t {
+        None,
+        Lz4
+    };
+
 namespace Request {
     struct Download {
         size_t position;
-        char fileName[];
+        /// Codec the client accepts, the server may send the file uncompressed anyway.
+        Codec codec;
+        // Aligned to follow the request appended by its size.
+        alignas(size_t) char fileName[];
     };
     struct Upload {
         size_t fileSize;
+        /// Offset the content starts at, the server keeps the part before it from the interrupted upload.
+        size_t position;
+        /// XXH64 of the whole file, the server keeps the file only if its copy matches.
+        uint64_t hash;
+        /// Codec the file content is compressed with.
+        Codec codec;
+        alignas(size_t) char fileName[];
+    };
+    struct UploadRecovery {
+        size_t fileSize;
+        uint64_t hash;
+        char fileName[];
+    };
+    struct DownloadRange {
+        size_t position;
+        size_t size;
+        char fileName[];
+    };
+    struct DeltaUpload {
+        size_t fileSize;
+        /// XXH64 of the whole file, the server keeps the rebuilt file only if it matches.
+        uint64_t hash;
         char fileName[];
     };
+    struct List {
+        /// Max number of the files of the page, the server may send fewer.
+        uint32_t maxCount;
+        /// Two null-terminated paths: the prefix of the listed ones and the last one of the previous page,
+        /// which is empty for the first page. The paths are relative to the host directory.
+        char paths[];
+    };
+
+    /// Instruction of the delta that follows the signatures, the file is rebuilt by them in order.
+    struct DeltaCommand {
+        enum Type : uint8_t {
+            Literal, // `value` bytes of the new content follow.
+            Copy     // Block `value` of the server copy.
+        };
+
+        Type type;
+        uint32_t value;
+    };
 };
 
 namespace Response {
@@ -37,20 +100,80 @@ namespace Response {
         char fileName[];
     };
 
+    /// The content of the untagged download is followed by the CRC32C of each of its chunks,
+    /// so the client fetches again only the damaged ones.
     struct Download {
         enum Status {
             Ready,
             NoSuchFile,
             IsNotFile,
+            Busy, // Too many tagged downloads are running on the connection.
         };
 
         Status status;
+        /// Number of the bytes that follow.
         size_t totalSize;
+        /// Size of the whole file.
+        size_t fileSize;
+        /// Codec the bytes that follow are compressed with, the `totalSize` is the uncompressed size.
+        Codec codec;
     };
 
     struct Time {
         std::time_t time;
     };
+
+    struct UploadRecovery {
+        /// Number of the bytes of the file the server kept, `0` if the upload must start over.
+        size_t position;
+    };
+
+    /// Sent once the uploaded content is received and checked.
+    struct Upload {
+        enum Status {
+            Committed,
+            Corrupted, // The received file doesn't match the hash, it's discarded.
+            Failed     // The file can't be stored.
+        };
+
+        Status status;
+    };
+
+    struct DeltaUpload {
+        enum Status {
+            Ready,     // `blockCount` signatures of the server copy follow, the delta is awaited.
+            NoBase,    // There is no copy to compare with, the file must be uploaded as a whole.
+            Rejected
+        };
+
+        Status status;
+        uint32_t blockSize;
+        uint32_t blockCount;
+        /// The last block is shorter if the size of the copy isn't a multiple of the `blockSize`.
+        uint32_t lastBlockSize;
+    };
+
+    /// Followed by `size` bytes of the entries of the page, ordered by the paths.
+    struct List {
+        uint32_t count;
+        uint32_t size;
+        /// More files follow the page, the next page starts after its last path.
+        bool hasMore;
+    };
+    /// The entries of the page follow each other unaligned, each path takes only its own length.
+    struct ListEntry {
+        uint64_t fileSize;
+        /// Nanoseconds since epoch.
+        int64_t modifyTime;
+        char path[];
+    };
+
+    /// Checksums of the block of the server copy. The weak one is rolled by the client
+    /// over its file to find the block candidates, the strong one confirms them.
+    struct BlockSignature {
+        uint32_t weak;
+        uint64_t strong;
+    };
 };
 
 };
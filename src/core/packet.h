@@ -3,49 +3,132 @@
 
 #include <cstdint>
 #include <cstring>
-#include <vector>
+#include <string_view>
 
 #include "message.h"
+#include "utils.h"
 
 namespace Msg {
     class Packet {
     public:
+        static constexpr uint32_t UNTAGGED = 0;
+
         struct Header {
             Opcodes opcode = Opcodes::MAX;
             uint16_t dataSize = 0;
+            /// Request the packet belongs to, the responses to a tagged request are framed into packets
+            /// carrying its id and may interleave with the responses to the other ones.
+            /// `UNTAGGED` requests are answered in order by the raw response data.
+            uint32_t requestId = UNTAGGED;
 
             inline bool IsValid() const {
                 return (opcode >= Opcodes::Echo && opcode < Opcodes::MAX);
             }
         };
 
+        /// Maximal size of the packet including its header.
+        static constexpr size_t MAX_SIZE = sizeof(Header) + UINT16_MAX;
+
     private:
+        /// Thread-local free list of `MAX_SIZE` buffers. Builders take the storage from the pool
+        /// and return it back when destroyed, so no memory is allocated in the steady state.
+        class Pool {
+            struct Node {
+                Node* next;
+            };
+
+            Node* head = nullptr;
+
+        public:
+            ~Pool() {
+                while (head != nullptr) {
+                    Node* next = head->next;
+                    delete[] reinterpret_cast<uint8_t*>(head);
+                    head = next;
+                }
+            }
+
+            inline uint8_t* Acquire() {
+                if (head == nullptr) [[unlikely]] return new uint8_t[MAX_SIZE];
+
+                Node* node = head;
+                head = node->next;
+                return reinterpret_cast<uint8_t*>(node);
+            }
+
+            inline void Release(uint8_t* buffer) {
+                Node* node = reinterpret_cast<Node*>(buffer);
+                node->next = head;
+                head = node;
+            }
+
+            static inline Pool& Local() {
+                thread_local Pool pool;
+                return pool;
+            }
+        };
+
         class BuildProxy {
         private:
-            std::vector<uint8_t> buffer;
+            uint8_t* buffer = nullptr;
+            size_t size = sizeof(Header);
+            size_t capacity = 0;
+            bool pooled = false;
+
+            inline uint8_t* Reserve(const size_t dataSize) {
+                LIBPOG_ASSERT(size + dataSize <= capacity, "Packet doesn't fit the storage");
+                // Data that doesn't fit is dropped, the packet can't describe it anyway.
+                if (size + dataSize > capacity) [[unlikely]] return nullptr;
+
+                uint8_t* dataDest = buffer + size;
+                size += dataSize;
+                return dataDest;
+            }
+
         public:
-            BuildProxy(const Opcodes opcode) {
-                buffer.resize(sizeof(Header));
-                auto* header = reinterpret_cast<Header*>(buffer.data());
-                header->opcode = opcode; 
+            BuildProxy(const Opcodes opcode, void* storage, const size_t storageCapacity)
+                : buffer(reinterpret_cast<uint8_t*>(storage)), capacity(storageCapacity)
+            {
+                LIBPOG_ASSERT(capacity >= sizeof(Header), "Packet storage is too small");
+
+                auto* header = reinterpret_cast<Header*>(buffer);
+                header->opcode = opcode;
+                header->requestId = UNTAGGED;
+            }
+
+            BuildProxy(const Opcodes opcode) : BuildProxy(opcode, Pool::Local().Acquire(), MAX_SIZE) {
+                pooled = true;
+            }
+
+            BuildProxy(BuildProxy&& other) noexcept
+                : buffer(other.buffer), size(other.size), capacity(other.capacity), pooled(other.pooled)
+            {
+                other.buffer = nullptr;
+                other.pooled = false;
+            }
+            BuildProxy(const BuildProxy&) = delete;
+
+            ~BuildProxy() {
+                if (pooled) Pool::Local().Release(buffer);
             }
 
-            inline BuildProxy& Append(const void* dataPtr, const uint16_t size) {
-                const auto bufferSize = buffer.size();
-                buffer.resize(bufferSize + size);
-                std::memcpy(buffer.data() + bufferSize, dataPtr, size);
+            inline BuildProxy& Tag(const uint32_t requestId) {
+                reinterpret_cast<Header*>(buffer)->requestId = requestId;
                 return *this;
             }
 
-            template<typename T>
-            inline BuildProxy& Append(const T& data) {
-                buffer.resize(buffer.size() + sizeof(data));
-                T* dataDest = reinterpret_cast<T*>(buffer.data() + buffer.size() - sizeof(data));
+            inline BuildProxy& Append(const void* dataPtr, const uint16_t dataSize) {
+                uint8_t* dataDest = Reserve(dataSize);
+                if (dataDest != nullptr) [[likely]] std::memcpy(dataDest, dataPtr, dataSize);
 
-                *dataDest = data;
                 return *this;
             }
 
+            template<typename T>
+            inline BuildProxy& Append(const T& data) {
+                return Append(&data, sizeof(data));
+            }
+
             inline BuildProxy& Append(const char* string) {
                 return Append(string, std::strlen(string) + 1);
             }
@@ -54,9 +137,10 @@ namespace Msg {
                 return Append(string.data(), string.length()).Append((char)0);
             }
 
+            /// Returns the packet placed in the builder storage, it's valid while the builder exists.
             inline const Packet* Complete() {
-                Packet* packet = reinterpret_cast<Packet*>(buffer.data());
-                packet->header.dataSize = buffer.size() - sizeof(Header);
+                Packet* packet = reinterpret_cast<Packet*>(buffer);
+                packet->header.dataSize = size - sizeof(Header);
 
                 return packet;
             }
@@ -66,11 +150,19 @@ namespace Msg {
         uint8_t data[];
 
     public:
+        /// Builds the packet within the thread-local pooled storage.
         static BuildProxy Build(const Opcodes opcode) { return BuildProxy(opcode); }
+        /// Builds the packet within the caller-provided `storage` of `capacity` bytes,
+        /// that must be aligned as `Header` and outlive the packet.
+        static BuildProxy Build(const Opcodes opcode, void* storage, const size_t capacity) {
+            return BuildProxy(opcode, storage, capacity);
+        }
 
         inline const Header& GetHeader() const { return header; }
         inline uint16_t GetSize() const  { return header.dataSize + sizeof(Header); }
         inline uint16_t GetDataSize() const { return header.dataSize; }
+        inline uint32_t GetRequestId() const { return header.requestId; }
+        inline bool IsTagged() const { return header.requestId != UNTAGGED; }
 
         template<typename T>
         inline T* GetDataAs() { return reinterpret_cast<T*>(&data[0]); }
@@ -0,0 +1,68 @@
+#include "poller.h"
+
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "utils.h"
+
+using namespace Net;
+
+Poller::Poller() noexcept {
+    osPoller = epoll_create1(EPOLL_CLOEXEC);
+    if (osPoller < 0) [[unlikely]] {
+        status = static_cast<Status>(errno);
+        Net::Error("Failed to create poller: ", std::system_category().message(static_cast<int>(status)));
+    }
+}
+
+Poller::~Poller() noexcept {
+    if (IsValid()) close(osPoller);
+}
+
+bool Poller::Add(const Socket& socket, const uint64_t key, const uint32_t events) {
+    return Add(socket.GetOsSocket(), key, events);
+}
+
+bool Poller::Add(const int osHandle, const uint64_t key, const uint32_t events) {
+    epoll_event event {};
+    event.events = events | EPOLLET;
+    event.data.u64 = key;
+
+    if (epoll_ctl(osPoller, EPOLL_CTL_ADD, osHandle, &event) < 0) {
+        status = static_cast<Status>(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Poller::Remove(const Socket& socket) {
+    if (epoll_ctl(osPoller, EPOLL_CTL_DEL, socket.GetOsSocket(), nullptr) < 0) {
+        status = static_cast<Status>(errno);
+        return false;
+    }
+    return true;
+}
+
+int Poller::Wait(Event* outEvents, const unsigned int maxEvents, const int timeoutMs) {
+    static thread_local std::vector<epoll_event> osEvents;
+    if (osEvents.size() < maxEvents) osEvents.resize(maxEvents);
+
+    const int count = epoll_wait(osPoller, osEvents.data(), maxEvents, timeoutMs);
+    if (count < 0) {
+        // Interrupted by signal is not a failure, just nothing happend.
+        if (errno == EINTR) return 0;
+
+        status = static_cast<Status>(errno);
+        return -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        outEvents[i].key = osEvents[i].data.u64;
+        outEvents[i].events = osEvents[i].events;
+    }
+
+    return count;
+}
@@ -0,0 +1,63 @@
+#ifndef _NET_POLLER_H
+#define _NET_POLLER_H
+
+#include <cstdint>
+
+#include <sys/epoll.h>
+
+#include "socket.h"
+
+namespace Net {
+    /// Edge-triggered readiness notifier over the os polling facility (`epoll`).
+    /// Each registered `Socket` is identified by a user-defined key that is reported back within events.
+    class Poller {
+    public:
+        enum Events : uint32_t {
+            None = 0,
+            Readable = EPOLLIN,
+            Writable = EPOLLOUT,
+            Closed = EPOLLRDHUP | EPOLLHUP,
+            Error = EPOLLERR
+        };
+
+        struct Event {
+            uint64_t key;
+            uint32_t events;
+
+            inline bool Is(const Events event) const { return (events & event) != 0; }
+        };
+
+    private:
+        int osPoller = -1;
+
+        mutable Status status = Status::Success;
+
+    public:
+        Poller() noexcept;
+        Poller(const Poller&) = delete;
+
+        ~Poller() noexcept;
+
+        /// Starts watching the socket for the `events`, the notifications are edge-triggered:
+        /// the event is reported once per readiness change, so the socket must be drained until `WouldBlock`.
+        bool Add(const Socket& socket, const uint64_t key, const uint32_t events);
+        /// Same as `Add(const Socket&, ...)`, but works with any pollable os descriptor.
+        bool Add(const int osHandle, const uint64_t key, const uint32_t events);
+        bool Remove(const Socket& socket);
+
+        /// Waits for events at most `timeoutMs` milliseconds, `-1` means infinite.
+        /// Returns the number of events written to `outEvents`, `-1` if failed.
+        int Wait(Event* outEvents, const unsigned int maxEvents, const int timeoutMs = -1);
+
+        /// Returns last error/failure code and clear it.
+        inline Status Fail() const {
+            const Status temp = status;
+            status = Success;
+            return temp;
+        }
+
+        inline bool IsValid() const { return osPoller >= 0; }
+    };
+}
+
+#endif
@@ -0,0 +1,607 @@
+#include "reliable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include "utils.h"
+
+using namespace Net;
+
+/// Compares sequence numbers that may wrap around.
+static inline bool Before(const uint32_t a, const uint32_t b) {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+static inline int ToTimeoutMs(const uint64_t timeUs) {
+    return static_cast<int>((timeUs + 999) / 1000);
+}
+
+uint64_t ReliableConnection::Now() {
+    const auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+}
+
+ReliableConnection::ReliableConnection(Socket& sharedSocket, const Address& peer)
+    : socket(&sharedSocket), peer(peer), isShared(true)
+{
+    Allocate();
+}
+
+void ReliableConnection::SetupSocket(Socket& socket) {
+    // Limited by the os, the defaults are used if failed.
+    socket.SetOption<int>(Socket::Option::ReceiveBuffer, SOCKET_BUFFER_SIZE);
+    socket.SetOption<int>(Socket::Option::SendBuffer, SOCKET_BUFFER_SIZE);
+    socket.EnableReceiveCoalescing();
+    socket.Fail();
+}
+
+void ReliableConnection::Configure(const TransportOptions& options) {
+    congestion = CongestionControl::Create(options.congestion);
+    lossRate = options.lossRate;
+}
+
+void ReliableConnection::Allocate() {
+    if (congestion == nullptr) congestion = CongestionControl::Create(CongestionAlgorithm::Aimd);
+
+    sendBuffer = std::make_unique<char[]>(WINDOW_SIZE * SEGMENT_SIZE);
+    sendSlots = std::make_unique<SendSlot[]>(WINDOW_SIZE);
+    receiveBuffer = std::make_unique<char[]>(WINDOW_SIZE * PAYLOAD_SIZE);
+    receiveSlots = std::make_unique<ReceiveSlot[]>(WINDOW_SIZE);
+    datagrams = std::make_unique<char[]>(RECEIVE_BATCH_SIZE * RECEIVE_BUFFER_SIZE);
+}
+
+bool ReliableConnection::Break(const Status reason) {
+    failure = (reason == Success) ? Failed : reason;
+    status = failure;
+    return false;
+}
+
+bool ReliableConnection::Connect(const Address& address) {
+    if (!ownSocket.Open(address.GetFamily(), Protocol::UDP)) return Break(ownSocket.Fail());
+
+    SetupSocket(ownSocket);
+    if (!ownSocket.Connect(address)) return Break(ownSocket.Fail());
+
+    socket = &ownSocket;
+    peer = address;
+    Allocate();
+
+    for (unsigned int attempt = 0; attempt < CONNECT_ATTEMPTS; ++attempt) {
+        if (!SendControl(SegmentType::Connect)) return false;
+
+        const uint64_t deadline = Now() + CONNECT_TIMEOUT;
+        for (uint64_t now = Now(); now < deadline; now = Now()) {
+            if (!socket->WaitReceive(ToTimeoutMs(deadline - now))) {
+                if (socket->GetStatus() != Success) return Break(socket->Fail());
+                break;
+            }
+
+            const uint received = socket->Receive(datagrams.get(), RECEIVE_BUFFER_SIZE);
+            if (received == 0) return Break(socket->Fail());
+
+            Segment segment;
+            if (received < sizeof(segment)) continue;
+
+            std::memcpy(&segment, datagrams.get(), sizeof(segment));
+            if (segment.type == SegmentType::Accept) return true;
+        }
+    }
+
+    return Break(Timeout);
+}
+
+bool ReliableConnection::Accept() {
+    return SendControl(SegmentType::Accept);
+}
+
+bool ReliableConnection::SendDatagrams(iovec* batch, unsigned int count) {
+    iovec keptBatch[Socket::MAX_BATCH_SIZE];
+
+    if (lossRate > 0.0f) [[unlikely]] {
+        // Dropped datagrams are considered sent.
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < count; ++i) {
+            if (distribution(lossRandom) >= lossRate) keptBatch[kept++] = batch[i];
+        }
+
+        batch = keptBatch;
+        count = kept;
+    }
+
+    unsigned int sent = 0;
+    while (sent < count) {
+        uint sentNow = 0;
+        if (isSegmenting) {
+            sentNow = isShared
+                ? socket->SendToSegmented(peer, batch + sent, count - sent, SEGMENT_SIZE)
+                : socket->SendSegmented(batch + sent, count - sent, SEGMENT_SIZE);
+
+            if (sentNow == 0) [[unlikely]] {
+                // The os or the path can't cut the segments, send them one by one.
+                const Status reason = socket->Fail();
+                if (reason == WouldBlock || reason == TryAgain) return Break(reason);
+
+                isSegmenting = false;
+                continue;
+            }
+        } else {
+            sentNow = isShared
+                ? socket->SendToBatch(peer, batch + sent, count - sent)
+                : socket->SendBatch(batch + sent, count - sent);
+            if (sentNow == 0) [[unlikely]] return Break(socket->Fail());
+        }
+
+        sent += sentNow;
+    }
+    return true;
+}
+
+bool ReliableConnection::SendControl(const SegmentType type) {
+    Segment segment;
+    segment.type = type;
+
+    iovec datagram = { &segment, sizeof(segment) };
+    return SendDatagrams(&datagram, 1);
+}
+
+bool ReliableConnection::SendAck() {
+    Segment ack;
+    ack.type = SegmentType::Ack;
+    ack.sequence = receiveNext;
+    ack.window = receiveBase + WINDOW_SIZE - receiveNext;
+    ack.timestamp = echoTimestamp;
+
+    for (unsigned int i = 0; i < 64; ++i) {
+        const uint32_t sequence = receiveNext + 1 + i;
+        if (!Before(sequence, receiveBase + WINDOW_SIZE)) break;
+
+        if (receiveSlots[sequence & WINDOW_MASK].received) ack.selective |= (1ull << i);
+    }
+
+    advertisedWindow = ack.window;
+    ackPending = false;
+    // Repeated acknowledgements don't measure the round trip.
+    echoTimestamp = 0;
+
+    iovec datagram = { &ack, sizeof(ack) };
+    return SendDatagrams(&datagram, 1);
+}
+
+bool ReliableConnection::Queue(const iovec* buffers, const unsigned int count, const SegmentType type) {
+    unsigned int index = 0;
+    size_t offset = 0;
+
+    const auto hasData = [&]() {
+        while (index < count && offset == buffers[index].iov_len) {
+            ++index;
+            offset = 0;
+        }
+        return index < count;
+    };
+
+    // Only the end of the stream is sent without payload.
+    if (type == SegmentType::Data && !hasData()) return true;
+
+    do {
+        while (sendTail - sendBase >= WINDOW_SIZE) {
+            if (!Pump()) return false;
+        }
+
+        char* payload = GetSendSegment(sendTail) + sizeof(Segment);
+        uint16_t size = 0;
+
+        while (hasData() && size < PAYLOAD_SIZE) {
+            const size_t chunkSize = std::min<size_t>(buffers[index].iov_len - offset, PAYLOAD_SIZE - size);
+            std::memcpy(payload + size, reinterpret_cast<const char*>(buffers[index].iov_base) + offset, chunkSize);
+
+            size += chunkSize;
+            offset += chunkSize;
+        }
+
+        Segment segment;
+        segment.type = type;
+        segment.size = size;
+        segment.sequence = sendTail;
+        std::memcpy(GetSendSegment(sendTail), &segment, sizeof(segment));
+
+        sendSlots[sendTail & WINDOW_MASK] = SendSlot{ .size = size };
+        ++sendTail;
+    } while (hasData());
+
+    return Transmit();
+}
+
+void ReliableConnection::RefillPacing(const uint64_t now) {
+    const double rate = congestion->GetPacingRate();
+    const double burst = std::max(MIN_PACING_BURST, rate * PACING_BURST_TIME / 1e6);
+
+    pacingCredit = std::min(pacingCredit + rate * (now - pacingTime) / 1e6, burst);
+    pacingTime = now;
+}
+
+bool ReliableConnection::CanTransmit() const {
+    return Before(sendNext, sendTail) && Before(sendNext, sendLimit) && inFlight < congestion->GetWindow();
+}
+
+bool ReliableConnection::Transmit() {
+    iovec batch[Socket::MAX_BATCH_SIZE];
+    unsigned int batchSize = 0;
+
+    const uint64_t now = Now();
+    RefillPacing(now);
+
+    if (deliveredTime == 0) deliveredTime = now;
+
+    const bool isPaced = congestion->GetPacingRate() > 0;
+    while (CanTransmit() && (!isPaced || pacingCredit >= 1.0)) {
+        SendSlot& slot = sendSlots[sendNext & WINDOW_MASK];
+        char* segment = GetSendSegment(sendNext);
+
+        slot.sentTime = now;
+        slot.delivered = delivered;
+        slot.deliveredTime = deliveredTime;
+        std::memcpy(segment + offsetof(Segment, timestamp), &now, sizeof(now));
+
+        batch[batchSize++] = { segment, sizeof(Segment) + slot.size };
+        ++sendNext;
+        ++inFlight;
+        if (isPaced) pacingCredit -= 1.0;
+
+        if (batchSize == Socket::MAX_BATCH_SIZE) {
+            if (!SendDatagrams(batch, batchSize)) return false;
+            batchSize = 0;
+        }
+    }
+
+    return (batchSize > 0) ? SendDatagrams(batch, batchSize) : true;
+}
+
+bool ReliableConnection::Retransmit() {
+    iovec batch[Socket::MAX_BATCH_SIZE];
+    unsigned int batchSize = 0;
+    bool isTimedOut = false;
+
+    const uint64_t now = Now();
+    const uint64_t rttTimeout = (smoothedRtt > 0) ? smoothedRtt + 4 * rttVariance : rto;
+
+    for (uint32_t sequence = sendBase; Before(sequence, sendNext); ++sequence) {
+        SendSlot& slot = sendSlots[sequence & WINDOW_MASK];
+        if (slot.acked) continue;
+
+        const uint64_t elapsed = now - slot.sentTime;
+        const bool isExpired = elapsed >= rto;
+        // Acknowledged followers mean the segment is lost, but give its last copy a round trip to arrive.
+        const bool isLost = Before(sequence + LOSS_THRESHOLD, highestAcked) && elapsed >= rttTimeout;
+
+        if (!isExpired && !isLost) continue;
+        if (isExpired && ++slot.retransmits > MAX_RETRANSMITS) [[unlikely]] return Break(Timeout);
+
+        isTimedOut |= isExpired;
+
+        if (isLost && !Before(sequence, recoveryPoint)) {
+            congestion->OnLoss(now, inFlight);
+            recoveryPoint = sendNext;
+        }
+
+        char* segment = GetSendSegment(sequence);
+        slot.sentTime = now;
+        std::memcpy(segment + offsetof(Segment, timestamp), &now, sizeof(now));
+
+        batch[batchSize++] = { segment, sizeof(Segment) + slot.size };
+        if (batchSize == Socket::MAX_BATCH_SIZE) {
+            if (!SendDatagrams(batch, batchSize)) return false;
+            batchSize = 0;
+        }
+    }
+
+    // Back off while the peer doesn't answer.
+    if (isTimedOut) {
+        rto = std::min(rto * 2, MAX_RTO);
+
+        congestion->OnTimeout(now);
+        recoveryPoint = sendNext;
+    }
+
+    return (batchSize > 0) ? SendDatagrams(batch, batchSize) : true;
+}
+
+int ReliableConnection::GetWaitTimeout() const {
+    const uint64_t now = Now();
+    uint64_t timeout = UINT64_MAX;
+
+    if (Before(sendBase, sendNext)) {
+        uint64_t oldestTime = UINT64_MAX;
+        for (uint32_t sequence = sendBase; Before(sequence, sendNext); ++sequence) {
+            const SendSlot& slot = sendSlots[sequence & WINDOW_MASK];
+            if (!slot.acked) oldestTime = std::min(oldestTime, slot.sentTime);
+        }
+
+        const uint64_t deadline = oldestTime + rto;
+        timeout = (deadline > now) ? deadline - now : 0;
+    } else if (Before(sendNext, sendTail) || advertisedWindow < WINDOW_SIZE / 2) {
+        // Waiting for the window to open, or the peer might have missed that it did.
+        timeout = rto;
+    }
+
+    // Paced segments wait for their turn.
+    const double rate = congestion->GetPacingRate();
+    if (rate > 0 && pacingCredit < 1.0 && CanTransmit()) {
+        timeout = std::min(timeout, static_cast<uint64_t>((1.0 - pacingCredit) * 1e6 / rate));
+    }
+
+    return (timeout == UINT64_MAX) ? -1 : ToTimeoutMs(timeout);
+}
+
+bool ReliableConnection::Pump() {
+    if (failure != Success) [[unlikely]] return Break(failure);
+
+    if (socket->WaitReceive(GetWaitTimeout())) {
+        if (!ReceiveDatagrams()) return false;
+    } else {
+        if (socket->GetStatus() != Success) [[unlikely]] return Break(socket->Fail());
+        // Repeat the window update, the peer might wait for it.
+        if (advertisedWindow < WINDOW_SIZE / 2) ackPending = true;
+    }
+
+    if (ackPending && !SendAck()) return false;
+    if (!Retransmit()) return false;
+
+    return Transmit();
+}
+
+bool ReliableConnection::Flush(const uint64_t timeout) {
+    const uint64_t deadline = Now() + timeout;
+    while (Before(sendBase, sendTail) && Now() < deadline) {
+        if (!Pump()) return false;
+    }
+    return true;
+}
+
+bool ReliableConnection::ReceiveDatagrams() {
+    iovec buffers[RECEIVE_BATCH_SIZE];
+    uint sizes[RECEIVE_BATCH_SIZE];
+    uint segmentSizes[RECEIVE_BATCH_SIZE];
+    Address addresses[RECEIVE_BATCH_SIZE];
+
+    for (unsigned int i = 0; i < RECEIVE_BATCH_SIZE; ++i) {
+        buffers[i] = { datagrams.get() + i * RECEIVE_BUFFER_SIZE, RECEIVE_BUFFER_SIZE };
+    }
+
+    const uint received = isShared
+        ? socket->ReceiveFromBatch(buffers, RECEIVE_BATCH_SIZE, sizes, addresses, Socket::DontWait, segmentSizes)
+        : socket->ReceiveBatch(buffers, RECEIVE_BATCH_SIZE, sizes, Socket::DontWait, segmentSizes);
+
+    if (received == 0) {
+        const Status reason = socket->Fail();
+        return (reason == WouldBlock) ? true : Break(reason);
+    }
+
+    for (unsigned int i = 0; i < received; ++i) {
+        // Other clients of the server.
+        if (isShared && addresses[i] != peer) continue;
+
+        const char* buffer = reinterpret_cast<const char*>(buffers[i].iov_base);
+        const uint segmentSize = (segmentSizes[i] != 0) ? segmentSizes[i] : sizes[i];
+        // Segments of the peer never exceed the slot, the larger ones are forged.
+        if (segmentSizes[i] > SEGMENT_SIZE) [[unlikely]] continue;
+
+        // Coalesced datagrams follow each other, only the last one may be shorter.
+        for (uint offset = 0; offset < sizes[i]; offset += segmentSize) {
+            HandleDatagram(buffer + offset, std::min(segmentSize, sizes[i] - offset));
+        }
+    }
+    return true;
+}
+
+void ReliableConnection::HandleDatagram(const char* datagram, const unsigned int size) {
+    Segment segment;
+    if (size < sizeof(segment)) [[unlikely]] return;
+
+    std::memcpy(&segment, datagram, sizeof(segment));
+    if (segment.size > PAYLOAD_SIZE || size != sizeof(segment) + segment.size) [[unlikely]] return;
+
+    switch (segment.type) {
+        case SegmentType::Data:
+        case SegmentType::Finish:
+            HandleData(segment, datagram + sizeof(segment));
+            break;
+        case SegmentType::Ack:
+            HandleAck(segment);
+            break;
+        case SegmentType::Connect:
+            // The accept is lost, repeat it.
+            if (isShared) SendControl(SegmentType::Accept);
+            break;
+        default:
+            break;
+    }
+}
+
+void ReliableConnection::HandleData(const Segment& segment, const char* payload) {
+    ackPending = true;
+    echoTimestamp = segment.timestamp;
+
+    // Duplicate or doesn't fit the buffer.
+    if (Before(segment.sequence, receiveNext) || !Before(segment.sequence, receiveBase + WINDOW_SIZE)) return;
+
+    ReceiveSlot& slot = receiveSlots[segment.sequence & WINDOW_MASK];
+    if (slot.received) return;
+
+    std::memcpy(GetReceivePayload(segment.sequence), payload, segment.size);
+    slot.size = segment.size;
+    slot.received = true;
+    slot.finish = (segment.type == SegmentType::Finish);
+    isFinishReceived |= slot.finish;
+
+    while (Before(receiveNext, receiveBase + WINDOW_SIZE) && receiveSlots[receiveNext & WINDOW_MASK].received) {
+        ++receiveNext;
+    }
+}
+
+void ReliableConnection::HandleAck(const Segment& segment) {
+    const uint32_t cumulative = segment.sequence;
+    if (Before(sendNext, cumulative)) [[unlikely]] return;
+
+    uint32_t acked = 0;
+    const SendSlot* latestSlot = nullptr;
+
+    const auto acknowledge = [&](const uint32_t sequence) {
+        SendSlot& slot = sendSlots[sequence & WINDOW_MASK];
+        if (slot.acked) return;
+
+        slot.acked = true;
+        ++acked;
+        if (inFlight > 0) --inFlight;
+
+        if (latestSlot == nullptr || slot.sentTime >= latestSlot->sentTime) latestSlot = &slot;
+    };
+
+    for (uint32_t sequence = sendBase; Before(sequence, cumulative); ++sequence) acknowledge(sequence);
+
+    if (Before(sendBase, cumulative)) sendBase = cumulative;
+    if (Before(highestAcked, sendBase)) highestAcked = sendBase;
+
+    for (unsigned int i = 0; i < 64; ++i) {
+        if ((segment.selective & (1ull << i)) == 0) continue;
+
+        const uint32_t sequence = cumulative + 1 + i;
+        if (!Before(sequence, sendNext)) break;
+
+        acknowledge(sequence);
+        if (Before(highestAcked, sequence + 1)) highestAcked = sequence + 1;
+    }
+
+    sendLimit = cumulative + segment.window;
+
+    const uint64_t now = Now();
+    uint64_t rtt = 0;
+    if (segment.timestamp != 0 && segment.timestamp <= now) {
+        rtt = now - segment.timestamp;
+        UpdateRtt(rtt);
+    }
+
+    if (acked == 0) return;
+
+    delivered += acked;
+    deliveredTime = now;
+
+    // Rate of the delivery since the latest acknowledged segment was sent.
+    double deliveryRate = 0;
+    const uint64_t interval = now - latestSlot->deliveredTime;
+    if (interval > 0) deliveryRate = (delivered - latestSlot->delivered) * 1e6 / interval;
+
+    congestion->OnAck({ now, acked, inFlight, rtt, deliveryRate });
+}
+
+void ReliableConnection::UpdateRtt(const uint64_t sample) {
+    if (smoothedRtt == 0) {
+        smoothedRtt = sample;
+        rttVariance = sample / 2;
+    } else {
+        const uint64_t deviation = (sample > smoothedRtt) ? sample - smoothedRtt : smoothedRtt - sample;
+        rttVariance = (3 * rttVariance + deviation) / 4;
+        smoothedRtt = (7 * smoothedRtt + sample) / 8;
+    }
+
+    rto = std::clamp(smoothedRtt + 4 * rttVariance, MIN_RTO, MAX_RTO);
+}
+
+uint ReliableConnection::Read(iovec* buffers, const unsigned int count) {
+    unsigned int index = 0;
+    size_t offset = 0;
+    uint read = 0;
+
+    while (index < count && Before(receiveBase, receiveNext)) {
+        ReceiveSlot& slot = receiveSlots[receiveBase & WINDOW_MASK];
+        if (slot.finish) {
+            peerFinished = true;
+            break;
+        }
+
+        const size_t chunkSize = std::min<size_t>(slot.size - receiveOffset, buffers[index].iov_len - offset);
+        std::memcpy(
+            reinterpret_cast<char*>(buffers[index].iov_base) + offset,
+            GetReceivePayload(receiveBase) + receiveOffset,
+            chunkSize
+        );
+
+        read += chunkSize;
+        offset += chunkSize;
+        receiveOffset += chunkSize;
+
+        if (receiveOffset == slot.size) {
+            slot.received = false;
+            receiveOffset = 0;
+            ++receiveBase;
+        }
+        if (offset == buffers[index].iov_len) {
+            ++index;
+            offset = 0;
+        }
+    }
+
+    // Let the peer know that the window is open again.
+    const uint32_t window = receiveBase + WINDOW_SIZE - receiveNext;
+    if (advertisedWindow < WINDOW_SIZE / 2 && window >= WINDOW_SIZE / 2) SendAck();
+
+    return read;
+}
+
+void ReliableConnection::Close() {
+    if (socket == nullptr || isClosed || failure != Success) return;
+    isClosed = true;
+
+    if (!Queue(nullptr, 0, SegmentType::Finish)) return;
+
+    // The peer that finished might be gone already, the finish is sent just once then.
+    if (!isFinishReceived) Flush(CLOSE_TIMEOUT);
+}
+
+uint ReliableConnection::Send(const void* buffer, const unsigned int size) {
+    const iovec data = { const_cast<void*>(buffer), size };
+    return SendV(&data, 1);
+}
+
+uint ReliableConnection::SendV(const iovec* buffers, const unsigned int count) {
+    if (failure != Success) [[unlikely]] return Break(failure);
+
+    uint size = 0;
+    for (unsigned int i = 0; i < count; ++i) size += buffers[i].iov_len;
+
+    return Queue(buffers, count, SegmentType::Data) ? size : 0;
+}
+
+uint ReliableConnection::Receive(void* buffer, const unsigned int size) {
+    iovec data = { buffer, size };
+    return ReceiveV(&data, 1);
+}
+
+uint ReliableConnection::ReceiveV(iovec* buffers, const unsigned int count) {
+    if (failure != Success) [[unlikely]] return Break(failure);
+
+    while (true) {
+        const uint read = Read(buffers, count);
+        if (read > 0) return read;
+
+        if (peerFinished) {
+            status = ConnectionReset;
+            return 0;
+        }
+        if (!Pump()) return 0;
+    }
+}
+
+uint ReliableConnection::ReceiveAll(void* buffer, const unsigned int size) {
+    unsigned int received = 0;
+    while (received < size) {
+        const uint chunkSize = Receive(reinterpret_cast<char*>(buffer) + received, size - received);
+        if (chunkSize == 0) return 0;
+
+        received += chunkSize;
+    }
+    return received;
+}
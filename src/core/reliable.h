@@ -0,0 +1,226 @@
+#ifndef _NET_RELIABLE_H
+#define _NET_RELIABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <random>
+
+#include "congestion.h"
+#include "connection.h"
+#include "socket.h"
+
+namespace Net {
+    struct TransportOptions {
+        CongestionAlgorithm congestion = CongestionAlgorithm::Aimd;
+        /// Share of the outgoing datagrams dropped on purpose, emulates a lossy link to measure the transport.
+        float lossRate = 0.0f;
+    };
+
+    /// Reliable ordered stream over UDP datagrams.
+    ///
+    /// The data is split into numbered segments. The receiver acknowledges them cumulatively and
+    /// selectively and advertises how many segments it can buffer. The sender keeps a sliding window
+    /// of unacknowledged segments and retransmits those reported lost or not acknowledged within
+    /// the timeout derived from the measured round-trip time. The flight is limited and paced
+    /// by the pluggable congestion control.
+    class ReliableConnection final : public Connection {
+    public:
+        enum class SegmentType : uint8_t {
+            None,
+            Connect,
+            Accept,
+            Data,
+            Finish, // Sequenced end of the stream.
+            Ack
+        };
+
+        struct Segment {
+            SegmentType type = SegmentType::None;
+            uint8_t reserved = 0;
+            /// Size of the payload following the segment header.
+            uint16_t size = 0;
+            /// `Data/Finish`: number of the segment, `Ack`: number of the first missing segment.
+            uint32_t sequence = 0;
+            /// `Ack`: number of segments starting from `sequence` the receiver can buffer.
+            uint32_t window = 0;
+            uint32_t reserved2 = 0;
+            /// `Ack`: bit `i` is set if the segment `sequence + 1 + i` is received.
+            uint64_t selective = 0;
+            /// `Data/Finish`: send time in microseconds, `Ack`: echoed send time of the latest received segment.
+            uint64_t timestamp = 0;
+        };
+
+        static constexpr unsigned int SEGMENT_SIZE = 8 * 1024;
+        static constexpr unsigned int PAYLOAD_SIZE = SEGMENT_SIZE - sizeof(Segment);
+        /// Max number of segments in flight and buffered by the receiver, must be a power of two.
+        static constexpr unsigned int WINDOW_SIZE = 256;
+        /// Max number of buffers taken from the socket at once, each holds the datagrams coalesced by the os.
+        static constexpr unsigned int RECEIVE_BATCH_SIZE = 16;
+        static constexpr unsigned int RECEIVE_BUFFER_SIZE = Socket::MAX_SEGMENTED_SIZE;
+        /// Size of the os socket buffers, must fit the window sent without waiting.
+        static constexpr int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+        // Timeouts in microseconds.
+        static constexpr uint64_t INITIAL_RTO = 200 * 1000;
+        static constexpr uint64_t MIN_RTO = 20 * 1000;
+        static constexpr uint64_t MAX_RTO = 2 * 1000 * 1000;
+        static constexpr uint64_t CONNECT_TIMEOUT = 500 * 1000;
+        static constexpr uint64_t CLOSE_TIMEOUT = 1000 * 1000;
+
+        static constexpr unsigned int CONNECT_ATTEMPTS = 10;
+        /// The peer is considered lost if a segment isn't acknowledged after this number of retransmissions.
+        static constexpr unsigned int MAX_RETRANSMITS = 12;
+        /// A segment is considered lost if this number of the following segments is acknowledged.
+        static constexpr unsigned int LOSS_THRESHOLD = 3;
+
+        /// Max number of segments sent at once by the paced sender, at least `MIN_PACING_BURST`.
+        static constexpr uint64_t PACING_BURST_TIME = 2 * 1000;
+        static constexpr double MIN_PACING_BURST = 16;
+
+    private:
+        static constexpr uint32_t WINDOW_MASK = WINDOW_SIZE - 1;
+
+        struct SendSlot {
+            uint64_t sentTime = 0;
+            // Delivery progress at the send time, to measure the delivery rate.
+            uint64_t delivered = 0;
+            uint64_t deliveredTime = 0;
+            uint16_t size = 0;
+            uint8_t retransmits = 0;
+            bool acked = false;
+        };
+
+        struct ReceiveSlot {
+            uint16_t size = 0;
+            bool received = false;
+            bool finish = false;
+        };
+
+        Socket ownSocket;
+        Socket* socket = nullptr;
+        Address peer;
+        /// The socket is shared by the connections of the server, datagrams are addressed and filtered by the `peer`.
+        bool isShared = false;
+        /// Full segments are sent as one buffer cut by the os, turned off if the path doesn't support it.
+        bool isSegmenting = true;
+
+        // Segments with headers, indexed by sequence number modulo `WINDOW_SIZE`.
+        std::unique_ptr<char[]> sendBuffer;
+        std::unique_ptr<SendSlot[]> sendSlots;
+        // Payloads of the received segments.
+        std::unique_ptr<char[]> receiveBuffer;
+        std::unique_ptr<ReceiveSlot[]> receiveSlots;
+        std::unique_ptr<char[]> datagrams;
+
+        uint32_t sendBase = 0;  // Oldest unacknowledged segment.
+        uint32_t sendNext = 0;  // Next segment to transmit for the first time.
+        uint32_t sendTail = 0;  // Next segment to queue.
+        uint32_t sendLimit = WINDOW_SIZE; // First segment the receiver can't buffer.
+        uint32_t highestAcked = 0; // Next after the highest selectively acknowledged segment.
+        uint32_t inFlight = 0;
+        // Losses of the segments sent before are considered already reacted to.
+        uint32_t recoveryPoint = 0;
+
+        std::unique_ptr<CongestionControl> congestion;
+        uint64_t delivered = 0;
+        uint64_t deliveredTime = 0;
+        double pacingCredit = MIN_PACING_BURST;
+        uint64_t pacingTime = 0;
+
+        float lossRate = 0.0f;
+        std::minstd_rand lossRandom;
+
+        uint32_t receiveBase = 0; // Next segment to deliver.
+        uint32_t receiveNext = 0; // First missing segment.
+        uint16_t receiveOffset = 0; // Delivered part of the `receiveBase` segment.
+        uint32_t advertisedWindow = WINDOW_SIZE;
+
+        uint64_t echoTimestamp = 0;
+        bool ackPending = false;
+
+        uint64_t smoothedRtt = 0;
+        uint64_t rttVariance = 0;
+        uint64_t rto = INITIAL_RTO;
+
+        bool isClosed = false;
+        /// The peer closed its side and all its data is delivered.
+        bool peerFinished = false;
+        /// The peer closed its side, but some of its data may be not delivered yet.
+        bool isFinishReceived = false;
+
+        /// Failure that broke the connection, every following operation fails with it.
+        Status failure = Success;
+        mutable Status status = Success;
+
+        static uint64_t Now();
+
+        inline char* GetSendSegment(const uint32_t sequence) const {
+            return sendBuffer.get() + (sequence & WINDOW_MASK) * SEGMENT_SIZE;
+        }
+        inline char* GetReceivePayload(const uint32_t sequence) const {
+            return receiveBuffer.get() + (sequence & WINDOW_MASK) * PAYLOAD_SIZE;
+        }
+
+        void Allocate();
+        bool Break(const Status reason);
+
+        bool SendDatagrams(iovec* batch, unsigned int count);
+        bool SendControl(const SegmentType type);
+        bool SendAck();
+
+        bool Queue(const iovec* buffers, const unsigned int count, const SegmentType type);
+        bool Transmit();
+        void RefillPacing(const uint64_t now);
+        bool CanTransmit() const;
+        bool Retransmit();
+        /// Waits for the incoming datagrams or the nearest retransmission, handles them and transmits what the window allows.
+        bool Pump();
+        bool Flush(const uint64_t timeout);
+        int GetWaitTimeout() const;
+
+        bool ReceiveDatagrams();
+        void HandleDatagram(const char* datagram, const unsigned int size);
+        void HandleData(const Segment& segment, const char* payload);
+        void HandleAck(const Segment& segment);
+        void UpdateRtt(const uint64_t sample);
+
+        uint Read(iovec* buffers, const unsigned int count);
+
+        void Close() override;
+
+        friend class UdpClient;
+        friend class UdpServer;
+
+    public:
+        ReliableConnection() = default;
+        /// Server side connection over the `sharedSocket` of the server.
+        ReliableConnection(Socket& sharedSocket, const Address& peer);
+
+        ~ReliableConnection() override { Close(); }
+
+        /// Opens own socket and makes the handshake with the server at `address`.
+        bool Connect(const Address& address);
+        /// Answers the handshake of the `peer`.
+        bool Accept();
+
+        void Configure(const TransportOptions& options);
+
+        /// Enlarges the os buffers of the `socket` to fit the window and lets the os coalesce the incoming segments.
+        static void SetupSocket(Socket& socket);
+
+        uint Send(const void* buffer, const unsigned int size) override;
+        uint Receive(void* buffer, const unsigned int size) override;
+        uint ReceiveAll(void* buffer, const unsigned int size) override;
+
+        uint SendV(const iovec* buffers, const unsigned int count) override;
+        uint ReceiveV(iovec* buffers, const unsigned int count) override;
+
+        inline Status Fail() override {
+            const Status temp = status;
+            status = Success;
+            return temp;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "ring.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+using namespace Net;
+
+static inline int io_uring_setup(const unsigned int entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static inline int io_uring_enter(const int ring, const unsigned int toSubmit, const unsigned int minComplete, const unsigned int flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static inline int io_uring_register(const int ring, const unsigned int opcode, const void* arg, const unsigned int argsNumber) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, arg, argsNumber));
+}
+
+Ring::~Ring() noexcept {
+    if (sqes != nullptr) munmap(sqes, sqesSize);
+    if (cqRingPtr != nullptr && cqRingPtr != sqRingPtr) munmap(cqRingPtr, cqRingSize);
+    if (sqRingPtr != nullptr) munmap(sqRingPtr, sqRingSize);
+    if (IsValid()) close(osRing);
+    if (osNotifier >= 0) close(osNotifier);
+}
+
+bool Ring::Setup(const unsigned int entries) {
+    LIBPOG_ASSERT(IsValid() == false, "Ring can be setup only once");
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    osRing = io_uring_setup(entries, &params);
+    if (osRing < 0) [[unlikely]] {
+        status = static_cast<Status>(errno);
+        Net::Error("Failed to setup io_uring: ", std::system_category().message(static_cast<int>(status)));
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    // Both queues may be mapped at once.
+    const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+        if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+        cqRingSize = sqRingSize;
+    }
+
+    sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, osRing, IORING_OFF_SQ_RING);
+    if (sqRingPtr == MAP_FAILED) goto fail;
+
+    if (singleMap) {
+        cqRingPtr = sqRingPtr;
+    } else {
+        cqRingPtr = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, osRing, IORING_OFF_CQ_RING);
+        if (cqRingPtr == MAP_FAILED) goto fail;
+    }
+
+    sqes = reinterpret_cast<io_uring_sqe*>(
+        mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, osRing, IORING_OFF_SQES)
+    );
+    if (sqes == MAP_FAILED) goto fail;
+
+    {
+        char* sqRing = reinterpret_cast<char*>(sqRingPtr);
+        sqHead = reinterpret_cast<unsigned int*>(sqRing + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned int*>(sqRing + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned int*>(sqRing + params.sq_off.ring_mask);
+        sqEntries = *reinterpret_cast<unsigned int*>(sqRing + params.sq_off.ring_entries);
+        sqArray = reinterpret_cast<unsigned int*>(sqRing + params.sq_off.array);
+
+        char* cqRing = reinterpret_cast<char*>(cqRingPtr);
+        cqHead = reinterpret_cast<unsigned int*>(cqRing + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned int*>(cqRing + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned int*>(cqRing + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+        sqLocalTail = *sqTail;
+    }
+
+    return true;
+
+fail:
+    status = static_cast<Status>(errno);
+    Net::Error("Failed to map io_uring: ", std::system_category().message(static_cast<int>(status)));
+
+    if (sqes == MAP_FAILED) sqes = nullptr;
+    if (cqRingPtr == MAP_FAILED) cqRingPtr = nullptr;
+    if (sqRingPtr == MAP_FAILED) sqRingPtr = nullptr;
+    return false;
+}
+
+bool Ring::Register(const unsigned int opcode, const void* arg, const unsigned int argsNumber) {
+    if (io_uring_register(osRing, opcode, arg, argsNumber) < 0) {
+        status = static_cast<Status>(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Ring::RegisterBuffers(const iovec* buffers, const unsigned int number) {
+    return Register(IORING_REGISTER_BUFFERS, buffers, number);
+}
+
+bool Ring::RegisterFiles(const unsigned int number) {
+    const std::vector<int> files(number, -1);
+    return Register(IORING_REGISTER_FILES, files.data(), number);
+}
+
+bool Ring::SetFile(const unsigned int index, const int osFile) {
+    io_uring_files_update update;
+    std::memset(&update, 0, sizeof(update));
+
+    update.offset = index;
+    update.fds = reinterpret_cast<uint64_t>(&osFile);
+
+    return Register(IORING_REGISTER_FILES_UPDATE, &update, 1);
+}
+
+bool Ring::EnableNotifier() {
+    LIBPOG_ASSERT(osNotifier < 0, "Notifier can be enabled only once");
+
+    osNotifier = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (osNotifier < 0) [[unlikely]] {
+        status = static_cast<Status>(errno);
+        return false;
+    }
+
+    if (Register(IORING_REGISTER_EVENTFD, &osNotifier, 1) == false) [[unlikely]] {
+        close(osNotifier);
+        osNotifier = -1;
+        return false;
+    }
+    return true;
+}
+
+void Ring::ResetNotifier() {
+    eventfd_t counter;
+    eventfd_read(osNotifier, &counter);
+}
+
+unsigned int Ring::GetFreeEntries() const {
+    const unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    return sqEntries - (sqLocalTail - head);
+}
+
+io_uring_sqe* Ring::Acquire(const uint8_t opcode, const unsigned int file, const uint64_t key, const Flags flags) {
+    if (GetFreeEntries() == 0) [[unlikely]] return nullptr;
+
+    const unsigned int index = sqLocalTail & sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = opcode;
+    sqe->fd = static_cast<int>(file);
+    sqe->flags = IOSQE_FIXED_FILE | flags;
+    sqe->user_data = key;
+
+    sqArray[index] = index;
+    sqLocalTail++;
+    toSubmit++;
+
+    return sqe;
+}
+
+bool Ring::Read(
+    const unsigned int file, const unsigned int buffer, void* data, const unsigned int size,
+    const uint64_t offset, const uint64_t key, const Flags flags
+) {
+    io_uring_sqe* sqe = Acquire(IORING_OP_READ_FIXED, file, key, flags);
+    if (sqe == nullptr) [[unlikely]] return false;
+
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(buffer);
+    return true;
+}
+
+bool Ring::Write(
+    const unsigned int file, const unsigned int buffer, const void* data, const unsigned int size,
+    const uint64_t offset, const uint64_t key, const Flags flags
+) {
+    io_uring_sqe* sqe = Acquire(IORING_OP_WRITE_FIXED, file, key, flags);
+    if (sqe == nullptr) [[unlikely]] return false;
+
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(buffer);
+    return true;
+}
+
+bool Ring::Send(const unsigned int file, const void* data, const unsigned int size, const uint64_t key, const Flags flags) {
+    io_uring_sqe* sqe = Acquire(IORING_OP_SEND, file, key, flags);
+    if (sqe == nullptr) [[unlikely]] return false;
+
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    // Complete only when all the data is sent, so the chunk is never split between operations.
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    return true;
+}
+
+bool Ring::Receive(const unsigned int file, void* data, const unsigned int size, const uint64_t key, const Flags flags) {
+    io_uring_sqe* sqe = Acquire(IORING_OP_RECV, file, key, flags);
+    if (sqe == nullptr) [[unlikely]] return false;
+
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    return true;
+}
+
+int Ring::Submit(const unsigned int waitCompletions) {
+    if (toSubmit == 0 && waitCompletions == 0) return 0;
+
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+    const unsigned int flags = (waitCompletions > 0) ? IORING_ENTER_GETEVENTS : 0;
+    const int ret = io_uring_enter(osRing, toSubmit, waitCompletions, flags);
+    if (ret < 0) [[unlikely]] {
+        if (errno == EINTR) return 0;
+
+        status = static_cast<Status>(errno);
+        return -1;
+    }
+
+    toSubmit -= static_cast<unsigned int>(ret);
+    return ret;
+}
+
+unsigned int Ring::Reap(Completion* outCompletions, const unsigned int maxCompletions) {
+    unsigned int head = *cqHead;
+    const unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+    unsigned int count = 0;
+    for (; head != tail && count < maxCompletions; ++head, ++count) {
+        const io_uring_cqe& cqe = cqes[head & cqMask];
+
+        outCompletions[count].key = cqe.user_data;
+        outCompletions[count].result = cqe.res;
+    }
+
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return count;
+}
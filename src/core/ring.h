@@ -0,0 +1,117 @@
+#ifndef _NET_RING_H
+#define _NET_RING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include "socket.h"
+
+namespace Net {
+    /// Asynchronous I/O queues over `io_uring`. Operations are prepared in the submission
+    /// queue and passed to the os in batches by `Submit()`, their results are taken from
+    /// the completion queue by `Reap()` and identified by the user-defined key.
+    ///
+    /// Files and buffers are referenced by indices within the tables registered at the ring,
+    /// that saves the os from looking them up for every operation.
+    class Ring {
+    public:
+        struct Completion {
+            uint64_t key;
+            int32_t result; // Number of bytes transfered or negative error code.
+        };
+
+        enum Flags : uint8_t {
+            None = 0,
+            /// The next operation starts only if this one fully succeeds.
+            Link = IOSQE_IO_LINK
+        };
+
+    private:
+        int osRing = -1;
+        int osNotifier = -1;
+
+        unsigned int* sqHead = nullptr;
+        unsigned int* sqTail = nullptr;
+        unsigned int* sqArray = nullptr;
+        unsigned int sqMask = 0;
+        unsigned int sqEntries = 0;
+        io_uring_sqe* sqes = nullptr;
+
+        unsigned int* cqHead = nullptr;
+        unsigned int* cqTail = nullptr;
+        unsigned int cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        void* sqRingPtr = nullptr;
+        size_t sqRingSize = 0;
+        void* cqRingPtr = nullptr;
+        size_t cqRingSize = 0;
+        size_t sqesSize = 0;
+
+        // Prepared, but not submitted yet operations.
+        unsigned int sqLocalTail = 0;
+        unsigned int toSubmit = 0;
+
+        mutable Status status = Status::Success;
+
+        io_uring_sqe* Acquire(const uint8_t opcode, const unsigned int file, const uint64_t key, const Flags flags);
+        bool Register(const unsigned int opcode, const void* arg, const unsigned int argsNumber);
+
+    public:
+        Ring() noexcept = default;
+        Ring(const Ring&) = delete;
+
+        ~Ring() noexcept;
+
+        /// Creates the queues with at least `entries` submission entries.
+        bool Setup(const unsigned int entries);
+
+        /// Registers buffers that are referenced by index within `Read()` and `Write()`.
+        bool RegisterBuffers(const iovec* buffers, const unsigned int number);
+        /// Registers an empty table of `number` files, fill it with `SetFile()`.
+        bool RegisterFiles(const unsigned int number);
+        /// Places os descriptor into the registered files table, `-1` clears the entry.
+        bool SetFile(const unsigned int index, const int osFile);
+        /// Creates the notifier that the os signals on every completion, so the ring
+        /// can be watched by the `Poller` through `GetNotifier()`.
+        bool EnableNotifier();
+        /// Clears pending notifications, call before reaping completions.
+        void ResetNotifier();
+
+        // Operations over registered files. Each returns `false` if the submission queue is full.
+
+        bool Read(const unsigned int file, const unsigned int buffer, void* data, const unsigned int size,
+                  const uint64_t offset, const uint64_t key, const Flags flags = None);
+        bool Write(const unsigned int file, const unsigned int buffer, const void* data, const unsigned int size,
+                   const uint64_t offset, const uint64_t key, const Flags flags = None);
+        bool Send(const unsigned int file, const void* data, const unsigned int size,
+                  const uint64_t key, const Flags flags = None);
+        bool Receive(const unsigned int file, void* data, const unsigned int size,
+                     const uint64_t key, const Flags flags = None);
+
+        /// Passes prepared operations to the os and waits for at least `waitCompletions` of them.
+        /// Returns number of submitted operations, `-1` if failed.
+        int Submit(const unsigned int waitCompletions = 0);
+        /// Takes at most `maxCompletions` completed operations. Returns number of written completions.
+        unsigned int Reap(Completion* outCompletions, const unsigned int maxCompletions);
+
+        /// Returns number of operations that can be prepared before the submission.
+        unsigned int GetFreeEntries() const;
+
+        /// Returns last error/failure code and clear it.
+        inline Status Fail() const {
+            const Status temp = status;
+            status = Success;
+            return temp;
+        }
+
+        /// Returns os descriptor of the notifier, `-1` if not enabled.
+        inline int GetNotifier() const { return osNotifier; }
+        inline bool IsValid() const { return osRing >= 0; }
+    };
+}
+
+#endif
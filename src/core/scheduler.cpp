@@ -0,0 +1,62 @@
+#include "scheduler.h"
+
+namespace Net {
+    bool Scheduler::Resume(const uint64_t key) {
+        const auto it = parked.find(key);
+        if (it == parked.end()) return false;
+
+        const std::coroutine_handle<> handle = it->second.handle;
+        // The coroutine may suspend again under the same key.
+        parked.erase(it);
+
+        handle.resume();
+        return true;
+    }
+
+    Scheduler::Wait Scheduler::GetWait(const uint64_t key) const {
+        const auto it = parked.find(key);
+        return (it == parked.end()) ? Wait::None : it->second.wait;
+    }
+
+    Task<uint> AsyncConnection::Send(const void* buffer, const unsigned int size) {
+        return Retry([this, buffer, size]() { return connection.Send(buffer, size); });
+    }
+
+    Task<uint> AsyncConnection::Receive(void* buffer, const unsigned int size) {
+        return Retry([this, buffer, size]() { return connection.Receive(buffer, size); });
+    }
+
+    Task<uint> AsyncConnection::SendFile(const int osFile, const size_t offset, const unsigned int size) {
+        return Retry([this, osFile, offset, size]() { return connection.SendFile(osFile, offset, size); });
+    }
+
+    Task<uint> AsyncConnection::ReceiveFile(const int osFile, const size_t offset, const unsigned int size) {
+        return Retry([this, osFile, offset, size]() { return connection.ReceiveFile(osFile, offset, size); });
+    }
+
+    Task<uint> AsyncConnection::SendAll(const void* buffer, const unsigned int size) {
+        const char* bytes = static_cast<const char*>(buffer);
+
+        for (unsigned int sent = 0; sent < size;) {
+            const uint done = co_await Send(bytes + sent, size - sent);
+            if (done == 0) co_return 0;
+
+            sent += done;
+        }
+
+        co_return size;
+    }
+
+    Task<uint> AsyncConnection::ReceiveAll(void* buffer, const unsigned int size) {
+        char* bytes = static_cast<char*>(buffer);
+
+        for (unsigned int received = 0; received < size;) {
+            const uint done = co_await Receive(bytes + received, size - received);
+            if (done == 0) co_return 0;
+
+            received += done;
+        }
+
+        co_return size;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef _NET_SCHEDULER_H
+#define _NET_SCHEDULER_H
+
+#include <coroutine>
+#include <cstdint>
+#include <unordered_map>
+
+#include "connection.h"
+#include "task.h"
+
+namespace Net {
+    /// Resumes the coroutines suspended until their connections are ready. Each coroutine waits
+    /// under the key the event loop reports the readiness with, e.g. the poller key of its socket.
+    class Scheduler {
+    public:
+        enum class Wait : uint8_t {
+            None,
+            Readiness, // The connection would block.
+            Turn       // The coroutine yields to the others.
+        };
+
+        class Awaiter {
+            Scheduler& scheduler;
+            uint64_t key;
+            Wait wait;
+
+        public:
+            Awaiter(Scheduler& scheduler, const uint64_t key, const Wait wait) : scheduler(scheduler), key(key), wait(wait) {}
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(const std::coroutine_handle<> handle) { scheduler.parked[key] = { handle, wait }; }
+            void await_resume() const noexcept {}
+        };
+
+    private:
+        struct Parked {
+            std::coroutine_handle<> handle;
+            Wait wait = Wait::None;
+        };
+
+        std::unordered_map<uint64_t, Parked> parked;
+
+    public:
+        /// Suspends the coroutine until it is resumed on readiness of the connection of the `key`.
+        inline Awaiter Readiness(const uint64_t key) { return Awaiter(*this, key, Wait::Readiness); }
+        /// Suspends the coroutine until the next turn of the event loop.
+        inline Awaiter NextTurn(const uint64_t key) { return Awaiter(*this, key, Wait::Turn); }
+
+        /// Resumes the coroutine waiting under the `key`. Returns `false` if there is none.
+        bool Resume(const uint64_t key);
+        Wait GetWait(const uint64_t key) const;
+        /// Forgets the coroutine of the `key`, its frame is destroyed by the owning task.
+        inline void Forget(const uint64_t key) { parked.erase(key); }
+    };
+
+    /// Operations of the non-blocking connection awaited by the coroutines. The operation that would
+    /// block suspends the coroutine within the `scheduler` and is retried once the connection is ready.
+    /// Over the blocking connection the operations complete without suspending.
+    class AsyncConnection {
+        Connection& connection;
+        Scheduler& scheduler;
+        uint64_t key;
+
+        Status status = Success;
+
+        template<typename Operation>
+        Task<uint> Retry(const Operation operation) {
+            while (true) {
+                const uint done = operation();
+                if (done != 0) co_return done;
+
+                status = connection.Fail();
+                if (status != Status::WouldBlock) co_return 0;
+
+                co_await scheduler.Readiness(key);
+            }
+        }
+
+    public:
+        AsyncConnection(Connection& connection, Scheduler& scheduler, const uint64_t key)
+            : connection(connection), scheduler(scheduler), key(key) {}
+
+        /// Same as the `Connection` ones, but suspend while the connection would block.
+        /// Return `0` on failure or if the connection is closed by the remote side.
+        Task<uint> Send(const void* buffer, const unsigned int size);
+        Task<uint> Receive(void* buffer, const unsigned int size);
+        Task<uint> SendFile(const int osFile, const size_t offset, const unsigned int size);
+        Task<uint> ReceiveFile(const int osFile, const size_t offset, const unsigned int size);
+
+        /// Suspend until all the `size` bytes are moved. Return `size`, `0` on failure.
+        Task<uint> SendAll(const void* buffer, const unsigned int size);
+        Task<uint> ReceiveAll(void* buffer, const unsigned int size);
+
+        /// Suspends until the next turn, so one connection doesn't occupy the event loop.
+        inline Scheduler::Awaiter Yield() { return scheduler.NextTurn(key); }
+
+        inline Connection& GetConnection() { return connection; }
+
+        inline Status Fail() {
+            const Status temp = status;
+            status = Success;
+            return temp;
+        }
+    };
+}
+
+#endif
@@ -1,14 +1,21 @@
 #include "server.h"
 
+#include "reliable.h"
+
 using namespace Net;
 
-static bool SocketOpenAndBind(Socket& socket, const Address& address, const Net::Protocol protocol) {
+static bool SocketOpenAndBind(Socket& socket, const Address& address, const Net::Protocol protocol, const bool shared) {
     if (!socket.Open(address.GetFamily(), protocol)) {
         return false;
     }
 
     socket.SetOption<int>(Socket::Option::ReuseAddress, true);
 
+    if (shared && !socket.SetOption<int>(Socket::Option::ReusePort, true)) {
+        socket.Close();
+        return false;
+    }
+
     if (!socket.Bind(address)) {
         socket.Close();
         return false;
@@ -17,8 +24,8 @@ static bool SocketOpenAndBind(Socket& socket, const Address& address, const Net:
     return true;
 }
 
-bool TcpServer::Bind(const Address& address) {
-    return SocketOpenAndBind(socket, address, Protocol::TCP);
+bool TcpServer::Bind(const Address& address, const bool shared) {
+    return SocketOpenAndBind(socket, address, Protocol::TCP, shared);
 }
 
 Ptr<Connection> TcpServer::Listen() {
@@ -29,25 +36,37 @@ Ptr<Connection> TcpServer::Listen() {
     Socket clientSocket = socket.Accept();
     if (!clientSocket.IsValid()) return nullptr;
 
+    // The response and the small file following it are sent at once.
+    clientSocket.SetNoDelay(true);
+
     Ptr<SocketConnection> connection = std::make_unique<SocketConnection>();
     connection->socket = std::move(clientSocket);
 
     return connection;
 }
 
-bool UdpServer::Bind(const Address& address) {
-    return SocketOpenAndBind(socket, address, Protocol::UDP);
+bool UdpServer::Bind(const Address& address, const bool shared) {
+    if (!SocketOpenAndBind(socket, address, Protocol::UDP, shared)) return false;
+
+    ReliableConnection::SetupSocket(socket);
+    return true;
 }
 
 Ptr<Connection> UdpServer::Listen() {
-    Ptr<ClientConnection> clientConnection = std::make_unique<ClientConnection>();
-    char connectBuffer[sizeof(CONNECT_MAGIC)] = { 0 };
+    using Segment = ReliableConnection::Segment;
+
+    Address clientAddress;
+    Segment segment;
 
-    socket.ReceiveFrom(connectBuffer, sizeof(connectBuffer), clientConnection->clientAddress, Socket::WaitAll);
-    if (strcmp(connectBuffer, CONNECT_MAGIC) != 0) return nullptr;
+    while (true) {
+        if (socket.ReceiveFrom(reinterpret_cast<char*>(&segment), sizeof(segment), clientAddress) == 0) return nullptr;
+        // Anything but the handshake is left from the previous clients.
+        if (segment.type == ReliableConnection::SegmentType::Connect) break;
+    }
 
-    clientConnection->serverSocket = &socket;
-    if (!clientConnection->Send(ACCEPT_MAGIC, sizeof(ACCEPT_MAGIC))) return nullptr;
+    Ptr<ReliableConnection> connection = std::make_unique<ReliableConnection>(socket, clientAddress);
+    connection->Configure(transportOptions);
+    if (!connection->Accept()) return nullptr;
 
-    return clientConnection;
-}
\ No newline at end of file
+    return connection;
+}
@@ -3,6 +3,7 @@
 
 #include "socket.h"
 #include "connection.h"
+#include "reliable.h"
 
 #include <memory>
 
@@ -14,58 +15,45 @@ namespace Net {
     public:
         virtual ~Server() = default;
 
-        virtual bool Bind(const Address& address) = 0;
+        /// Binds the server to the address. Multiple `shared` servers can be bound to the same address,
+        /// then the os balances incoming connections between them.
+        virtual bool Bind(const Address& address, const bool shared = false) = 0;
         virtual Ptr<Connection> Listen() = 0;
 
         virtual Status Fail() = 0;
+
+        /// Returns the socket that signals incoming connections, used to poll for them.
+        /// `nullptr` if incoming connections can't be polled.
+        virtual Socket* GetSocket() { return nullptr; }
+
+        /// Sets up the transport of the following connections, ignored by the stream servers.
+        virtual void SetTransportOptions([[maybe_unused]] const TransportOptions& options) {}
     };
 
     class TcpServer final : public Server {
         Socket socket;
 
     public:
-        bool Bind(const Address& address) override;
+        bool Bind(const Address& address, const bool shared = false) override;
         Ptr<Connection> Listen() override;
 
         Status Fail() override { return socket.Fail(); }
+
+        Socket* GetSocket() override { return &socket; }
     };
 
+    /// Serves clients over `ReliableConnection`, all of them share the server socket.
     class UdpServer final : public Server {
-        static constexpr const char CONNECT_MAGIC[] = "connect";
-        static constexpr const char ACCEPT_MAGIC[]  = "accept_";
-        static constexpr const char CLOSE_MAGIC[]   = "disconn";
-
         Socket socket;
-
-        class ClientConnection final : public Connection {
-            Address clientAddress;
-            Socket* serverSocket = nullptr;
-
-            friend class UdpServer;
-
-        public:
-            uint Send(const void* buffer, const unsigned int size) override {
-                return serverSocket->SendTo(clientAddress, reinterpret_cast<const char*>(buffer), size);
-            }
-
-            uint Receive(void* buffer, const unsigned int size) override {
-                return serverSocket->Receive(reinterpret_cast<char*>(buffer), size);
-            }
-
-            uint ReceiveAll(void* buffer, const unsigned int size) override {
-                return serverSocket->Receive(reinterpret_cast<char*>(buffer), size, Net::Socket::WaitAll);
-            }
-
-            Status Fail() override { return serverSocket->Fail(); }
-        };
-
-        friend class UdpClient;
+        TransportOptions transportOptions;
 
     public:
-        bool Bind(const Address& address) override;
+        bool Bind(const Address& address, const bool shared = false) override;
         Ptr<Connection> Listen() override;
 
         Status Fail() override { return socket.Fail(); }
+
+        void SetTransportOptions(const TransportOptions& options) override { transportOptions = options; }
     };
 }
 
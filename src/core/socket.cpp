@@ -1,5 +1,6 @@
 #include "socket.h"
 
+#include <algorithm>
 #include <cstring>
 #include <system_error>
 
@@ -48,9 +49,12 @@ static void DeinitWSA() {
 #define OS(nt, unix) unix
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <poll.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <cstdio>
 #include <cstdlib>
@@ -58,6 +62,39 @@ static void DeinitWSA() {
 inline static int GetLastSystemError() {
     return errno;
 }
+
+/// Intermediate buffer within the os, used to move data between a socket and a file.
+class SplicePipe {
+    static constexpr int CAPACITY = 1024 * 1024;
+
+public:
+    int input = -1;
+    int output = -1;
+
+    SplicePipe() { Open(); }
+    ~SplicePipe() { Close(); }
+
+    void Open() {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) return;
+
+        output = fds[0];
+        input = fds[1];
+
+        // May be limited by the os, the default capacity is also fine.
+        fcntl(input, F_SETPIPE_SZ, CAPACITY);
+    }
+
+    void Close() {
+        if (IsValid() == false) return;
+
+        close(input);
+        close(output);
+        input = output = -1;
+    }
+
+    inline bool IsValid() const { return input >= 0; }
+};
 #endif
 
 const char* Net::GetStatusName(const Status status) {
@@ -206,6 +243,20 @@ Address Address::MakeBind(const port_t port, const Protocol protocol, const Fami
     return result;
 }
 
+bool Address::operator==(const Address& other) const {
+    if (GetFamily() != other.GetFamily() || GetPort() != other.GetPort()) return false;
+
+    switch (GetFamily()) {
+        case Family::IPv4:
+            return osAddress.ipv4.sin_addr.s_addr == other.osAddress.ipv4.sin_addr.s_addr;
+        case Family::IPv6:
+            return std::memcmp(&osAddress.ipv6.sin6_addr, &other.osAddress.ipv6.sin6_addr, sizeof(osAddress.ipv6.sin6_addr)) == 0;
+        default:
+            break;
+    }
+    return std::memcmp(&osAddress, &other.osAddress, sizeof(osAddress)) == 0;
+}
+
 std::string Address::ConvertToString() const {
     std::string result;
     const void* ret;
@@ -313,7 +364,7 @@ bool Socket::Listen() {
         "Socket can start listening from opened state only, if it's not alredy connected or listening"
     );
 
-    if (listen(osSocket, 0) < 0) {
+    if (listen(osSocket, SOMAXCONN) < 0) {
         status = static_cast<Status>(GetLastSystemError());
         Net::Error("Failed to start listening: ", std::system_category().message(static_cast<int>(status)));
         return Address::INVALID_PORT;
@@ -384,6 +435,258 @@ uint Socket::Receive(char* buffer, const uint size, const Flags flags) {
     return static_cast<uint>(ret);
 }
 
+uint Socket::SendV(const iovec* buffers, const uint count, const Flags flags) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = const_cast<iovec*>(buffers);
+    message.msg_iovlen = count;
+
+    const ssize_t ret = sendmsg(osSocket, &message, flags);
+    if (ret < 0) [[unlikely]] {
+        status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    return static_cast<uint>(ret);
+}
+
+uint Socket::ReceiveV(iovec* buffers, const uint count, const Flags flags) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = buffers;
+    message.msg_iovlen = count;
+
+    const ssize_t ret = recvmsg(osSocket, &message, flags);
+    if (ret < 0) [[unlikely]] {
+        status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    return static_cast<uint>(ret);
+}
+
+uint Socket::SendFile(const int osFile, const size_t offset, const uint size) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+
+    off_t fileOffset = static_cast<off_t>(offset);
+    const ssize_t ret = sendfile(osSocket, osFile, &fileOffset, size);
+    if (ret < 0) [[unlikely]] {
+        status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    return static_cast<uint>(ret);
+}
+
+uint Socket::ReceiveFile(const int osFile, const size_t offset, const uint size) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+
+    static thread_local SplicePipe pipe;
+    if (pipe.IsValid() == false) [[unlikely]] {
+        status = Status::Failed;
+        return 0;
+    }
+
+    const ssize_t received = splice(osSocket, nullptr, pipe.input, nullptr, size, SPLICE_F_MOVE);
+    if (received <= 0) {
+        if (received < 0) status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    loff_t fileOffset = static_cast<loff_t>(offset);
+    size_t bytesLeft = static_cast<size_t>(received);
+
+    while (bytesLeft > 0) {
+        const ssize_t written = splice(pipe.output, nullptr, osFile, &fileOffset, bytesLeft, SPLICE_F_MOVE);
+        if (written <= 0) [[unlikely]] {
+            status = (written < 0) ? static_cast<Status>(GetLastSystemError()) : Status::Failed;
+
+            // The pipe might keep a part of the data, it must be empty for the next call.
+            pipe.Close();
+            pipe.Open();
+            return 0;
+        }
+
+        bytesLeft -= static_cast<size_t>(written);
+    }
+
+    return static_cast<uint>(received);
+}
+
+/// Sends the `datagrams` by one call, each message is gathered from the consecutive datagrams
+/// of `segmentSize` bytes the os cuts it into. Each datagram is a separate message if `segmentSize` is `0`.
+/// Returns number of datagrams sent.
+static uint SendMessages(
+    const Socket::SOCKET osSocket, const sockaddr* address, const socklen_t addressSize,
+    const iovec* datagrams, const uint count, const uint segmentSize, const int flags, Status& outStatus
+) {
+    constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+
+    mmsghdr messages[Socket::MAX_BATCH_SIZE];
+    uint messageSizes[Socket::MAX_BATCH_SIZE];
+    alignas(cmsghdr) char controls[Socket::MAX_BATCH_SIZE][CONTROL_SIZE];
+
+    const uint maxSegments = (segmentSize == 0)
+        ? 1
+        : std::min(Socket::MAX_SEGMENTS, Socket::MAX_SEGMENTED_SIZE / segmentSize);
+
+    uint batchSize = 0;
+    uint index = 0;
+    while (index < count && batchSize < Socket::MAX_BATCH_SIZE) {
+        const uint first = index;
+        // The os cuts the message evenly, only the last datagram may be shorter.
+        while (index < count && index - first < maxSegments) {
+            LIBPOG_ASSERT(segmentSize == 0 || datagrams[index].iov_len <= segmentSize, "Datagram must fit the segment");
+            if (datagrams[index++].iov_len != segmentSize) break;
+        }
+
+        msghdr& header = messages[batchSize].msg_hdr;
+        std::memset(&messages[batchSize], 0, sizeof(mmsghdr));
+        header.msg_name = const_cast<sockaddr*>(address);
+        header.msg_namelen = addressSize;
+        header.msg_iov = const_cast<iovec*>(&datagrams[first]);
+        header.msg_iovlen = index - first;
+
+        if (header.msg_iovlen > 1) {
+            header.msg_control = controls[batchSize];
+            header.msg_controllen = CONTROL_SIZE;
+
+            cmsghdr* control = CMSG_FIRSTHDR(&header);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+            const uint16_t size = static_cast<uint16_t>(segmentSize);
+            std::memcpy(CMSG_DATA(control), &size, sizeof(size));
+        }
+
+        messageSizes[batchSize++] = index - first;
+    }
+
+    const int ret = sendmmsg(osSocket, messages, batchSize, flags);
+    if (ret < 0) [[unlikely]] {
+        outStatus = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    uint sent = 0;
+    for (int i = 0; i < ret; ++i) sent += messageSizes[i];
+    return sent;
+}
+
+uint Socket::SendBatch(const iovec* datagrams, const uint count, const Flags flags) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+    return SendMessages(osSocket, nullptr, 0, datagrams, count, 0, static_cast<int>(flags), status);
+}
+
+uint Socket::SendToBatch(const Address& address, const iovec* datagrams, const uint count, const Flags flags) {
+    LIBPOG_ASSERT(IsOpen(), "Socket must be open");
+    return SendMessages(
+        osSocket, &address.osAddress.any, sizeof(address.osAddress.ipv4),
+        datagrams, count, 0, static_cast<int>(flags), status
+    );
+}
+
+uint Socket::SendSegmented(const iovec* datagrams, const uint count, const uint segmentSize, const Flags flags) {
+    LIBPOG_ASSERT(IsConnected(), "Socket must be connected");
+    return SendMessages(osSocket, nullptr, 0, datagrams, count, segmentSize, static_cast<int>(flags), status);
+}
+
+uint Socket::SendToSegmented(
+    const Address& address, const iovec* datagrams, const uint count,
+    const uint segmentSize, const Flags flags
+) {
+    LIBPOG_ASSERT(IsOpen(), "Socket must be open");
+    return SendMessages(
+        osSocket, &address.osAddress.any, sizeof(address.osAddress.ipv4),
+        datagrams, count, segmentSize, static_cast<int>(flags), status
+    );
+}
+
+bool Socket::EnableReceiveCoalescing() {
+    const int enable = 1;
+    if (setsockopt(osSocket, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == SOCKET_ERROR) {
+        status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+    return true;
+}
+
+uint Socket::ReceiveBatch(iovec* datagrams, const uint count, uint* outSizes, const Flags flags, uint* outSegmentSizes) {
+    return ReceiveFromBatch(datagrams, count, outSizes, nullptr, flags, outSegmentSizes);
+}
+
+uint Socket::ReceiveFromBatch(
+    iovec* datagrams, const uint count, uint* outSizes, Address* outAddresses,
+    const Flags flags, uint* outSegmentSizes
+) {
+    LIBPOG_ASSERT(IsOpen(), "Socket must be open");
+
+    constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+
+    mmsghdr messages[MAX_BATCH_SIZE];
+    alignas(cmsghdr) char controls[MAX_BATCH_SIZE][CONTROL_SIZE];
+    const uint batchSize = std::min(count, MAX_BATCH_SIZE);
+
+    std::memset(messages, 0, sizeof(mmsghdr) * batchSize);
+    for (uint i = 0; i < batchSize; ++i) {
+        messages[i].msg_hdr.msg_iov = &datagrams[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+
+        if (outAddresses != nullptr) {
+            messages[i].msg_hdr.msg_name = &outAddresses[i].osAddress.any;
+            messages[i].msg_hdr.msg_namelen = sizeof(outAddresses[i].osAddress);
+        }
+        if (outSegmentSizes != nullptr) {
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+    }
+
+    const int ret = recvmmsg(osSocket, messages, batchSize, static_cast<int>(flags) | MSG_WAITFORONE, nullptr);
+    if (ret < 0) [[unlikely]] {
+        status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    for (int i = 0; i < ret; ++i) outSizes[i] = messages[i].msg_len;
+
+    if (outSegmentSizes != nullptr) {
+        for (int i = 0; i < ret; ++i) {
+            outSegmentSizes[i] = 0;
+
+            msghdr& header = messages[i].msg_hdr;
+            for (cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(&header, control)) {
+                if (control->cmsg_level != SOL_UDP || control->cmsg_type != UDP_GRO) continue;
+
+                int segmentSize = 0;
+                std::memcpy(&segmentSize, CMSG_DATA(control), sizeof(segmentSize));
+                outSegmentSizes[i] = static_cast<uint>(segmentSize);
+            }
+        }
+    }
+
+    return static_cast<uint>(ret);
+}
+
+bool Socket::WaitReceive(const int timeoutMs) {
+    LIBPOG_ASSERT(IsOpen(), "Socket must be open");
+
+    pollfd request = { osSocket, POLLIN, 0 };
+    const int ret = poll(&request, 1, timeoutMs);
+    if (ret < 0) [[unlikely]] {
+        // Interrupted wait is treated as a timeout.
+        if (GetLastSystemError() != EINTR) status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+
+    return ret > 0;
+}
+
 uint Socket::SendTo(const Address& address, const char* dataPtr, const uint size, const Flags flags) {
     LIBPOG_ASSERT(IsOpen(), "Socket must be open");
 
@@ -396,6 +699,25 @@ uint Socket::SendTo(const Address& address, const char* dataPtr, const uint size
     return static_cast<uint>(ret);
 }
 
+uint Socket::SendToV(const Address& address, const iovec* buffers, const uint count, const Flags flags) {
+    LIBPOG_ASSERT(IsOpen(), "Socket must be open");
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_name = const_cast<sockaddr*>(&address.osAddress.any);
+    message.msg_namelen = sizeof(address.osAddress.ipv4);
+    message.msg_iov = const_cast<iovec*>(buffers);
+    message.msg_iovlen = count;
+
+    const ssize_t ret = sendmsg(osSocket, &message, static_cast<int>(flags));
+    if (ret < 0) [[unlikely]] {
+        status = static_cast<Status>(GetLastSystemError());
+        return 0;
+    }
+
+    return static_cast<uint>(ret);
+}
+
 uint Socket::ReceiveFrom(char* bufferPtr, const uint size, Address& outRemoteAddress, const Flags flags) {
     LIBPOG_ASSERT(IsOpen(), "Socket must be open");
 
@@ -440,6 +762,50 @@ uint Socket::Send(const std::string& string) {
     return Send(string.data(), string.size());
 }
 
+bool Socket::SetBlocking(const bool isBlocking) {
+#ifdef _WIN32
+    u_long mode = isBlocking ? 0 : 1;
+    if (ioctlsocket(osSocket, FIONBIO, &mode) == SOCKET_ERROR) {
+        status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+#else
+    const int flags = fcntl(osSocket, F_GETFL, 0);
+    if (flags < 0 || fcntl(osSocket, F_SETFL, isBlocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK)) < 0) {
+        status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool Socket::SetNoDelay(const bool isNoDelay) {
+    const int value = isNoDelay ? 1 : 0;
+    if (setsockopt(osSocket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value)) == SOCKET_ERROR) {
+        status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+    return true;
+}
+
+bool Socket::GetLinkInfo(LinkInfo& outInfo) const {
+#ifdef __linux__
+    tcp_info info;
+    socklen_t size = sizeof(info);
+
+    if (getsockopt(osSocket, IPPROTO_TCP, TCP_INFO, &info, &size) == SOCKET_ERROR) {
+        status = static_cast<Status>(GetLastSystemError());
+        return false;
+    }
+
+    outInfo.rtt = info.tcpi_rtt;
+    outInfo.receiveRtt = info.tcpi_rcv_rtt;
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool Socket::SetOption(const Option option, const void* value, const uint valueSize) {
     if (setsockopt(osSocket, SOL_SOCKET, static_cast<int>(option), value, valueSize) == SOCKET_ERROR) {
         status = static_cast<Status>(GetLastSystemError());
@@ -449,7 +815,7 @@ bool Socket::SetOption(const Option option, const void* value, const uint valueS
 }
 
 bool Socket::GetOption(const Option option, void* outValue, uint& valueSize) const {
-    if (getsockopt(osSocket, SOL_SOCKET, static_cast<int>(option), &outValue, &valueSize) == SOCKET_ERROR) {
+    if (getsockopt(osSocket, SOL_SOCKET, static_cast<int>(option), outValue, &valueSize) == SOCKET_ERROR) {
         status = static_cast<Status>(GetLastSystemError());
         return false;
     }
@@ -12,6 +12,7 @@
 #else // POSIX
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #ifndef INVALID_SOCKET
@@ -135,6 +136,10 @@ namespace Net {
         }
         inline bool IsIPv4() const { return GetFamily() == Family::IPv4; }
         inline bool IsIPv6() const { return GetFamily() == Family::IPv6; }
+
+        /// Returns `true` if both addresses have the same family, IP address and port.
+        bool operator==(const Address& other) const;
+        inline bool operator!=(const Address& other) const { return !(*this == other); }
     };
 
     class Socket {
@@ -149,8 +154,11 @@ namespace Net {
             KeepAlive = SO_KEEPALIVE,
             Broadcast = SO_BROADCAST,
             ReuseAddress = SO_REUSEADDR,
+            ReusePort = SO_REUSEPORT,
             ReceiveTimeout = SO_RCVTIMEO,
-            SendTimeout = SO_SNDTIMEO
+            SendTimeout = SO_SNDTIMEO,
+            ReceiveBuffer = SO_RCVBUF,
+            SendBuffer = SO_SNDBUF
         };
         enum Flags {
             None = 0,
@@ -167,10 +175,18 @@ namespace Net {
             NoSignal = MSG_NOSIGNAL
         };
 
-    private:
+        /// Max number of datagrams moved by one batch call.
+        static constexpr uint MAX_BATCH_SIZE = 64;
+        /// Max number of datagrams the os cuts one segmented buffer into.
+        static constexpr uint MAX_SEGMENTS = 64;
+        /// Max size of one segmented buffer, leaves room for the IPv6 and UDP headers.
+        static constexpr uint MAX_SEGMENTED_SIZE = UINT16_MAX - 48;
+
 #ifndef _WIN32
         typedef int SOCKET;
 #endif
+
+    private:
         SOCKET osSocket = INVALID_SOCKET;
         State state = State::None;
 
@@ -225,7 +241,55 @@ namespace Net {
         /// use `Socket::Fail()` to determine what happend.
         uint Receive(char* bufferPtr, const uint size, const Flags flags = None);
 
+        /// Gathers data from the `buffers` and sends it to remote side at once.
+        /// On success return the number of bytes sent. Otherwise returns `0`, use `Socket::Fail()` to determine what happend.
+        uint SendV(const iovec* buffers, const uint count, const Flags flags = None);
+        /// Receives data from remote side and scatters it over the `buffers` in order.
+        /// Returns number of received bytes. `0` represents an error or no-data,
+        /// use `Socket::Fail()` to determine what happend.
+        uint ReceiveV(iovec* buffers, const uint count, const Flags flags = None);
+
+        /// Sends `size` bytes of the file starting at `offset` directly from the os file cache,
+        /// without copying them through the user space. Returns number of bytes sent, `0` on failure
+        /// or at the end of file, use `Socket::Fail()` to determine what happend.
+        uint SendFile(const int osFile, const size_t offset, const uint size);
+        /// Receives at most `size` bytes and writes them into the file at `offset` within the os,
+        /// without copying them through the user space. Returns number of bytes received, `0` on failure
+        /// or if the remote side closed the connection, use `Socket::Fail()` to determine what happend.
+        uint ReceiveFile(const int osFile, const size_t offset, const uint size);
+
+        /// Sends each of the `datagrams` as a separate datagram within one call, at most `MAX_BATCH_SIZE`.
+        /// Returns number of datagrams sent, `0` on failure, use `Socket::Fail()` to determine what happend.
+        uint SendBatch(const iovec* datagrams, const uint count, const Flags flags = None);
+        uint SendToBatch(const Address& address, const iovec* datagrams, const uint count, const Flags flags = None);
+        /// Receives at most `count` datagrams within one call, each into its own buffer of `datagrams`,
+        /// and writes their sizes to `outSizes`. Waits for the first datagram only, then takes those already queued.
+        /// Returns number of received datagrams, `0` on failure, use `Socket::Fail()` to determine what happend.
+        uint ReceiveBatch(iovec* datagrams, const uint count, uint* outSizes, const Flags flags = None, uint* outSegmentSizes = nullptr);
+        /// Same as `ReceiveBatch()`, but also writes the sender address of each datagram to `outAddresses`.
+        /// If the receive coalescing is enabled, `outSegmentSizes` gets the size of the datagrams each buffer
+        /// is coalesced from, the last of them may be shorter, `0` if the buffer holds one datagram.
+        uint ReceiveFromBatch(
+            iovec* datagrams, const uint count, uint* outSizes, Address* outAddresses,
+            const Flags flags = None, uint* outSegmentSizes = nullptr
+        );
+
+        /// Sends the `datagrams` cutting them within the os (UDP GSO): consecutive datagrams of `segmentSize` bytes
+        /// are gathered into one buffer, so the os network stack is passed once per buffer instead of once per datagram.
+        /// A datagram shorter than `segmentSize` ends its buffer, none of them may be longer.
+        /// Returns number of datagrams sent, `0` on failure, use `Socket::Fail()` to determine what happend.
+        /// Fails if the path doesn't fit datagrams of `segmentSize` bytes without fragmentation.
+        uint SendSegmented(const iovec* datagrams, const uint count, const uint segmentSize, const Flags flags = None);
+        uint SendToSegmented(
+            const Address& address, const iovec* datagrams, const uint count,
+            const uint segmentSize, const Flags flags = None
+        );
+        /// Lets the os coalesce the incoming datagrams of one sender into one buffer (UDP GRO),
+        /// the buffers given to `ReceiveFromBatch()` must fit `MAX_SEGMENTED_SIZE` bytes then.
+        bool EnableReceiveCoalescing();
+
         uint SendTo(const Address& address, const char* dataPtr, const uint size, const Flags flags = None);
+        uint SendToV(const Address& address, const iovec* buffers, const uint count, const Flags flags = None);
         uint ReceiveFrom(char* bufferPtr, const uint size, Address& outRemoteAddressm, const Flags flags = None);
         uint ReceiveFrom(char* bufferPtr, const uint size, Socket& outSocket, const Flags flags = None);
 
@@ -251,13 +315,38 @@ namespace Net {
             return Receive(&destObject);
         }
 
+        /// Waits until the socket has data to receive at most `timeoutMs` milliseconds, `-1` waits without limit.
+        /// Returns `true` if the data can be received, `false` on timeout or failure, use `Socket::Fail()` to determine what happend.
+        bool WaitReceive(const int timeoutMs);
+
+        /// Switches the socket between blocking and non-blocking mode. In non-blocking mode
+        /// operations that cannot complete immediately fail with `Status::WouldBlock`.
+        bool SetBlocking(const bool isBlocking);
+        /// Switches off the Nagle's algorithm of the stream socket, so the short write isn't held
+        /// until the previous one is acknowledged, which the peer may delay for tens of milliseconds.
+        bool SetNoDelay(const bool isNoDelay);
+
+        /// Measurements of the stream connection taken by the os.
+        struct LinkInfo {
+            /// Smoothed round-trip time in microseconds, `0` if not measured yet.
+            uint32_t rtt = 0;
+            /// Round-trip time estimated by the receiving side in microseconds, `0` if not measured yet.
+            uint32_t receiveRtt = 0;
+        };
+
+        /// Returns `false` if the os doesn't measure the connection.
+        bool GetLinkInfo(LinkInfo& outInfo) const;
+
         bool SetOption(const Option option, const void* value, const uint valueSize);
         bool GetOption(const Option option, void* value, uint& valueSize) const;
 
         template<typename T>
         bool SetOption(const Option option, const T value) { return SetOption(option, &value, sizeof(value)); }
         template<typename T>
-        bool GetOption(const Option option, T& outValue) const { return GetOption(option, &outValue, sizeof(outValue)); }
+        bool GetOption(const Option option, T& outValue) const {
+            uint valueSize = sizeof(outValue);
+            return GetOption(option, &outValue, valueSize);
+        }
 
         /// Returns last error/failure code and clear it.
         inline Status Fail() const {
@@ -268,6 +357,8 @@ namespace Net {
 
         /// Returns last error/failure code without reset.
         inline Status GetStatus() const { return status; }
+        /// Returns os-specific socket descriptor.
+        inline SOCKET GetOsSocket() const { return osSocket; }
         /// Returns socket state.
         inline State GetState() const { return state; };
         /// Returns `true` if socket descriptor is valid and ready to use.
@@ -0,0 +1,91 @@
+#ifndef _NET_TASK_H
+#define _NET_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace Net {
+    /// Lazily started coroutine producing the value of type `T`.
+    ///
+    /// The task owns its frame. It is either started by its owner with `Start()`, or awaited
+    /// by another coroutine, which is resumed once the task returns. The suspended tasks are
+    /// resumed by the `Scheduler` when the connection they wait for becomes ready.
+    template<typename T>
+    class Task {
+    public:
+        struct promise_type {
+            std::optional<T> result;
+            /// Coroutine awaiting the task, resumed when the task returns.
+            std::coroutine_handle<> continuation;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            auto final_suspend() noexcept {
+                struct FinalAwaiter {
+                    bool await_ready() noexcept { return false; }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                        const std::coroutine_handle<> continuation = handle.promise().continuation;
+                        return continuation ? continuation : std::noop_coroutine();
+                    }
+                    void await_resume() noexcept {}
+                };
+                return FinalAwaiter{};
+            }
+
+            template<typename U>
+            void return_value(U&& value) { result.emplace(std::forward<U>(value)); }
+
+            // Handlers don't throw, the failures are returned as values.
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit Task(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    public:
+        Task() = default;
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Task(const Task&) = delete;
+
+        ~Task() { Reset(); }
+
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        /// Destroys the coroutine frame along with the frames of the tasks it awaits.
+        void Reset() {
+            if (handle) handle.destroy();
+            handle = nullptr;
+        }
+
+        /// Runs the task until its first suspension.
+        inline void Start() { handle.resume(); }
+
+        inline bool IsValid() const { return static_cast<bool>(handle); }
+        inline bool IsDone() const { return handle.done(); }
+
+        /// Takes the returned value, the task must be done.
+        inline T TakeResult() { return std::move(*handle.promise().result); }
+
+        // Awaiting the task starts it, the awaiting coroutine is resumed with its result.
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return TakeResult(); }
+    };
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "checksumCache.h"
+
+#include <sys/stat.h>
+
+ChecksumCache::Version ChecksumCache::GetVersion(const File& file) {
+    struct stat status;
+    if (fstat(file.GetDescriptor(), &status) != 0) [[unlikely]] return {};
+
+    return {
+        status.st_dev,
+        status.st_ino,
+        static_cast<size_t>(status.st_size),
+        static_cast<int64_t>(status.st_mtim.tv_sec) * 1'000'000'000 + status.st_mtim.tv_nsec
+    };
+}
+
+ChecksumCache::Checksums ChecksumCache::Find(const std::filesystem::path& filePath, const Version& version) const {
+    if (version == Version {}) [[unlikely]] return nullptr;
+
+    const std::lock_guard lock(mutex);
+
+    const auto entry = entries.find(filePath.string());
+    if (entry == entries.end() || entry->second.version != version) return nullptr;
+    return entry->second.checksums;
+}
+
+ChecksumCache::Checksums ChecksumCache::Put(
+    const std::filesystem::path& filePath, const Version& version, std::vector<uint32_t> checksums
+) {
+    auto shared = std::make_shared<const std::vector<uint32_t>>(std::move(checksums));
+    if (version == Version {}) [[unlikely]] return shared;
+
+    const std::lock_guard lock(mutex);
+
+    // The changed file takes the place of its outdated entry.
+    const auto [entry, isInserted] = entries.insert_or_assign(filePath.string(), Entry { version, shared });
+    if (isInserted == false) return shared;
+
+    order.push_back(entry->first);
+    if (order.size() > MAX_FILES) {
+        entries.erase(order.front());
+        order.pop_front();
+    }
+    return shared;
+}
@@ -0,0 +1,63 @@
+#ifndef _CHECKSUM_CACHE_H
+#define _CHECKSUM_CACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <core/file.h>
+
+/// Checksums of the chunks of the hosted files, so the content sent by the os straight from the file cache
+/// isn't read back to be checksummed by each download. The checksums are taken from the download of the whole
+/// file and kept while the file has the same content, which is told by its inode, size and modification time.
+///
+/// The files aren't watched: each download looks the checksums up by the `Version` of the file it opened,
+/// so the checksums of the changed file stop matching and the next whole download replaces them. The change
+/// that keeps the size within the granularity of the modification time isn't noticed. The put checksums
+/// are immutable and shared with the downloads, the lock guards only the map for the moment of the lookup.
+class ChecksumCache {
+public:
+    using Checksums = std::shared_ptr<const std::vector<uint32_t>>;
+
+    /// Identity of the content of the file, the empty one matches no file.
+    struct Version {
+        dev_t device = 0;
+        ino_t inode = 0;
+        size_t size = 0;
+        int64_t modifyTime = 0;
+
+        bool operator==(const Version&) const = default;
+    };
+
+    /// Max number of the files kept, the earliest cached are forgotten.
+    static constexpr unsigned int MAX_FILES = 256;
+
+private:
+    struct Entry {
+        Version version;
+        Checksums checksums;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    /// Paths of the entries from the earliest cached.
+    std::deque<std::string> order;
+
+public:
+    /// Returns the empty version if the file can't be examined.
+    static Version GetVersion(const File& file);
+
+    /// Returns `nullptr` if the checksums of that version of the file aren't cached.
+    Checksums Find(const std::filesystem::path& filePath, const Version& version) const;
+    /// Returns the cached checksums.
+    Checksums Put(const std::filesystem::path& filePath, const Version& version, std::vector<uint32_t> checksums);
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "contentCache.h"
+
+#include <algorithm>
+
+void ContentCache::Trim() {
+    while (stats.size > budget) {
+        const Entry& entry = order.back();
+        stats.size -= entry.content->size();
+        entries.erase(entry.path);
+        order.pop_back();
+    }
+    stats.files = order.size();
+}
+
+ContentCache::Content ContentCache::Load(const File& file, const ChecksumCache::Version& version) {
+    std::vector<char> content(version.size);
+
+    for (size_t offset = 0; offset < content.size();) {
+        const size_t read = file.Read(content.data() + offset, content.size() - offset, offset);
+        if (read == 0) [[unlikely]] return nullptr;
+        offset += read;
+    }
+
+    // The file grown since it was examined isn't of that version anymore.
+    char extra;
+    if (file.Read(&extra, sizeof(extra), content.size()) != 0) [[unlikely]] return nullptr;
+
+    return std::make_shared<const std::vector<char>>(std::move(content));
+}
+
+ContentCache::Content ContentCache::Get(
+    const std::filesystem::path& filePath, const ChecksumCache::Version& version, const File& file
+) {
+    std::string key = filePath.string();
+    {
+        const std::lock_guard lock(mutex);
+
+        if (const auto cached = entries.find(key); cached != entries.end() && cached->second->version == version) {
+            ++stats.hits;
+            order.splice(order.begin(), order, cached->second);
+            return cached->second->content;
+        }
+
+        ++stats.misses;
+        if (version == ChecksumCache::Version {} || version.size == 0 || version.size > std::min(MAX_FILE_SIZE, budget)) {
+            return nullptr;
+        }
+    }
+
+    // The file is read without holding the others waiting.
+    Content content = Load(file, version);
+    if (!content) [[unlikely]] return nullptr;
+
+    const std::lock_guard lock(mutex);
+
+    // The entry of the outdated version or the one loaded by another thread meanwhile is replaced.
+    if (const auto cached = entries.find(key); cached != entries.end()) {
+        stats.size -= cached->second->content->size();
+        order.erase(cached->second);
+        entries.erase(cached);
+    }
+
+    order.push_front(Entry { key, version, content });
+    entries.emplace(std::move(key), order.begin());
+    stats.size += content->size();
+
+    Trim();
+    return content;
+}
+
+void ContentCache::SetBudget(const size_t size) {
+    const std::lock_guard lock(mutex);
+    budget = size;
+    Trim();
+}
+
+ContentCache::Stats ContentCache::GetStats() const {
+    const std::lock_guard lock(mutex);
+    return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef _CONTENT_CACHE_H
+#define _CONTENT_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <core/file.h>
+
+#include "checksumCache.h"
+
+/// Content of the small hosted files downloaded over and over, so they are sent straight from memory
+/// instead of being read from the file by each download. The content is immutable and shared by the
+/// transfers sending it, the entry of the changed file is replaced while the old content lives on until sent.
+/// The total size of the content is bounded, the least recently used files are forgotten first.
+/// The cache doesn't examine the files itself, the entries are matched by the `Version` the caller took
+/// from the opened file. The lock is held only for the lookup and the insertion, the missed file is read
+/// outside of it, so two misses may both read it and the later one replaces the entry. The file that grew
+/// while read isn't cached.
+class ContentCache {
+public:
+    using Content = std::shared_ptr<const std::vector<char>>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t files = 0;
+        size_t size = 0;
+    };
+
+    /// Larger files are sent from the file, they would push many of the small ones out.
+    static constexpr size_t MAX_FILE_SIZE = 1024 * 1024;
+    static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+private:
+    struct Entry {
+        std::string path;
+        ChecksumCache::Version version;
+        Content content;
+    };
+
+    mutable std::mutex mutex;
+    size_t budget = DEFAULT_BUDGET;
+    /// Entries from the most recently used.
+    std::list<Entry> order;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+    Stats stats;
+
+    /// Forgets the least recently used entries until the content fits the budget.
+    void Trim();
+    /// Reads the whole content of the file, returns `nullptr` if it isn't of the `version` size.
+    static Content Load(const File& file, const ChecksumCache::Version& version);
+
+public:
+    /// Returns the content of that version of the file, it's read from the opened `file` if it isn't cached.
+    /// Returns `nullptr` if the file isn't kept in memory, it's sent from the file then.
+    Content Get(const std::filesystem::path& filePath, const ChecksumCache::Version& version, const File& file);
+
+    /// Sets the max total size of the content kept, `0` disables the cache.
+    void SetBudget(const size_t size);
+    Stats GetStats() const;
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "directoryIndex.h"
+
+#include <condition_variable>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Any change of the directory content, the directories themselves are followed by the events of their parents.
+static constexpr uint32_t WATCHED_EVENTS =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+static DirectoryIndex::Entry MakeEntry(const struct stat& status) {
+    return {
+        static_cast<size_t>(status.st_size),
+        static_cast<int64_t>(status.st_mtim.tv_sec) * 1'000'000'000 + status.st_mtim.tv_nsec
+    };
+}
+
+static std::string JoinPath(const std::string& directory, const std::string_view name) {
+    if (directory.empty()) return std::string(name);
+
+    std::string path;
+    path.reserve(directory.size() + 1 + name.size());
+    path.append(directory).append(1, '/').append(name);
+    return path;
+}
+
+DirectoryIndex::~DirectoryIndex() {
+    if (rescanThread.joinable()) rescanThread.join();
+    if (tree.osNotify >= 0) close(tree.osNotify);
+}
+
+void DirectoryIndex::ScanDirectory(
+    const int osNotify, const std::string& directory, ScanResult& result, std::vector<std::string>& outDirectories
+) const {
+    const std::filesystem::path path = root / directory;
+
+    // The directory is watched first, so the change made while it's read isn't missed.
+    const int watch = (osNotify < 0) ? -1 : inotify_add_watch(osNotify, path.c_str(), WATCHED_EVENTS);
+    if (watch < 0) {
+        result.isWatched = false;
+    } else {
+        result.watches[watch] = directory;
+    }
+
+    DIR* osDirectory = opendir(path.c_str());
+    if (osDirectory == nullptr) return;
+
+    const int descriptor = dirfd(osDirectory);
+
+    while (const dirent* item = readdir(osDirectory)) {
+        const std::string_view name = item->d_name;
+        if (name == "." || name == "..") continue;
+
+        struct stat status;
+        bool isDirectory = (item->d_type == DT_DIR);
+
+        if (item->d_type == DT_UNKNOWN) {
+            if (fstatat(descriptor, item->d_name, &status, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            isDirectory = S_ISDIR(status.st_mode);
+        }
+
+        // The linked directories aren't followed, they may lead out of the tree or loop.
+        if (isDirectory) {
+            outDirectories.push_back(JoinPath(directory, name));
+            continue;
+        }
+
+        std::string filePath = JoinPath(directory, name);
+        if (IsHidden(filePath)) continue;
+
+        if (fstatat(descriptor, item->d_name, &status, 0) != 0 || S_ISREG(status.st_mode) == false) continue;
+        result.files.emplace_back(std::move(filePath), MakeEntry(status));
+    }
+
+    closedir(osDirectory);
+}
+
+void DirectoryIndex::Scan(Tree& tree, const std::string& directory, const unsigned int threads) const {
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::vector<std::string> pending = { directory };
+    // Number of the directories being read, they may add more to the queue.
+    unsigned int busy = 0;
+    std::vector<ScanResult> results(threads);
+
+    const auto work = [&](ScanResult& result) {
+        std::vector<std::string> found;
+        std::unique_lock lock(queueMutex);
+
+        for (;;) {
+            queueChanged.wait(lock, [&]() { return !pending.empty() || busy == 0; });
+            if (pending.empty()) return;
+
+            const std::string next = std::move(pending.back());
+            pending.pop_back();
+            ++busy;
+
+            lock.unlock();
+            ScanDirectory(tree.osNotify, next, result, found);
+            lock.lock();
+
+            --busy;
+            pending.insert(pending.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+            found.clear();
+            queueChanged.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i) workers.emplace_back(work, std::ref(results[i]));
+
+    work(results[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    for (ScanResult& result : results) {
+        for (auto& [path, entry] : result.files) tree.entries.insert_or_assign(std::move(path), entry);
+        tree.directories.merge(result.watches);
+        tree.isStale |= !result.isWatched;
+    }
+}
+
+DirectoryIndex::Tree DirectoryIndex::ScanTree() const {
+    Tree fresh;
+
+    // The fresh instance doesn't take the events of the old watches.
+    fresh.osNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    fresh.isStale = (fresh.osNotify < 0);
+
+    Scan(fresh, {}, SCAN_THREADS);
+    return fresh;
+}
+
+void DirectoryIndex::StartRescan() {
+    if (isRescanning) return;
+    isRescanning = true;
+
+    // The previous rescan has swapped its tree already.
+    if (rescanThread.joinable()) rescanThread.join();
+
+    rescanThread = std::thread([this]() {
+        Tree fresh = ScanTree();
+
+        const std::lock_guard lock(mutex);
+
+        // The old watches are dropped along with their pending events.
+        if (tree.osNotify >= 0) close(tree.osNotify);
+        tree = std::move(fresh);
+        isRescanning = false;
+    });
+}
+
+void DirectoryIndex::Forget(const std::string& directory) {
+    const std::string prefix = directory + '/';
+
+    tree.entries.erase(directory);
+    for (auto entry = tree.entries.lower_bound(prefix); entry != tree.entries.end() && entry->first.starts_with(prefix);) {
+        entry = tree.entries.erase(entry);
+    }
+
+    std::erase_if(tree.directories, [&](const auto& watch) {
+        if (watch.second != directory && watch.second.starts_with(prefix) == false) return false;
+
+        inotify_rm_watch(tree.osNotify, watch.first);
+        return true;
+    });
+}
+
+bool DirectoryIndex::IsHidden(const std::string& path) const {
+    for (const std::string_view suffix : HIDDEN_SUFFIXES) {
+        if (path.ends_with(suffix)) return true;
+    }
+    return hiddenPaths.contains(path);
+}
+
+void DirectoryIndex::Update(const std::string& path) {
+    if (IsHidden(path)) return;
+
+    struct stat status;
+
+    if (stat((root / path).c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+        tree.entries.insert_or_assign(path, MakeEntry(status));
+    } else {
+        tree.entries.erase(path);
+    }
+}
+
+void DirectoryIndex::TakeEvents() {
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    for (;;) {
+        const ssize_t size = read(tree.osNotify, buffer, sizeof(buffer));
+        if (size <= 0) return;
+
+        for (ssize_t offset = 0; offset < size;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            // The lost events may concern any file.
+            if (event->mask & IN_Q_OVERFLOW) {
+                tree.isStale = true;
+                return;
+            }
+            if (event->mask & IN_IGNORED) {
+                tree.directories.erase(event->wd);
+                continue;
+            }
+
+            const auto directory = tree.directories.find(event->wd);
+            if (directory == tree.directories.end() || event->len == 0) continue;
+
+            const std::string path = JoinPath(directory->second, event->name);
+
+            // The moved directory is forgotten at the old place and scanned at the new one.
+            if (event->mask & IN_ISDIR) {
+                Forget(path);
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) Scan(tree, path, 1);
+            } else {
+                Update(path);
+            }
+        }
+    }
+}
+
+bool DirectoryIndex::Open(const std::filesystem::path& directory, const std::vector<std::filesystem::path>& hiddenFiles) {
+    if (rescanThread.joinable()) rescanThread.join();
+
+    const std::lock_guard lock(mutex);
+
+    root = directory;
+    hiddenPaths.clear();
+
+    std::error_code error;
+    const std::filesystem::path canonicalRoot = std::filesystem::weakly_canonical(root, error);
+
+    for (const std::filesystem::path& file : hiddenFiles) {
+        const std::filesystem::path path = std::filesystem::weakly_canonical(file, error).lexically_relative(canonicalRoot);
+        // The files outside of the tree aren't listed anyway.
+        if (!error && !path.empty() && *path.begin() != "..") hiddenPaths.insert(path.string());
+    }
+
+    // The first scan is complete before the servers start.
+    if (tree.osNotify >= 0) close(tree.osNotify);
+    tree = ScanTree();
+    return !tree.isStale;
+}
+
+bool DirectoryIndex::List(
+    const std::string_view prefix, const std::string_view after, const unsigned int maxCount,
+    std::vector<Item>& outItems
+) {
+    outItems.clear();
+
+    const std::lock_guard lock(mutex);
+
+    if (tree.osNotify >= 0) TakeEvents();
+    // The listing doesn't wait for the scan, it takes the files known so far.
+    if (tree.isStale) StartRescan();
+
+    auto entry = (after < prefix) ? tree.entries.lower_bound(prefix) : tree.entries.upper_bound(after);
+
+    for (; entry != tree.entries.end() && entry->first.starts_with(prefix); ++entry) {
+        if (outItems.size() == maxCount) return false;
+        outItems.push_back({ entry->first, entry->second });
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef _DIRECTORY_INDEX_H
+#define _DIRECTORY_INDEX_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/// Regular files of the directory tree with their sizes and modification times, ordered by their paths
+/// relative to the root, so the clients list the hosted files by pages without walking the storage.
+///
+/// The tree is scanned once by several threads, then each of its directories is watched by inotify.
+/// The pending events are taken before each listing and only the files they are about are examined again,
+/// the new directories are scanned and the removed ones are forgotten along with their files. The tree is
+/// scanned again if the events are lost or some of its directories can't be watched. That scan runs
+/// by its own thread, the listings take the files known before it until it's complete. Symbolic links
+/// to the files are listed by their targets, but the changes of the targets aren't watched.
+/// One lock covers the events, the listings and the swap of the rescanned tree, the listing takes the
+/// pending events first, so it sees the changes made before it unless the tree is being scanned again.
+class DirectoryIndex {
+public:
+    struct Entry {
+        size_t size = 0;
+        /// Nanoseconds since epoch.
+        int64_t modifyTime = 0;
+    };
+
+    struct Item {
+        std::string path;
+        Entry entry;
+    };
+
+    /// Number of threads scanning the tree, the examined files of the cold storage are waited for in parallel.
+    static constexpr unsigned int SCAN_THREADS = 8;
+    /// Files the server keeps next to the hosted ones aren't listed: the parts of the interrupted uploads,
+    /// the files rebuilt from the deltas and the compacted journals.
+    static constexpr std::string_view HIDDEN_SUFFIXES[] = { ".part", ".delta", ".compact" };
+
+private:
+    /// Files of the tree along with the watches that keep them up to date.
+    struct Tree {
+        int osNotify = -1;
+        /// Paths of the watched directories by the watch descriptors, the root one is empty.
+        std::unordered_map<int, std::string> directories;
+        std::map<std::string, Entry, std::less<>> entries;
+        /// Some of the changes aren't watched, the tree must be scanned again.
+        bool isStale = false;
+    };
+
+    /// Files and directories found by one of the scanning threads.
+    struct ScanResult {
+        std::vector<std::pair<std::string, Entry>> files;
+        std::unordered_map<int, std::string> watches;
+        bool isWatched = true;
+    };
+
+    std::mutex mutex;
+    std::filesystem::path root;
+    /// Paths of the other files of the server within the tree, relative to the root.
+    std::unordered_set<std::string> hiddenPaths;
+    Tree tree;
+
+    /// Scans the whole tree again, the fresh tree replaces the listed one once it's complete.
+    std::thread rescanThread;
+    bool isRescanning = false;
+
+    /// Scans the `directory` within the root and all of its subdirectories into the `tree`
+    /// by at most `threads` threads.
+    void Scan(Tree& tree, const std::string& directory, const unsigned int threads) const;
+    /// Scans the whole tree from the fresh watches.
+    Tree ScanTree() const;
+    /// Starts scanning the tree by the rescan thread, unless it's scanned already.
+    void StartRescan();
+    /// Reads the entries of the `directory` after it's watched, its subdirectories are put into `outDirectories`.
+    void ScanDirectory(
+        const int osNotify, const std::string& directory, ScanResult& result, std::vector<std::string>& outDirectories
+    ) const;
+    /// Forgets the `directory` with all of its files and the watches of its subdirectories.
+    void Forget(const std::string& directory);
+    /// Examines the file again after its change.
+    void Update(const std::string& path);
+    /// Applies the pending events.
+    void TakeEvents();
+    bool IsHidden(const std::string& path) const;
+
+public:
+    DirectoryIndex() = default;
+    DirectoryIndex(const DirectoryIndex&) = delete;
+    ~DirectoryIndex();
+
+    /// Indexes the tree of the `directory` without the `hiddenFiles`. Returns `false` if its changes
+    /// can't be watched, then the tree is scanned again after each listing.
+    bool Open(const std::filesystem::path& directory, const std::vector<std::filesystem::path>& hiddenFiles = {});
+    /// Takes at most `maxCount` files whose paths start with the `prefix` and follow the `after` one in order.
+    /// Returns `true` if no more of such files follow.
+    bool List(
+        const std::string_view prefix, const std::string_view after, const unsigned int maxCount,
+        std::vector<Item>& outItems
+    );
+};
+
+#endif
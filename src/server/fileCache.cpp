@@ -0,0 +1,122 @@
+#include "fileCache.h"
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Any change of the directory content that may make its entries outdated.
+static constexpr uint32_t WATCHED_EVENTS =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+    IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::FileCache() {
+    // Without inotify every lookup goes past the cache.
+    osNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileCache::~FileCache() {
+    if (osNotify >= 0) close(osNotify);
+}
+
+void FileCache::TakeEvents() {
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    for (;;) {
+        const ssize_t size = read(osNotify, buffer, sizeof(buffer));
+        if (size <= 0) return;
+
+        for (ssize_t offset = 0; offset < size;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_IGNORED) {
+                const auto paths = directories.find(event->wd);
+                if (paths != directories.end()) {
+                    for (const std::filesystem::path& path : paths->second) watches.erase(path.string());
+                    directories.erase(paths);
+                }
+            }
+
+            // The lost events and the changes of the directories themselves may concern any entry.
+            if (event->mask & (IN_Q_OVERFLOW | IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+                entries.clear();
+                order.clear();
+                continue;
+            }
+
+            const auto paths = directories.find(event->wd);
+            if (paths == directories.end() || event->len == 0) continue;
+
+            for (const std::filesystem::path& path : paths->second) entries.erase((path / event->name).string());
+        }
+    }
+}
+
+bool FileCache::Watch(const std::filesystem::path& directory) {
+    if (watches.contains(directory.string())) return true;
+
+    const int watch = inotify_add_watch(osNotify, directory.empty() ? "." : directory.c_str(), WATCHED_EVENTS | IN_ONLYDIR);
+    if (watch < 0) return false;
+
+    directories[watch].push_back(directory);
+    watches[directory.string()] = watch;
+    return true;
+}
+
+FileCache::Kind FileCache::Lookup(const std::filesystem::path& filePath, File& outFile, ChecksumCache::Version& outVersion) {
+    outVersion = {};
+
+    struct stat status;
+    if (stat(filePath.c_str(), &status) != 0) return Kind::Missing;
+    if (S_ISREG(status.st_mode) == false) return Kind::NotFile;
+
+    if (outFile.Open(filePath, File::Mode::Read) == false) [[unlikely]] return Kind::Unreadable;
+
+    // The opened file is examined once more, it might be replaced since.
+    outVersion = ChecksumCache::GetVersion(outFile);
+    return Kind::Regular;
+}
+
+FileCache::Kind FileCache::Open(const std::filesystem::path& filePath, File& outFile, ChecksumCache::Version& outVersion) {
+    const std::filesystem::path fileName = filePath.filename();
+    // The path that doesn't end by the name of the file can't be matched to the events.
+    const bool isCacheable = !fileName.empty() && fileName != "." && fileName != "..";
+
+    if (osNotify < 0 || isCacheable == false) [[unlikely]] return Lookup(filePath, outFile, outVersion);
+
+    const std::lock_guard lock(mutex);
+    TakeEvents();
+
+    const std::string key = filePath.string();
+
+    if (const auto cached = entries.find(key); cached != entries.end()) {
+        const Entry& entry = cached->second;
+        outVersion = entry.version;
+
+        if (entry.kind != Kind::Regular) return entry.kind;
+        return outFile.Duplicate(entry.file) ? Kind::Regular : Kind::Unreadable;
+    }
+
+    // The directory is watched first, so the change made while the file is examined isn't missed.
+    const bool isWatched = Watch(filePath.parent_path());
+
+    struct stat linkStatus;
+    const bool isLink = (lstat(filePath.c_str(), &linkStatus) == 0) && S_ISLNK(linkStatus.st_mode);
+
+    const Kind kind = Lookup(filePath, outFile, outVersion);
+    if (isWatched == false || isLink || kind == Kind::Unreadable) return kind;
+
+    Entry entry;
+    entry.kind = kind;
+    entry.version = outVersion;
+    if (kind == Kind::Regular && entry.file.Duplicate(outFile) == false) [[unlikely]] return kind;
+
+    if (entries.insert_or_assign(key, std::move(entry)).second) order.push_back(key);
+
+    // The entries forgotten by the events leave their paths in the order, so it's bounded instead of the entries.
+    while (order.size() > MAX_ENTRIES) {
+        entries.erase(order.front());
+        order.pop_front();
+    }
+    return kind;
+}
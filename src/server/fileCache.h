@@ -0,0 +1,70 @@
+#ifndef _FILE_CACHE_H
+#define _FILE_CACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <core/file.h>
+
+#include "checksumCache.h"
+
+/// Metadata and open descriptors of the downloaded files, so the repeated requests of the same file
+/// don't walk its path and open it again. The missing files are remembered as well.
+///
+/// The directories of the cached files are watched by inotify, the entry is forgotten once its file
+/// is created, changed, replaced or removed. The pending events are taken before each lookup,
+/// so the change made before the request is always seen. Symbolic links aren't cached, as the changes
+/// of their targets aren't watched. The events, the lookup and the opening of the missed file are done under
+/// one lock, so the file isn't opened twice, and each caller gets its own duplicate of the cached descriptor.
+/// The `Version` taken when the file is opened is what the checksum and content caches check their entries by.
+class FileCache {
+public:
+    enum class Kind : uint8_t {
+        Missing,
+        NotFile,
+        /// Regular file that can't be opened.
+        Unreadable,
+        Regular
+    };
+
+    /// Max number of the entries kept, the earliest cached are forgotten.
+    static constexpr unsigned int MAX_ENTRIES = 4096;
+
+private:
+    struct Entry {
+        Kind kind = Kind::Missing;
+        ChecksumCache::Version version;
+        File file;
+    };
+
+    std::mutex mutex;
+    int osNotify = -1;
+    /// Paths of the watched directories by the watch descriptors, the same directory may be reached by several paths.
+    std::unordered_map<int, std::vector<std::filesystem::path>> directories;
+    std::unordered_map<std::string, int> watches;
+    std::unordered_map<std::string, Entry> entries;
+    /// Paths of the entries from the earliest cached.
+    std::deque<std::string> order;
+
+    /// Forgets the entries of the files the pending events are about.
+    void TakeEvents();
+    /// Returns `false` if the changes of the directory can't be watched.
+    bool Watch(const std::filesystem::path& directory);
+    /// Examines and opens the file past the cache.
+    static Kind Lookup(const std::filesystem::path& filePath, File& outFile, ChecksumCache::Version& outVersion);
+
+public:
+    FileCache();
+    FileCache(const FileCache&) = delete;
+    ~FileCache();
+
+    /// Opens the file for reading if it's regular, its `outVersion` tells its size.
+    Kind Open(const std::filesystem::path& filePath, File& outFile, ChecksumCache::Version& outVersion);
+};
+
+#endif
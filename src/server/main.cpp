@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
+#include <thread>
+#include <vector>
 
 #include <core/args.h>
 #include <core/message.h>
@@ -11,6 +14,13 @@ struct ServerConfig {
     Net::Address::port_t port = Msg::DEFAULT_SERVER_PORT;
     Net::Protocol protocol = Net::Protocol::TCP;
     const char* hostFilesDirectory = Server::DEFAULT_FILES_DIR;
+    const char* journalPath = Server::DEFAULT_JOURNAL_PATH;
+    unsigned int threads = 1;
+    /// Max total size of the small files kept in memory, in mebibytes.
+    unsigned int cacheSize = ContentCache::DEFAULT_BUDGET / (1024 * 1024);
+    bool cacheStats = false;
+    bool useRing = false;
+    Net::TransportOptions transport;
 };
 
 static void PrintHelp() {
@@ -20,7 +30,15 @@ static void PrintHelp() {
         "  -p\n"
         "  -dir <path>\tSpecify directory to host.\n"
         "  -d\n"
+        "  -journal <path>\tFile keeping the interrupted transfers to resume them after restart.\n"
+        "  -cache <mebibytes>\tMemory kept for the content of the small files downloaded often, 0 disables it.\n"
+        "  -cache-stats\tPrint the hits and misses of the content cache as the clients disconnect.\n"
         "  -udp\tStart server over UDP protocol.\n"
+        "  -uring\tTransfer files over io_uring.\n"
+        "  -threads <number>\tNumber of worker threads, each serves its own share of clients.\n"
+        "  -t\n"
+        "  -cc <aimd|bbr>\tCongestion control of the UDP transport.\n"
+        "  -loss <percent>\tDrop this share of the outgoing UDP datagrams to emulate a lossy link.\n"
         "  -help\tShow this help.\n"
         "  -h\n";
     ;
@@ -51,7 +69,53 @@ static bool ParseServerArgs(int argc, const char** argv, ServerConfig& outConfig
                     "Expected host directory: -dir, d <directory path>.",
                     outConfig.hostFilesDirectory
                 );
-            } if (value == "udp") {
+            } else if (value == "journal") {
+                result &= RequireArgParameter<const char*>(
+                    argIter,
+                    "Expected journal path: -journal <file path>.",
+                    outConfig.journalPath
+                );
+            } else if (value == "threads" || value == "t") {
+                result &= RequireArgParameter<unsigned int>(
+                    argIter,
+                    "Expected number of threads: -threads, t <number>.",
+                    outConfig.threads
+                );
+            } else if (value == "cache") {
+                result &= RequireArgParameter<unsigned int>(
+                    argIter,
+                    "Expected cache size: -cache <mebibytes>.",
+                    outConfig.cacheSize
+                );
+            } else if (value == "cc") {
+                const char* algorithm = "";
+                result &= RequireArgParameter<const char*>(
+                    argIter,
+                    "Expected congestion control: -cc <aimd|bbr>.",
+                    algorithm
+                );
+
+                if (std::string_view(algorithm) == "aimd") {
+                    outConfig.transport.congestion = Net::CongestionAlgorithm::Aimd;
+                } else if (std::string_view(algorithm) == "bbr") {
+                    outConfig.transport.congestion = Net::CongestionAlgorithm::Bbr;
+                } else {
+                    std::cerr << "Unknown congestion control: \"" << algorithm << "\".\n";
+                    result = false;
+                }
+            } else if (value == "loss") {
+                unsigned int percent = 0;
+                result &= RequireArgParameter<unsigned int>(
+                    argIter,
+                    "Expected share of lost datagrams: -loss <percent>.",
+                    percent
+                );
+                outConfig.transport.lossRate = std::min(percent, 100u) / 100.0f;
+            } else if (value == "cache-stats") {
+                outConfig.cacheStats = true;
+            } else if (value == "uring") {
+                outConfig.useRing = true;
+            } else if (value == "udp") {
                 outConfig.protocol = Net::Protocol::UDP;
             } else if (value == "help" || value == "h") {
                 printHelp = true;
@@ -63,6 +127,11 @@ static bool ParseServerArgs(int argc, const char** argv, ServerConfig& outConfig
 
     if (printHelp) PrintHelp();
 
+    if (outConfig.threads == 0) [[unlikely]] {
+        std::cerr << "Number of threads must be positive.\n";
+        result = false;
+    }
+
     return result;
 }
 
@@ -91,27 +160,51 @@ int main(int argc, const char** argv) {
         return EXIT_FAILURE;
     }
 
-    Server server(config.protocol, config.port);
-    server.SetHostDirectory(config.hostFilesDirectory);
+    if (Server::IndexHostDirectory(config.hostFilesDirectory, config.journalPath) == false) [[unlikely]] {
+        std::cerr << "Cannot watch host directory, it's scanned again for each list request.\n";
+    }
 
-    if (Net::Status fail = server.Fail()) [[unlikely]] {
-        std::cerr << "Failed to startup server: " << Net::GetStatusName(fail) << ".\n";
-        return EXIT_FAILURE;
+    if (Server::OpenRecoveryJournal(config.journalPath) == false) [[unlikely]] {
+        std::cerr << "Cannot write recovery journal " << config.journalPath << ", interrupted transfers are kept until exit.\n";
     }
 
-    std::cout << "Server listening at port: " << config.port << ".\n";
+    Server::SetContentBudget(static_cast<size_t>(config.cacheSize) * 1024 * 1024);
+    Server::ReportCacheStats(config.cacheStats);
+
+    // Each worker owns a server bound to the same port, the os spreads clients between them.
+    const bool shared = config.threads > 1;
+    std::vector<Server> servers;
+    servers.reserve(config.threads);
+
+    for (unsigned int i = 0; i < config.threads; ++i) {
+        Server& server = servers.emplace_back(config.protocol, config.port, shared);
+        server.SetHostDirectory(config.hostFilesDirectory);
+        server.SetTransportOptions(config.transport);
+
+        if (Net::Status fail = server.Fail()) [[unlikely]] {
+            std::cerr << "Failed to startup server: " << Net::GetStatusName(fail) << ".\n";
+            return EXIT_FAILURE;
+        }
 
-    while (true) {
-        const int clientIndex = server.Listen();
-        if (clientIndex == Server::INVALID_CLIENT_INDEX) {
-            std::cout << "Listen failed: " << Net::GetStatusName(server.Fail()) << ".\n";
-            continue;
+        if (config.useRing && server.EnableRing() == false) [[unlikely]] {
+            std::cerr << "io_uring is not available, transfer files within the event loop.\n";
+            config.useRing = false;
         }
+    }
 
-        while (server.Handle(clientIndex) != false);
+    std::cout << "Server listening at port: " << config.port << ".\n";
+    if (config.protocol == Net::Protocol::UDP) {
+        std::cout << "Congestion control: " << Net::GetCongestionAlgorithmName(config.transport.congestion) << ".\n";
+    }
 
-        std::cout << "Client disconnected.\n";
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < config.threads; ++i) {
+        workers.emplace_back(&Server::Run, &servers[i]);
     }
 
+    servers[0].Run();
+
+    for (auto& worker : workers) worker.join();
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "recoveryJournal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <core/hash.h>
+
+/// Fixed part of the record, the file path follows it.
+struct RecordPayload {
+    uint8_t type;
+    uint8_t kind;
+    std::array<uint8_t, 6> client;
+    uint64_t fileSize;
+    uint64_t hash;
+    uint64_t position;
+    int64_t time;
+    uint32_t pathSize;
+};
+
+static constexpr size_t MAX_RECORD_SIZE = sizeof(RecordPayload) + 64 * 1024;
+
+static inline int64_t GetTime() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static inline uint32_t GetChecksum(const char* data, const size_t size) {
+    return static_cast<uint32_t>(Hash::Xxh64(data, size));
+}
+
+void RecoveryJournal::Encode(std::vector<char>& output, const RecordType type, const Net::MacAddress& client, const Stamp& stamp) {
+    const std::string filePath = stamp.filePath.string();
+
+    RecordPayload payload {};
+    payload.type = static_cast<uint8_t>(type);
+    payload.kind = static_cast<uint8_t>(stamp.kind);
+    payload.client = client.bytes;
+    payload.fileSize = stamp.fileSize;
+    payload.hash = stamp.hash;
+    payload.position = stamp.position;
+    payload.time = stamp.time;
+    payload.pathSize = static_cast<uint32_t>(filePath.size());
+
+    const size_t offset = output.size();
+    output.resize(offset + sizeof(RecordHeader) + sizeof(payload) + filePath.size());
+
+    char* data = output.data() + offset + sizeof(RecordHeader);
+    std::memcpy(data, &payload, sizeof(payload));
+    std::memcpy(data + sizeof(payload), filePath.data(), filePath.size());
+
+    const size_t size = sizeof(payload) + filePath.size();
+    const RecordHeader header = { static_cast<uint32_t>(size), GetChecksum(data, size) };
+    std::memcpy(output.data() + offset, &header, sizeof(header));
+}
+
+bool RecoveryJournal::Open(const std::filesystem::path& journalPath) {
+    const std::lock_guard lock(mutex);
+
+    // The servers sharing the port open the same journal.
+    if (file.IsOpen()) return path == journalPath;
+
+    path = journalPath;
+    stamps.clear();
+    stampsCount = 0;
+
+    std::error_code error;
+    const size_t size = std::filesystem::file_size(path, error);
+
+    File input;
+    std::vector<char> data;
+    if (!error && input.Open(path, File::Mode::Read)) {
+        data.resize(size);
+        data.resize(input.Read(data.data(), size, 0));
+    }
+
+    // The replay stops at the first broken record, it's the one torn by the crash.
+    isReplaying = true;
+    for (size_t offset = 0; data.size() - offset >= sizeof(RecordHeader);) {
+        RecordHeader header;
+        std::memcpy(&header, data.data() + offset, sizeof(header));
+
+        const char* record = data.data() + offset + sizeof(header);
+        if (header.size < sizeof(RecordPayload) || header.size > MAX_RECORD_SIZE) break;
+        if (data.size() - offset - sizeof(header) < header.size) break;
+        if (GetChecksum(record, header.size) != header.checksum) break;
+
+        RecordPayload payload;
+        std::memcpy(&payload, record, sizeof(payload));
+        if (payload.pathSize != header.size - sizeof(payload)) break;
+        if (payload.type < static_cast<uint8_t>(RecordType::Put) || payload.type > static_cast<uint8_t>(RecordType::Remove)) break;
+        if (payload.kind > static_cast<uint8_t>(Kind::Upload)) break;
+
+        Net::MacAddress client;
+        client.bytes = payload.client;
+
+        Stamp stamp;
+        stamp.kind = static_cast<Kind>(payload.kind);
+        stamp.filePath = std::string(record + sizeof(payload), payload.pathSize);
+        stamp.fileSize = payload.fileSize;
+        stamp.hash = payload.hash;
+        stamp.position = payload.position;
+        stamp.time = payload.time;
+
+        Apply(static_cast<RecordType>(payload.type), client, std::move(stamp));
+        offset += sizeof(header) + header.size;
+    }
+    isReplaying = false;
+
+    // Clients that didn't come back for a long time are not expected anymore.
+    const int64_t minTime = GetTime() - std::chrono::duration_cast<std::chrono::seconds>(MAX_STAMP_AGE).count();
+    std::vector<Stamp> expired;
+
+    for (auto it = stamps.begin(); it != stamps.end();) {
+        stampsCount -= std::erase_if(it->second, [&](const Stamp& stamp) {
+            if (stamp.time >= minTime) return false;
+
+            expired.push_back(stamp);
+            return true;
+        });
+        it = it->second.empty() ? stamps.erase(it) : std::next(it);
+    }
+
+    for (const Stamp& stamp : expired) Discard(stamp);
+
+    // The journal starts over from the live stamps.
+    return Compact();
+}
+
+void RecoveryJournal::Apply(const RecordType type, const Net::MacAddress& client, Stamp&& stamp) {
+    std::vector<Stamp>& clientStamps = stamps[client];
+
+    const auto same = std::find_if(clientStamps.begin(), clientStamps.end(), [&stamp](const Stamp& other) {
+        return other.kind == stamp.kind && other.filePath == stamp.filePath;
+    });
+    if (same != clientStamps.end()) {
+        clientStamps.erase(same);
+        --stampsCount;
+    }
+
+    if (type == RecordType::Put) {
+        if (clientStamps.size() >= MAX_CLIENT_STAMPS) [[unlikely]] {
+            const Stamp oldest = std::move(clientStamps.front());
+            clientStamps.erase(clientStamps.begin());
+            --stampsCount;
+
+            if (isReplaying == false) Discard(oldest);
+        }
+
+        clientStamps.push_back(std::move(stamp));
+        ++stampsCount;
+    }
+
+    if (clientStamps.empty()) stamps.erase(client);
+}
+
+void RecoveryJournal::Discard(const Stamp& stamp) const {
+    if (stamp.kind != Kind::Upload) return;
+
+    for (const auto& [client, clientStamps] : stamps) {
+        for (const Stamp& other : clientStamps) {
+            if (other.kind == Kind::Upload && other.filePath == stamp.filePath) return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove(GetPartPath(stamp.filePath), error);
+}
+
+void RecoveryJournal::Append(const RecordType type, const Net::MacAddress& client, const Stamp& stamp) {
+    if (file.IsOpen() == false) return;
+
+    std::vector<char> record;
+    Encode(record, type, client, stamp);
+
+    // The record torn by the failed write is overwritten by the next one.
+    if (file.Write(record.data(), record.size(), fileSize) != record.size() || file.Sync() == false) [[unlikely]] {
+        std::cerr << "Failed to write recovery journal " << path << ".\n";
+        return;
+    }
+
+    fileSize += record.size();
+    ++recordsCount;
+
+    if (recordsCount >= MIN_COMPACTED_RECORDS && recordsCount > stampsCount * 2) Compact();
+}
+
+bool RecoveryJournal::Compact() {
+    std::vector<char> data;
+    size_t records = 0;
+
+    for (const auto& [client, clientStamps] : stamps) {
+        for (const Stamp& stamp : clientStamps) {
+            Encode(data, RecordType::Put, client, stamp);
+            ++records;
+        }
+    }
+
+    // The new journal is complete on the storage before it replaces the old one.
+    const std::filesystem::path compactedPath = path.string() + ".compact";
+    File compacted;
+    std::error_code error;
+
+    if (
+        !compacted.Open(compactedPath, File::Mode::Write) ||
+        compacted.Write(data.data(), data.size(), 0) != data.size() ||
+        !compacted.Sync()
+    ) [[unlikely]] {
+        compacted.Close();
+        std::filesystem::remove(compactedPath, error);
+        return false;
+    }
+
+    std::filesystem::rename(compactedPath, path, error);
+    if (error) [[unlikely]] {
+        compacted.Close();
+        std::filesystem::remove(compactedPath, error);
+        return false;
+    }
+
+    // The rename itself is durable once the directory is synced.
+    File directory;
+    if (directory.Open(path.has_parent_path() ? path.parent_path() : ".", File::Mode::Read)) directory.Sync();
+
+    file = std::move(compacted);
+    fileSize = data.size();
+    recordsCount = records;
+    return true;
+}
+
+void RecoveryJournal::Put(const Net::MacAddress& client, Stamp&& stamp) {
+    const std::lock_guard lock(mutex);
+
+    stamp.time = GetTime();
+
+    // Applied first, so the compaction after the record takes the stamp as well.
+    Apply(RecordType::Put, client, Stamp(stamp));
+    Append(RecordType::Put, client, stamp);
+}
+
+bool RecoveryJournal::Remove(const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath) {
+    return Take(client, kind, filePath).has_value();
+}
+
+const RecoveryJournal::Stamp* RecoveryJournal::Lookup(
+    const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath
+) const {
+    const auto clientStamps = stamps.find(client);
+    if (clientStamps == stamps.end()) return nullptr;
+
+    for (const Stamp& stamp : clientStamps->second) {
+        if (stamp.kind == kind && stamp.filePath == filePath) return &stamp;
+    }
+    return nullptr;
+}
+
+std::optional<RecoveryJournal::Stamp> RecoveryJournal::Find(
+    const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath
+) const {
+    const std::lock_guard lock(mutex);
+
+    const Stamp* stamp = Lookup(client, kind, filePath);
+    return stamp ? std::optional<Stamp>(*stamp) : std::nullopt;
+}
+
+std::optional<RecoveryJournal::Stamp> RecoveryJournal::Take(
+    const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath
+) {
+    const std::lock_guard lock(mutex);
+
+    const Stamp* found = Lookup(client, kind, filePath);
+    if (found == nullptr) return std::nullopt;
+
+    Stamp stamp = *found;
+    Apply(RecordType::Remove, client, Stamp(stamp));
+    Append(RecordType::Remove, client, stamp);
+    return stamp;
+}
+
+std::vector<RecoveryJournal::Stamp> RecoveryJournal::TakeAll(const Net::MacAddress& client, const Kind kind) {
+    const std::lock_guard lock(mutex);
+
+    std::vector<Stamp> found;
+
+    const auto clientStamps = stamps.find(client);
+    if (clientStamps == stamps.end()) return found;
+
+    for (const Stamp& stamp : clientStamps->second) {
+        if (stamp.kind == kind) found.push_back(stamp);
+    }
+    // The client's stamps may be erased along with the last of them.
+    for (const Stamp& stamp : found) {
+        Apply(RecordType::Remove, client, Stamp(stamp));
+        Append(RecordType::Remove, client, stamp);
+    }
+    return found;
+}
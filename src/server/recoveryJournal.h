@@ -0,0 +1,109 @@
+#ifndef _RECOVERY_JOURNAL_H
+#define _RECOVERY_JOURNAL_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <core/file.h>
+#include <core/net.h>
+
+/// Stamps of the interrupted transfers kept for the clients to resume them, any number of them per client.
+///
+/// The stamps live in memory and each change is appended to the journal file as a checksummed record,
+/// which is synced before the change is used. The journal is replayed when opened, so the stamps survive
+/// restarts, and the torn record left by the crash ends the replay. Once most of the records are outdated,
+/// the live stamps are rewritten into the new journal that replaces the old one.
+/// Each change is applied and synced under one lock before the method returns, so the stamp taken by one
+/// of the servers isn't handed to another, and the put stamp outlives the crash that follows.
+class RecoveryJournal {
+public:
+    enum class Kind : uint8_t {
+        Download,
+        Upload
+    };
+
+    struct Stamp {
+        Kind kind = Kind::Download;
+        std::filesystem::path filePath;
+        /// Size and hash of the whole uploaded file, the kept part belongs only to the same one.
+        size_t fileSize = 0;
+        uint64_t hash = 0;
+        /// Number of the transfered bytes of the file.
+        size_t position = 0;
+        /// Seconds since epoch the stamp was made at.
+        int64_t time = 0;
+    };
+
+    /// Suffix of the part kept from the interrupted upload, it's stored next to the file.
+    static constexpr const char* PART_SUFFIX = ".part";
+    /// Max number of the stamps of one client, the oldest are forgotten.
+    static constexpr unsigned int MAX_CLIENT_STAMPS = 64;
+    /// Stamps older than that are forgotten when the journal is opened.
+    static constexpr std::chrono::hours MAX_STAMP_AGE = std::chrono::hours(24 * 7);
+    /// Journal is compacted once it has that many records and most of them are outdated.
+    static constexpr size_t MIN_COMPACTED_RECORDS = 256;
+
+private:
+    enum class RecordType : uint8_t {
+        Put = 1,
+        Remove
+    };
+
+    struct RecordHeader {
+        uint32_t size;
+        /// Low bits of XXH64 of the record payload.
+        uint32_t checksum;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<Net::MacAddress, std::vector<Stamp>> stamps;
+    size_t stampsCount = 0;
+
+    std::filesystem::path path;
+    File file;
+    /// The journal is being replayed, the forgotten stamps were discarded when it was written.
+    bool isReplaying = false;
+    /// Offset the next record is appended at.
+    size_t fileSize = 0;
+    size_t recordsCount = 0;
+
+    /// Appends the checksummed record of the change to the `output`.
+    static void Encode(std::vector<char>& output, const RecordType type, const Net::MacAddress& client, const Stamp& stamp);
+    /// Appends the record of the change, the stamps are kept in memory only if it fails.
+    void Append(const RecordType type, const Net::MacAddress& client, const Stamp& stamp);
+    /// Rewrites the live stamps into the new journal. Returns `false` if the old one is kept.
+    bool Compact();
+    /// Applies the change to the stamps in memory.
+    void Apply(const RecordType type, const Net::MacAddress& client, Stamp&& stamp);
+    /// Removes the part kept for the upload stamp that is forgotten without being taken,
+    /// unless the stamp of another client refers to the same part.
+    void Discard(const Stamp& stamp) const;
+    const Stamp* Lookup(const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath) const;
+
+public:
+    static std::filesystem::path GetPartPath(const std::filesystem::path& filePath) {
+        return filePath.string() + PART_SUFFIX;
+    }
+
+    /// Replays the journal at `path` and keeps appending to it, the missing one is created.
+    /// Returns `false` if it can't be written, the stamps are kept in memory then.
+    bool Open(const std::filesystem::path& path);
+
+    /// Stamps the transfer, replaces the stamp of the same kind and file.
+    void Put(const Net::MacAddress& client, Stamp&& stamp);
+    /// Forgets the stamp of the file. Returns `false` if there is none.
+    bool Remove(const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath);
+
+    std::optional<Stamp> Find(const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath) const;
+    /// Finds the stamp and forgets it.
+    std::optional<Stamp> Take(const Net::MacAddress& client, const Kind kind, const std::filesystem::path& filePath);
+    /// Finds the stamps of the kind made for the client, from the oldest, and forgets them.
+    std::vector<Stamp> TakeAll(const Net::MacAddress& client, const Kind kind);
+};
+
+#endif
@@ -1,249 +1,1442 @@
 #include "server.h"
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
+#include <limits>
 
+#include <core/hash.h>
 #include <core/packet.h>
 
-static void TakeBitrate(const std::chrono::system_clock::time_point begin, const uint bytes) {
+static void TakeBitrate(
+    const std::chrono::system_clock::time_point begin, const uint bytes, const Net::BufferTuner* tuner = nullptr
+) {
     const auto end = std::chrono::system_clock::now();
 
     const size_t timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
     const float bitrate = ((double)bytes / 125000) / ((double)timeNs / 1e+9);
 
-    std::cout << "Bitrate: " << bitrate << " Mb/s.\n";
+    std::cout << "Bitrate: " << bitrate << " Mb/s";
+    if (tuner != nullptr && tuner->IsTuned()) {
+        std::cout << ", RTT: " << tuner->GetRtt() << " us, chunk: " << tuner->GetChunkSize() / 1024
+            << " KiB, socket buffer: " << tuner->GetBufferSize() / 1024 << " KiB";
+    }
+    std::cout << ".\n";
 }
 
-Server::Server(const Net::Protocol protocol, const Net::Address::port_t port) : port(port) {
+Server::Server(const Net::Protocol protocol, const Net::Address::port_t port, const bool shared) : port(port) {
     if (protocol == Net::Protocol::TCP) {
         listenServer = std::make_unique<Net::TcpServer>();
     } else {
         listenServer = std::make_unique<Net::UdpServer>();
     }
 
-    listenServer->Bind(Net::Address::MakeBind(port, protocol));
+    listenServer->Bind(Net::Address::MakeBind(port, protocol), shared);
 };
 
+void Server::Run() {
+    Net::Socket* listenSocket = listenServer->GetSocket();
+
+    if (listenSocket != nullptr) {
+        RunEventLoop(*listenSocket);
+    } else {
+        RunSequential();
+    }
+}
+
+void Server::RunEventLoop(Net::Socket& listenSocket) {
+    Net::Poller poller;
+    if (!poller.IsValid() || !listenSocket.SetBlocking(false)) [[unlikely]] {
+        std::cerr << "Failed to start event loop, serve clients one by one.\n";
+        RunSequential();
+        return;
+    }
+
+    poller.Add(listenSocket, LISTEN_KEY, Net::Poller::Readable);
+    // Starts listening, there might be no events until then.
+    AcceptClients(poller);
+
+    if (ring != nullptr) poller.Add(ring->GetNotifier(), RING_KEY, Net::Poller::Readable);
+    std::array<Net::Ring::Completion, RING_ENTRIES> completions;
+
+    std::array<Net::Poller::Event, MAX_EVENTS> events;
+    std::vector<ClientId> readyClients;
+    std::vector<ClientId> yieldedClients;
+
+    while (true) {
+        // Don't sleep while there are clients that have more work to do.
+        const int count = poller.Wait(events.data(), events.size(), readyClients.empty() ? -1 : 0);
+        if (count < 0) [[unlikely]] {
+            std::cerr << "Poll failed: " << Net::GetStatusName(poller.Fail()) << ".\n";
+            continue;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (events[i].key == LISTEN_KEY) {
+                AcceptClients(poller);
+            } else if (events[i].key == RING_KEY) {
+                ring->ResetNotifier();
+
+                unsigned int reaped;
+                while ((reaped = ring->Reap(completions.data(), completions.size())) > 0) {
+                    for (unsigned int j = 0; j < reaped; ++j) HandleCompletion(completions[j], readyClients);
+                }
+            } else {
+                readyClients.push_back(events[i].key);
+            }
+        }
+
+        std::swap(readyClients, yieldedClients);
+        readyClients.clear();
+
+        for (const ClientId clientId : yieldedClients) {
+            const auto it = clients.find(clientId);
+            if (it == clients.end()) continue;
+
+            switch (Drive(it->second, STEPS_PER_TURN)) {
+                case Step::Yield:
+                    readyClients.push_back(clientId);
+                    break;
+                case Step::Drop:
+                    Disconnect(clientId);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // All the operations prepared during the iteration are passed at once.
+        if (ring != nullptr && ring->Submit() < 0) [[unlikely]] {
+            std::cerr << "Ring submission failed: " << Net::GetStatusName(ring->Fail()) << ".\n";
+        }
+    }
+}
+
+void Server::RunSequential() {
+    while (true) {
+        const int clientId = Listen();
+        if (clientId == INVALID_CLIENT_ID) {
+            std::cout << "Listen failed: " << Net::GetStatusName(listenServer->Fail()) << ".\n";
+            continue;
+        }
+
+        ClientHandle& client = clients.at(clientId);
+        while (Drive(client, std::numeric_limits<unsigned int>::max()) != Step::Drop);
+
+        Disconnect(clientId);
+    }
+}
+
 int Server::Listen() {
     Net::Ptr<Net::Connection> clientConnection = listenServer->Listen();
-    if (clientConnection == nullptr) return INVALID_CLIENT_INDEX;
+    if (clientConnection == nullptr) return INVALID_CLIENT_ID;
 
-    const auto clientIndex = clients.size();
-    clients.push_back(ClientHandle(std::move(clientConnection)));
+    const ClientId clientId = nextClientId++;
+    ClientHandle& client = clients.emplace(clientId, ClientHandle(std::move(clientConnection))).first->second;
+    client.id = clientId;
 
-    ClientHandle& client = clients[clientIndex];
-    std::cout << "Receive mac address...\n";
-    client.connection->ReceiveAll(client.identifier);
+    // The transfers are tuned to the link of the connection, if the os measures it.
+    client.transfer.sendTuner.Attach(client.connection->GetSocket());
+    client.transfer.receiveTuner.Attach(client.connection->GetSocket());
 
-    if (CheckFail(client)) [[unlikely]] goto fail_ret;
+    std::cout << "Receive mac address...\n";
+    return clientId;
+}
 
-    {
-        const auto downloadStamp = recoveryStamps.find(client.identifier);
-        if (downloadStamp != recoveryStamps.end()) [[unlikely]] {
-            auto builder = Msg::Packet::Build(Msg::Opcodes::DownloadRecovery);
-            const auto packet = builder
-                .Append(downloadStamp->second.position)
-                .Append(downloadStamp->second.filePath.filename().c_str())
-                .Complete();
-
-            client.connection->Send(packet->RawPtr(), sizeof(Msg::Packet::Header));
-            client.connection->Send(packet->GetDataAs<char>(), packet->GetDataSize());
-
-            recoveryStamps.erase(downloadStamp);
-        } else {
-            recoveryStamps.clear();
+void Server::AcceptClients(Net::Poller& poller) {
+    while (true) {
+        const int clientId = Listen();
+        if (clientId == INVALID_CLIENT_ID) {
+            const Net::Status status = listenServer->Fail();
+            if (status != Net::Status::WouldBlock) [[unlikely]] {
+                std::cout << "Listen failed: " << Net::GetStatusName(status) << ".\n";
+            }
+            return;
+        }
 
-            std::cout << "Send none stamps.\n";
-            Msg::Packet::Header packet { Msg::Opcodes::None };
-            client.connection->Send(packet);
+        Net::Socket* socket = clients.at(clientId).connection->GetSocket();
+        if (
+            socket == nullptr ||
+            !socket->SetBlocking(false) ||
+            !poller.Add(*socket, clientId, Net::Poller::Readable | Net::Poller::Writable | Net::Poller::Closed)
+        ) [[unlikely]] {
+            std::cerr << "Client connection failed.\n";
+            clients.erase(clientId);
         }
+    }
+}
 
-        if (CheckFail(client)) [[unlikely]] goto fail_ret;
+void Server::Disconnect(const ClientId clientId) {
+    // The suspended transfer is destroyed along with the client.
+    scheduler.Forget(clientId);
+    // Closing the socket also removes it from the poller.
+    clients.erase(clientId);
+    std::cout << "Client disconnected.\n";
+    if (reportCacheStats == false) return;
+
+    const ContentCache::Stats stats = contentCache.GetStats();
+    std::cout << "Content cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+        << stats.files << " files of " << stats.size << " bytes.\n";
+}
+
+void Server::SaveRecoveryStamp(const ClientHandle& client, const size_t position) {
+    const Transfer& transfer = client.transfer;
+    if (transfer.isRange) return;
+
+    RecoveryJournal::Stamp stamp;
+    stamp.kind = RecoveryJournal::Kind::Download;
+    stamp.filePath = transfer.filePath;
+    stamp.position = position;
+
+    recoveryJournal.Put(client.identifier, std::move(stamp));
+}
+
+void Server::SaveUploadStamp(ClientHandle& client, const size_t position) {
+    Transfer& transfer = client.transfer;
+    std::error_code error;
+
+    // Only the part that reached the storage is kept.
+    const bool isSynced = transfer.file.Sync();
+    transfer.file.Close();
+
+    if (position == 0 || isSynced == false) {
+        std::filesystem::remove(transfer.partPath, error);
+        return;
     }
 
-    std::cout << "Client [" << client.identifier.ToString() << "] connected.\n";
-    return clientIndex;
+    RecoveryJournal::Stamp stamp;
+    stamp.kind = RecoveryJournal::Kind::Upload;
+    stamp.filePath = transfer.filePath;
+    stamp.fileSize = transfer.startPos + transfer.totalSize;
+    stamp.hash = transfer.hash;
+    stamp.position = position;
 
-fail_ret:
-    std::cerr << "Client connection failed.\n"; 
-    return INVALID_CLIENT_INDEX;
+    recoveryJournal.Put(client.identifier, std::move(stamp));
+
+    std::cout << "Upload of " << transfer.filePath << " is kept at " << position << " bytes.\n";
 }
 
-bool Server::Handle(unsigned int clientIndex) {
-    ClientHandle& client = clients[clientIndex];
+size_t Server::TakeUploadStamp(const ClientHandle& client) {
+    const Transfer& transfer = client.transfer;
 
-    Msg::Packet* packet = reinterpret_cast<Msg::Packet*>(client.buffer);
-    if (client.connection->ReceiveAll(*packet) < sizeof(*packet)) {
-        CheckFail(client);
-        return false;
+    const auto stamp = recoveryJournal.Take(client.identifier, RecoveryJournal::Kind::Upload, transfer.filePath);
+    if (stamp.has_value() == false) return 0;
+
+    // The kept part belongs to another version of the file if it doesn't match.
+    const bool isSameFile = (stamp->fileSize == transfer.startPos + transfer.totalSize) && (stamp->hash == transfer.hash);
+    return isSameFile ? stamp->position : 0;
+}
+
+Server::Step Server::CheckFail(ClientHandle& client) {
+    return CheckFail(client, client.connection->Fail());
+}
+
+Server::Step Server::CheckFail(const ClientHandle& client, const Net::Status status) {
+    if (status == Net::Status::Success) return Step::Continue;
+    if (status == Net::Status::WouldBlock) return Step::Block;
+
+    std::cerr << "client[" << client.identifier.ToString() << "]: " << Net::GetStatusName(status) << ".\n";
+    return Step::Drop;
+}
+
+Server::Step Server::Drive(ClientHandle& client, unsigned int steps) {
+    while (steps-- > 0) {
+        Step step = Flush(client);
+        if (step != Step::Continue) return step;
+
+        switch (client.state) {
+            case ClientHandle::State::Handshake:
+                step = StepHandshake(client);
+                break;
+            case ClientHandle::State::Packet:
+                step = StepPacket(client);
+                break;
+            case ClientHandle::State::Download:
+            case ClientHandle::State::Upload:
+            case ClientHandle::State::DeltaUpload:
+            case ClientHandle::State::UploadCommit:
+                step = StepTransfer(client);
+                break;
+            case ClientHandle::State::RingDownload:
+            case ClientHandle::State::RingUpload:
+                // Waiting for the ring completions.
+                return Step::Block;
+        }
+
+        if (step != Step::Continue) return step;
     }
-    if (packet->GetDataSize() > 0) {
-        if (client.connection->ReceiveAll(client.buffer + sizeof(Msg::Packet), packet->GetDataSize()) == 0) [[unlikely]] return false;
+
+    return Step::Yield;
+}
+
+Server::Step Server::Flush(ClientHandle& client) {
+    if (client.output.empty()) return Step::Continue;
+
+    const uint sent = client.connection->Send(client.output.data(), client.output.size());
+    if (sent == 0) [[unlikely]] {
+        const Step step = CheckFail(client);
+        return (step == Step::Continue) ? Step::Drop : step;
     }
 
-    return HandlePacket(client, packet);
+    client.output.erase(client.output.begin(), client.output.begin() + sent);
+    return client.output.empty() ? Step::Continue : Step::Block;
 }
 
-bool Server::CheckFail(ClientHandle& client) {
-    Net::Status status = client.connection->Fail();
-    if (status == Net::Status::Success) return false;
+Server::Step Server::Reply(ClientHandle& client, const void* data, const size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
 
-    std::cerr << "client[" << client.identifier.ToString() << "]: " << Net::GetStatusName(status) << ".\n";
+    // Keep ordering with the output that is still pending.
+    if (client.output.empty()) {
+        const uint sent = client.connection->Send(bytes, size);
+        if (sent == 0) [[unlikely]] {
+            const Step step = CheckFail(client);
+            if (step != Step::Block) return (step == Step::Continue) ? Step::Drop : step;
+        }
 
-    switch (status) {
-        case Net::Status::Timeout:
-        case Net::Status::TryAgain:
-        case Net::Status::Unreachable:
-        case Net::Status::ConnectionRefused:
-        case Net::Status::ConnectionReset: {
-            // Swap remove.
-            auto it = std::find(clients.begin(), clients.end(), client);
-            auto last = std::prev(clients.end());
-            if (it != last) std::iter_swap(it, last);
-
-            clients.pop_back();
-            return false;
+        bytes += sent;
+        if (sent == size) return Step::Continue;
+    }
+
+    client.output.insert(client.output.end(), bytes, reinterpret_cast<const char*>(data) + size);
+    return Step::Continue;
+}
+
+Server::Step Server::Reply(ClientHandle& client, const Msg::Packet* request, const void* data, const size_t size) {
+    return Reply(client, request->GetHeader().opcode, request->GetRequestId(), data, size);
+}
+
+Server::Step Server::Reply(
+    ClientHandle& client, const Msg::Opcodes opcode, const uint32_t requestId, const void* data, const size_t size
+) {
+    if (requestId == Msg::Packet::UNTAGGED) return Reply(client, data, size);
+
+    const Msg::Packet::Header header = { opcode, static_cast<uint16_t>(size), requestId };
+
+    const Step step = Reply(client, header);
+    if (step != Step::Continue) [[unlikely]] return step;
+
+    return Reply(client, data, size);
+}
+
+Server::Step Server::ReceiveInput(ClientHandle& client, const size_t size) {
+    while (client.received < size) {
+        const uint received = client.connection->Receive(client.buffer + client.received, size - client.received);
+        if (received == 0) {
+            const Step step = CheckFail(client);
+            // No error and no data: connection is closed by the remote side.
+            return (step == Step::Continue) ? Step::Drop : step;
         }
-        default:
-            break;
+
+        client.received += received;
     }
 
-    return true;
+    return Step::Continue;
+}
+
+Server::Step Server::StepHandshake(ClientHandle& client) {
+    const Step step = ReceiveInput(client, sizeof(client.identifier));
+    if (step != Step::Continue) return step;
+
+    std::memcpy(&client.identifier, client.buffer, sizeof(client.identifier));
+    client.received = 0;
+    client.state = ClientHandle::State::Packet;
+
+    // Each of the interrupted downloads is offered once, the list ends by the empty packet.
+    // The declined ones aren't offered again, the client resumes the accepted ones by the offered positions.
+    for (const RecoveryJournal::Stamp& stamp : recoveryJournal.TakeAll(client.identifier, RecoveryJournal::Kind::Download)) {
+        auto builder = Msg::Packet::Build(Msg::Opcodes::DownloadRecovery);
+        const auto packet = builder
+            .Append(stamp.position)
+            .Append(stamp.filePath.filename().c_str())
+            .Complete();
+
+        if (Reply(client, packet->RawPtr(), packet->GetSize()) == Step::Drop) [[unlikely]] goto fail_ret;
+    }
+
+    {
+        Msg::Packet::Header packet { Msg::Opcodes::None };
+        if (Reply(client, packet) == Step::Drop) [[unlikely]] goto fail_ret;
+    }
+
+    std::cout << "Client [" << client.identifier.ToString() << "] connected.\n";
+    return Step::Continue;
+
+fail_ret:
+    std::cerr << "Client connection failed.\n";
+    return Step::Drop;
+}
+
+Server::Step Server::StepPacket(ClientHandle& client) {
+    if (!client.streams.empty()) {
+        // Connections that can't be polled would wait for the next request, so their streams are sent first.
+        if (client.connection->GetSocket() == nullptr) return StepStreams(client);
+    }
+
+    Step step = ReceiveInput(client, sizeof(Msg::Packet));
+    // The tagged downloads proceed while no requests come.
+    if (step == Step::Block && !client.streams.empty()) return StepStreams(client);
+    if (step != Step::Continue) return step;
+
+    const Msg::Packet* packet = reinterpret_cast<Msg::Packet*>(client.buffer);
+    // The size is checked by its data part, the whole size of the packet wraps around 16 bits.
+    if (packet->GetDataSize() > DEFAULT_BUFFER_SIZE - sizeof(Msg::Packet)) [[unlikely]] {
+        std::cerr << "Too large packet from client[" << client.identifier.ToString() << "].\n";
+        return Step::Drop;
+    }
+
+    step = ReceiveInput(client, packet->GetSize());
+    if (step == Step::Block && !client.streams.empty()) return StepStreams(client);
+    if (step != Step::Continue) return step;
+
+    client.received = 0;
+    return HandlePacket(client, packet);
 }
 
-bool Server::HandlePacket(ClientHandle& client, const Msg::Packet* packet) {
+Server::Step Server::HandlePacket(ClientHandle& client, const Msg::Packet* packet) {
     std::cout << "Handle packet: type: " << (int)packet->GetHeader().opcode << " - size: " << packet->GetSize() << ".\n";
 
     switch (packet->GetHeader().opcode) {
-        case Msg::Opcodes::Echo: {
-            client.connection->Send(packet->GetDataAs<char>(), packet->GetDataSize());
-        } break;
+        case Msg::Opcodes::Echo:
+            return Reply(client, packet, packet->GetDataAs<char>(), packet->GetDataSize());
         case Msg::Opcodes::Time: {
             const std::time_t serverTime = std::time(nullptr);
-            client.connection->Send(reinterpret_cast<const char*>(&serverTime), sizeof(serverTime));
-        } break;
+            return Reply(client, packet, serverTime);
+        }
         case Msg::Opcodes::Download: {
             const auto request = packet->GetDataAs<Msg::Request::Download>();
-            return HandleDownload(client, request->position, request->fileName);
+            return HandleDownload(client, packet, request->position, SIZE_MAX, request->codec, request->fileName);
+        }
+        case Msg::Opcodes::DownloadRange: {
+            const auto request = packet->GetDataAs<Msg::Request::DownloadRange>();
+            return HandleDownload(
+                client, packet, request->position, request->size, Msg::Codec::None, request->fileName
+            );
         }
         case Msg::Opcodes::Upload:
-            return HandleUpload(client, packet->GetDataAs<Msg::Request::Upload>());
+            return HandleUpload(client, packet, packet->GetDataAs<Msg::Request::Upload>());
+        case Msg::Opcodes::UploadRecovery:
+            return HandleUploadRecovery(client, packet, packet->GetDataAs<Msg::Request::UploadRecovery>());
+        case Msg::Opcodes::DeltaUpload:
+            return HandleDeltaUpload(client, packet->GetDataAs<Msg::Request::DeltaUpload>());
+        case Msg::Opcodes::List:
+            return HandleList(client, packet);
+        case Msg::Opcodes::Close:
+            return Step::Drop;
         default:
             std::cerr << "Invalid packet from client[" << client.identifier.ToString() << "].\n";
-            return false;
+            return Step::Drop;
     }
-
-    return !CheckFail(client);
 }
 
-bool Server::HandleDownload(ClientHandle& client, const size_t startPos, const char* fileName) {
-    const auto filePath = hostDirectory / fileName;
-
-    std::ifstream fileStream;
-    Msg::Response::Download response;
+Msg::Response::Download Server::OpenDownload(
+    const std::filesystem::path& filePath, const size_t startPos, const size_t size,
+    File& outFile, ChecksumCache::Version& outVersion
+) {
+    Msg::Response::Download response {};
 
-    // Check if file exists and can be open.
-    if (std::filesystem::exists(filePath)) {
-        if (std::filesystem::is_regular_file(filePath) == false) {
+    // The repeated requests of the same file are answered by the cache.
+    switch (fileCache.Open(filePath, outFile, outVersion)) {
+        case FileCache::Kind::Missing:
+            response.status = Msg::Response::Download::NoSuchFile;
+            std::cout << "No such file: " << filePath << ".\n";
+            return response;
+        case FileCache::Kind::NotFile:
             response.status = Msg::Response::Download::IsNotFile;
             std::cout << "Is not file: " << filePath << ".\n";
-            goto sendPacket;
+            return response;
+        case FileCache::Kind::Unreadable:
+            response.status = Msg::Response::Download::NoSuchFile;
+            std::cout << "Failed to open file: " << filePath << ".\n";
+            return response;
+        case FileCache::Kind::Regular:
+            break;
+    }
+
+    response.status = Msg::Response::Download::Ready;
+    response.fileSize = outVersion.size;
+
+    if (response.fileSize <= startPos) [[unlikely]] { response.totalSize = 0; }
+    else { response.totalSize = std::min(response.fileSize - startPos, size); }
+
+    return response;
+}
+
+Server::Step Server::HandleDownload(
+    ClientHandle& client, const Msg::Packet* request,
+    const size_t startPos, const size_t size, const Msg::Codec codec, const char* fileName
+) {
+    if (request->IsTagged()) {
+        Stream stream;
+        Msg::Response::Download response {};
+
+        if (client.streams.size() < MAX_STREAMS) [[likely]] {
+            const std::filesystem::path filePath = hostDirectory / fileName;
+            ChecksumCache::Version version;
+
+            response = OpenDownload(filePath, startPos, size, stream.file, version);
+            if (response.totalSize > 0) stream.content = contentCache.Get(filePath, version, stream.file);
+        } else {
+            response.status = Msg::Response::Download::Busy;
         }
 
-        response.status = Msg::Response::Download::Ready;
-        response.totalSize = std::filesystem::file_size(filePath);
+        const Step step = Reply(client, request, response);
+        if (step != Step::Continue || response.status != Msg::Response::Download::Ready) return step;
+        if (response.totalSize == 0) [[unlikely]] return Step::Continue;
 
-        if (response.totalSize <= startPos) [[unlikely]] { response.totalSize = 0; }
-        else { response.totalSize -= startPos; }
+        stream.requestId = request->GetRequestId();
+        stream.position = startPos;
+        stream.bytesLeft = response.totalSize;
+        client.streams.push_back(std::move(stream));
+        return Step::Continue;
+    }
 
-        fileStream.open(filePath, std::ios::binary);
+    Transfer& transfer = client.transfer;
+    transfer.filePath = hostDirectory / fileName;
 
-        if (fileStream.is_open() == false) [[unlikely]] {
-            response.status = Msg::Response::Download::NoSuchFile;
-            std::cout << "Failed to open file: " << filePath << ".\n";
+    // The interrupted download is resumed or started over, it isn't offered anymore.
+    if (size == SIZE_MAX) recoveryJournal.Remove(client.identifier, RecoveryJournal::Kind::Download, transfer.filePath);
+
+    Msg::Response::Download response = OpenDownload(transfer.filePath, startPos, size, transfer.file, transfer.fileVersion);
+    if (response.status == Msg::Response::Download::Ready) {
+        transfer.codec = Compression::Choose(codec, transfer.file, startPos, response.totalSize);
+        response.codec = transfer.codec;
+    }
+    {
+        const Step step = Reply(client, response);
+
+        if (step != Step::Continue) [[unlikely]] return step;
+        if (response.status != Msg::Response::Download::Ready) return Step::Continue;
+    }
+
+    if (response.totalSize == 0) [[unlikely]] {
+        transfer.file.Close();
+        return Step::Continue;
+    }
+
+    transfer.startPos = startPos;
+    transfer.isRange = (size != SIZE_MAX);
+    transfer.totalSize = response.totalSize;
+    transfer.bytesLeft = response.totalSize;
+    transfer.checksums.Reset(startPos);
+    transfer.content = contentCache.Get(transfer.filePath, transfer.fileVersion, transfer.file);
+    transfer.fileChecksums = checksumCache.Find(transfer.filePath, transfer.fileVersion);
+
+    // The content in memory is checksummed at once, its next downloads take the cached checksums.
+    if (transfer.content && !transfer.fileChecksums) {
+        Hash::ChunkChecksums checksums { Msg::CHECKSUM_CHUNK_SIZE };
+        checksums.Update(transfer.content->data(), transfer.content->size());
+        transfer.fileChecksums = checksumCache.Put(transfer.filePath, transfer.fileVersion, checksums.Finish());
+    }
+    transfer.beginTime = std::chrono::system_clock::now();
+    transfer.sendTuner.Begin();
+
+    client.state = ClientHandle::State::Download;
+    return Step::Continue;
+}
+
+Server::Step Server::StepStreams(ClientHandle& client) {
+    using Header = Msg::Packet::Header;
+
+    if (client.nextStream >= client.streams.size()) client.nextStream = 0;
+    Stream& stream = client.streams[client.nextStream];
+
+    if (client.frame.empty()) client.frame.resize(sizeof(Header) + STREAM_FRAME_SIZE);
+
+    const size_t size = std::min(STREAM_FRAME_SIZE, stream.bytesLeft);
+    if (stream.content) {
+        std::memcpy(client.frame.data() + sizeof(Header), stream.content->data() + stream.position, size);
+    } else if (stream.file.Read(client.frame.data() + sizeof(Header), size, stream.position) != size) [[unlikely]] {
+        std::cerr << "Failed to read file of the request " << stream.requestId << ".\n";
+        return Step::Drop;
+    }
+
+    const Header header = { Msg::Opcodes::Data, static_cast<uint16_t>(size), stream.requestId };
+    std::memcpy(client.frame.data(), &header, sizeof(header));
+
+    stream.position += size;
+    stream.bytesLeft -= size;
+
+    // Each of the streams sends one frame in turn.
+    if (stream.bytesLeft == 0) {
+        client.streams.erase(client.streams.begin() + client.nextStream);
+    } else {
+        ++client.nextStream;
+    }
+
+    return Reply(client, client.frame.data(), sizeof(header) + size);
+}
+
+Server::Step Server::HandleUpload(ClientHandle& client, const Msg::Packet* packet, const Msg::Request::Upload* request) {
+    Transfer& transfer = client.transfer;
+
+    if (request->fileSize == 0 || request->position >= request->fileSize || request->codec > Msg::Codec::Lz4) {
+        return Step::Drop;
+    }
+
+    transfer.codec = request->codec;
+    // The content follows from the `position`, the part before it is kept from the interrupted upload.
+    transfer.startPos = request->position;
+    transfer.totalSize = request->fileSize - request->position;
+    transfer.bytesLeft = transfer.totalSize;
+    transfer.hash = request->hash;
+    transfer.requestId = packet->GetRequestId();
+    transfer.discard = false;
+
+    if (request->fileName[0] == '.' || request->fileName[0] == '/' || request->fileName[0] == '~') {
+        // Ignore file content: invalid file name
+        transfer.discard = true;
+    } else {
+        transfer.filePath = hostDirectory / request->fileName;
+        transfer.partPath = RecoveryJournal::GetPartPath(transfer.filePath);
+
+        const size_t keptSize = TakeUploadStamp(client);
+        // The upload from the beginning starts over, the kept part is truncated.
+        const bool isContinued = (request->position > 0);
+
+        if (isContinued && keptSize != request->position) [[unlikely]] {
+            std::cout << "No kept part to continue the upload of " << transfer.filePath << ".\n";
+            transfer.discard = true;
+        } else if (transfer.file.Open(transfer.partPath, isContinued ? File::Mode::Update : File::Mode::Write) == false) [[unlikely]] {
+            std::cout << "Failed to create or open file at " << transfer.partPath << ".\n";
+            transfer.discard = true;
+        } else if (transfer.file.Reserve(request->fileSize) == false) [[unlikely]] {
+            std::cout << "Not enough space for " << transfer.filePath << ".\n";
+
+            transfer.file.Close();
+            std::filesystem::remove(transfer.partPath);
+            transfer.discard = true;
+        }
+    }
+
+    transfer.beginTime = std::chrono::system_clock::now();
+    transfer.receiveTuner.Begin();
+
+    client.state = ClientHandle::State::Upload;
+    return Step::Continue;
+}
+
+Server::Step Server::HandleUploadRecovery(
+    ClientHandle& client, const Msg::Packet* packet, const Msg::Request::UploadRecovery* request
+) {
+    Msg::Response::UploadRecovery response {};
+
+    if (request->fileName[0] != '.' && request->fileName[0] != '/' && request->fileName[0] != '~') {
+        const std::filesystem::path filePath = hostDirectory / request->fileName;
+        const auto stamp = recoveryJournal.Find(client.identifier, RecoveryJournal::Kind::Upload, filePath);
+
+        // The part could be removed while the server was down.
+        if (
+            stamp.has_value() && stamp->fileSize == request->fileSize && stamp->hash == request->hash &&
+            std::filesystem::exists(RecoveryJournal::GetPartPath(filePath))
+        ) {
+            response.position = stamp->position;
+        }
+    }
+
+    return Reply(client, packet, response);
+}
+
+Server::Step Server::StepTransfer(ClientHandle& client) {
+    Transfer& transfer = client.transfer;
+    const bool isDownload = (client.state == ClientHandle::State::Download);
+
+    if (client.task.IsValid() == false) {
+        if (client.state == ClientHandle::State::DeltaUpload) {
+            client.task = ReceiveDelta(client);
+        } else if (client.state == ClientHandle::State::UploadCommit) {
+            client.task = CommitUpload(client);
+        } else {
+            // The ring takes the whole transfer, the transfer given back by the ring continues within the event loop.
+            // The content kept in memory is sent by the event loop, there is nothing to read.
+            const bool isStarting = (transfer.bytesLeft == transfer.totalSize) && (transfer.codec == Msg::Codec::None) &&
+                (isDownload ? !transfer.content : transfer.discard == false);
+            if (isStarting && AttachRing(client)) return Step::Block;
+
+            client.task = isDownload ? SendTransfer(client) : ReceiveTransfer(client);
         }
+
+        client.task.Start();
     } else {
-        response.status = Msg::Response::Download::NoSuchFile;
-        std::cout << "No such file: " << filePath << ".\n";
+        scheduler.Resume(client.id);
     }
 
-sendPacket:
-    {
-        client.connection->Send(response);
+    if (client.task.IsDone() == false) {
+        return (scheduler.GetWait(client.id) == Net::Scheduler::Wait::Turn) ? Step::Yield : Step::Block;
+    }
+
+    const Step step = client.task.TakeResult();
+    client.task.Reset();
+    return step;
+}
+
+Net::Task<Server::Step> Server::SendTransfer(ClientHandle& client) {
+    Transfer& transfer = client.transfer;
+    Net::AsyncConnection connection(*client.connection, scheduler, client.id);
+
+    for (unsigned int steps = 1; transfer.bytesLeft > 0; ++steps) {
+        if (steps % STEPS_PER_TURN == 0) co_await connection.Yield();
+
+        const size_t position = transfer.startPos + transfer.totalSize - transfer.bytesLeft;
+
+        if (transfer.codec != Msg::Codec::None) {
+            if (transfer.chunk.empty() && !transfer.content) transfer.chunk.resize(COPY_CHUNK_SIZE);
+            if (transfer.packed.empty()) transfer.packed.resize(Compression::MAX_PACKED_BLOCK_SIZE);
+
+            const size_t blockSize = std::min(Compression::MAX_BLOCK_SIZE, transfer.bytesLeft);
+            const char* block = transfer.chunk.data();
+
+            if (transfer.content) {
+                block = transfer.content->data() + position;
+            } else if (transfer.file.Read(transfer.chunk.data(), blockSize, position) != blockSize) [[unlikely]] {
+                std::cerr << "Failed to read file: " << transfer.filePath << ".\n";
+                co_return Step::Drop;
+            }
+
+            if (!transfer.fileChecksums) transfer.checksums.Update(block, blockSize);
+
+            const size_t packedSize = Compression::PackBlock(transfer.codec, block, blockSize, transfer.packed.data());
+            if (co_await connection.SendAll(transfer.packed.data(), packedSize) == 0) {
+                CheckFail(client, connection.Fail());
+                // The client keeps only the complete blocks.
+                SaveRecoveryStamp(client, position);
+                co_return Step::Drop;
+            }
+
+            transfer.bytesLeft -= blockSize;
+            continue;
+        }
+
+        // Stream connections send the file straight from the os file cache, it saves a copy of the content
+        // kept in memory as well, unless its rest is sent by one call.
+        if (client.connection->CanSendFile() && (!transfer.content || transfer.bytesLeft > COPY_CHUNK_SIZE)) {
+            const uint sent = co_await connection.SendFile(
+                transfer.file.GetDescriptor(),
+                position,
+                std::min(transfer.sendTuner.GetChunkSize(), transfer.bytesLeft)
+            );
+            if (sent == 0) {
+                CheckFail(client, connection.Fail());
+                SaveRecoveryStamp(client, position);
+                co_return Step::Drop;
+            }
+            // The content sent by the os is read back from the file cache, only until the checksums are cached.
+            if (!transfer.fileChecksums && !ChecksumFile(transfer, position, sent)) [[unlikely]] {
+                std::cerr << "Failed to read file: " << transfer.filePath << ".\n";
+                co_return Step::Drop;
+            }
+
+            transfer.bytesLeft -= sent;
+            transfer.sendTuner.Update(sent);
+            continue;
+        }
 
-        if (CheckFail(client)) [[unlikely]] return false;
-        if (response.status != Msg::Response::Download::Ready) return true;
+        const size_t chunkSize = std::min(COPY_CHUNK_SIZE, transfer.bytesLeft);
+        const char* chunk;
+
+        if (transfer.content) {
+            chunk = transfer.content->data() + position;
+        } else {
+            if (transfer.chunk.empty()) transfer.chunk.resize(COPY_CHUNK_SIZE);
+
+            chunk = transfer.chunk.data();
+            if (transfer.file.Read(transfer.chunk.data(), chunkSize, position) != chunkSize) [[unlikely]] {
+                std::cerr << "Failed to read file: " << transfer.filePath << ".\n";
+                co_return Step::Drop;
+            }
+        }
+        if (!transfer.fileChecksums) transfer.checksums.Update(chunk, chunkSize);
+
+        for (size_t offset = 0; offset < chunkSize;) {
+            const uint sent = co_await connection.Send(chunk + offset, chunkSize - offset);
+            if (sent == 0) {
+                CheckFail(client, connection.Fail());
+                SaveRecoveryStamp(client, position + offset);
+                co_return Step::Drop;
+            }
+
+            offset += sent;
+        }
+
+        transfer.bytesLeft -= chunkSize;
+    }
+
+    // The checksums let the client find the damaged chunks.
+    if (transfer.fileChecksums && !CollectChecksums(transfer)) [[unlikely]] {
+        std::cerr << "Failed to read file: " << transfer.filePath << ".\n";
+        co_return Step::Drop;
     }
 
-    if (response.totalSize == 0) [[unlikely]] return true;
-    if (startPos != 0) fileStream.seekg(startPos, std::ios::beg);
+    const std::vector<uint32_t>& checksums = transfer.checksums.Finish();
+    // The whole file is checksummed, so its next downloads take the checksums from the cache.
+    if (!transfer.fileChecksums && transfer.startPos == 0 && transfer.totalSize == transfer.fileVersion.size) {
+        checksumCache.Put(transfer.filePath, transfer.fileVersion, checksums);
+    }
+
+    if (co_await connection.SendAll(checksums.data(), checksums.size() * sizeof(checksums[0])) == 0) {
+        CheckFail(client, connection.Fail());
+        co_return Step::Drop;
+    }
+
+    TakeBitrate(transfer.beginTime, transfer.totalSize, &transfer.sendTuner);
+
+    transfer.file.Close();
+    transfer.content.reset();
+    client.state = ClientHandle::State::Packet;
+    co_return Step::Continue;
+}
+
+bool Server::ChecksumFile(Transfer& transfer, size_t position, size_t size) {
+    if (transfer.content) {
+        transfer.checksums.Update(transfer.content->data() + position, size);
+        return true;
+    }
+
+    if (transfer.chunk.empty()) transfer.chunk.resize(COPY_CHUNK_SIZE);
+
+    while (size > 0) {
+        const size_t chunkSize = std::min(COPY_CHUNK_SIZE, size);
+        if (transfer.file.Read(transfer.chunk.data(), chunkSize, position) != chunkSize) [[unlikely]] return false;
+
+        transfer.checksums.Update(transfer.chunk.data(), chunkSize);
+        position += chunkSize;
+        size -= chunkSize;
+    }
+    return true;
+}
+
+bool Server::CollectChecksums(Transfer& transfer) {
+    const std::vector<uint32_t>& fileChecksums = *transfer.fileChecksums;
+    const size_t fileSize = transfer.fileVersion.size;
+    const size_t endPos = transfer.startPos + transfer.totalSize;
 
-    const auto beginTime = std::chrono::system_clock::now();
+    transfer.checksums.Reset(transfer.startPos);
 
-    // Send file.
-    size_t bytesToSend = response.totalSize;
-    while (bytesToSend > 0) {
-        const size_t chunkSize = std::min(DEFAULT_BUFFER_SIZE, bytesToSend);
-        fileStream.read(client.buffer, chunkSize);
+    for (size_t position = transfer.startPos; position < endPos;) {
+        const size_t chunk = position / Msg::CHECKSUM_CHUNK_SIZE;
+        const size_t chunkEnd = std::min((chunk + 1) * Msg::CHECKSUM_CHUNK_SIZE, fileSize);
+        const size_t end = std::min(chunkEnd, endPos);
 
-        if (!client.connection->Send(client.buffer, chunkSize)) {
-            recoveryStamps[client.identifier] = DownloadStamp{ filePath, startPos + response.totalSize - bytesToSend };
+        if (position % Msg::CHECKSUM_CHUNK_SIZE == 0 && end == chunkEnd) {
+            transfer.checksums.Append(fileChecksums[chunk]);
+        } else if (!ChecksumFile(transfer, position, end - position)) [[unlikely]] {
             return false;
         }
+        position = end;
+    }
+    return true;
+}
+
+Net::Task<Server::Step> Server::ReceiveTransfer(ClientHandle& client) {
+    Transfer& transfer = client.transfer;
+    Net::AsyncConnection connection(*client.connection, scheduler, client.id);
+
+    const auto removeFile = [&transfer]() {
+        transfer.file.Close();
+        std::filesystem::remove(transfer.partPath);
+    };
+
+    for (unsigned int steps = 1; transfer.bytesLeft > 0; ++steps) {
+        if (steps % STEPS_PER_TURN == 0) co_await connection.Yield();
+
+        const size_t position = transfer.startPos + transfer.totalSize - transfer.bytesLeft;
+        uint received;
+
+        if (transfer.codec != Msg::Codec::None) {
+            if (transfer.chunk.empty()) transfer.chunk.resize(COPY_CHUNK_SIZE);
+            if (transfer.packed.empty()) transfer.packed.resize(Compression::MAX_PACKED_BLOCK_SIZE);
+
+            Compression::BlockHeader header;
+            received = co_await connection.ReceiveAll(&header, sizeof(header));
+
+            if (received != 0) {
+                const size_t payloadSize = Compression::GetPayloadSize(header);
+                if (payloadSize == 0 || payloadSize > Compression::MAX_BLOCK_SIZE) [[unlikely]] goto invalid_block;
+
+                received = co_await connection.ReceiveAll(transfer.packed.data(), payloadSize);
+            }
+            if (received != 0) {
+                received = Compression::UnpackBlock(transfer.codec, header, transfer.packed.data(), transfer.chunk.data());
+                if (received == 0 || received > transfer.bytesLeft) [[unlikely]] goto invalid_block;
+
+                if (transfer.discard == false) {
+                    if (transfer.file.Write(transfer.chunk.data(), received, position) != received) [[unlikely]] {
+                        std::cerr << "Failed to write file: " << transfer.filePath << ".\n";
+                        removeFile();
+                        co_return Step::Drop;
+                    }
+                }
+            }
+        } else if (transfer.discard == false && client.connection->CanReceiveFile()) {
+            // Stream connections move the data from the socket to the file within the os.
+            received = co_await connection.ReceiveFile(
+                transfer.file.GetDescriptor(),
+                position,
+                std::min(transfer.receiveTuner.GetChunkSize(), transfer.bytesLeft)
+            );
+        } else {
+            received = co_await connection.Receive(client.buffer, std::min(DEFAULT_BUFFER_SIZE, transfer.bytesLeft));
 
-        bytesToSend -= chunkSize;
+            if (received != 0 && transfer.discard == false) {
+                if (transfer.file.Write(client.buffer, received, position) != received) [[unlikely]] {
+                    std::cerr << "Failed to write file: " << transfer.filePath << ".\n";
+                    removeFile();
+                    co_return Step::Drop;
+                }
+            }
+        }
+
+        if (received == 0) {
+            CheckFail(client, connection.Fail());
+            // The client may continue the upload after reconnecting.
+            if (transfer.discard == false) SaveUploadStamp(client, position);
+            co_return Step::Drop;
+        }
+
+        transfer.bytesLeft -= received;
+        transfer.receiveTuner.Update(received);
     }
 
-    TakeBitrate(beginTime, response.totalSize);
-    return true;
+    // Content of the rejected file is consumed, drop the client.
+    if (transfer.discard) co_return Step::Drop;
+
+    transfer.file.Close();
+    TakeBitrate(transfer.beginTime, transfer.totalSize, &transfer.receiveTuner);
+
+    client.state = ClientHandle::State::UploadCommit;
+    co_return Step::Continue;
+
+invalid_block:
+    std::cerr << "Invalid compressed block from client[" << client.identifier.ToString() << "].\n";
+    if (transfer.discard == false) removeFile();
+    co_return Step::Drop;
+}
+
+Net::Task<Server::Step> Server::CommitUpload(ClientHandle& client) {
+    using Response = Msg::Response::Upload;
+
+    Transfer& transfer = client.transfer;
+    Net::AsyncConnection connection(*client.connection, scheduler, client.id);
+
+    const size_t fileSize = transfer.startPos + transfer.totalSize;
+    Response response { Response::Corrupted };
+    std::error_code error;
+
+    // The stored file is read back, so the part kept from the interrupted upload is checked as well.
+    if (std::filesystem::file_size(transfer.partPath, error) == fileSize && transfer.file.Open(transfer.partPath, File::Mode::Read)) {
+        if (transfer.chunk.empty()) transfer.chunk.resize(COPY_CHUNK_SIZE);
+
+        Hash::Xxh64State state;
+        size_t position = 0;
+
+        for (unsigned int steps = 1; position < fileSize; ++steps) {
+            if (steps % STEPS_PER_TURN == 0) co_await connection.Yield();
+
+            const size_t chunkSize = std::min(COPY_CHUNK_SIZE, fileSize - position);
+            if (transfer.file.Read(transfer.chunk.data(), chunkSize, position) != chunkSize) [[unlikely]] break;
+
+            state.Update(transfer.chunk.data(), chunkSize);
+            position += chunkSize;
+        }
+
+        if (position == fileSize && state.Digest() == transfer.hash) response.status = Response::Committed;
+        transfer.file.Close();
+    }
+
+    if (response.status == Response::Committed) {
+        std::filesystem::rename(transfer.partPath, transfer.filePath, error);
+
+        if (error) [[unlikely]] {
+            std::cerr << "Failed to replace file: " << transfer.filePath << ".\n";
+            response.status = Response::Failed;
+        } else {
+            std::cout << "File saved at " << transfer.filePath << ".\n";
+        }
+    } else {
+        std::cerr << "Uploaded file doesn't match its hash: " << transfer.filePath << ".\n";
+    }
+
+    if (response.status != Response::Committed) std::filesystem::remove(transfer.partPath, error);
+
+    client.state = ClientHandle::State::Packet;
+    co_return Reply(client, Msg::Opcodes::Upload, transfer.requestId, response);
 }
 
-bool Server::HandleUpload(ClientHandle& client, const Msg::Request::Upload* request) {
-    const size_t fileSize = request->fileSize;
-    size_t bytesToReceive = request->fileSize;
+Server::Step Server::HandleDeltaUpload(ClientHandle& client, const Msg::Request::DeltaUpload* request) {
+    Transfer& transfer = client.transfer;
+
+    if (request->fileSize == 0) return Step::Drop;
 
-    if (request->fileSize == 0) return false;
     if (request->fileName[0] == '.' || request->fileName[0] == '/' || request->fileName[0] == '~') {
-        // Ignore file content: invalid file name
-    ignoreContent:
-        while (bytesToReceive > 0) {
-            const size_t chunkSize = std::min(DEFAULT_BUFFER_SIZE, bytesToReceive);
+        // Nothing is sent until the signatures are received, so the delta is just not requested.
+        Msg::Response::DeltaUpload response {};
+        response.status = Msg::Response::DeltaUpload::Rejected;
+        return Reply(client, response);
+    }
+
+    transfer.filePath = hostDirectory / request->fileName;
+    transfer.startPos = 0;
+    transfer.totalSize = request->fileSize;
+    transfer.bytesLeft = request->fileSize;
+    transfer.hash = request->hash;
+    // The delta goes without the packets, so does the commit result.
+    transfer.requestId = Msg::Packet::UNTAGGED;
+    transfer.beginTime = std::chrono::system_clock::now();
+
+    client.state = ClientHandle::State::DeltaUpload;
+    return Step::Continue;
+}
+
+Server::Step Server::HandleList(ClientHandle& client, const Msg::Packet* packet) {
+    using Entry = Msg::Response::ListEntry;
+
+    const auto request = packet->GetDataAs<Msg::Request::List>();
+    if (packet->GetDataSize() < sizeof(*request)) [[unlikely]] goto invalid_request;
+
+    {
+        // Both of the paths must end within the packet.
+        const char* paths = request->paths;
+        const size_t pathsSize = packet->GetDataSize() - sizeof(*request);
+
+        const std::string_view prefix(paths, strnlen(paths, pathsSize));
+        if (prefix.size() == pathsSize) [[unlikely]] goto invalid_request;
+
+        const char* afterPath = paths + prefix.size() + 1;
+        const size_t afterSize = pathsSize - prefix.size() - 1;
+
+        const std::string_view after(afterPath, strnlen(afterPath, afterSize));
+        if (after.size() == afterSize) [[unlikely]] goto invalid_request;
+
+        std::vector<DirectoryIndex::Item> items;
+        Msg::Response::List response {};
+        response.hasMore = !hostIndex.List(prefix, after, std::min(request->maxCount, MAX_LIST_COUNT), items);
+
+        std::vector<char> page(sizeof(response));
+        page.reserve(LIST_PAGE_SIZE);
+
+        for (const DirectoryIndex::Item& item : items) {
+            if (page.size() + sizeof(Entry) + item.path.size() + 1 > LIST_PAGE_SIZE) [[unlikely]] {
+                response.hasMore = true;
+                break;
+            }
 
-            uint received = client.connection->Receive(client.buffer, chunkSize);
-            if (CheckFail(client)) [[unlikely]] return false;
+            const Entry entry = { item.entry.size, item.entry.modifyTime };
+            const char* entryBytes = reinterpret_cast<const char*>(&entry);
 
-            bytesToReceive -= received;
+            page.insert(page.end(), entryBytes, entryBytes + sizeof(entry));
+            page.insert(page.end(), item.path.c_str(), item.path.c_str() + item.path.size() + 1);
+            ++response.count;
         }
-        return false;
+
+        response.size = static_cast<uint32_t>(page.size() - sizeof(response));
+        std::memcpy(page.data(), &response, sizeof(response));
+
+        return Reply(client, packet, page.data(), page.size());
     }
 
-    const std::filesystem::path filePath = hostDirectory / request->fileName;
-    std::ofstream fileStream(filePath, std::ios::binary);
+invalid_request:
+    std::cerr << "Invalid list request from client[" << client.identifier.ToString() << "].\n";
+    return Step::Drop;
+}
+
+Net::Task<Server::Step> Server::ReceiveDelta(ClientHandle& client) {
+    using Response = Msg::Response::DeltaUpload;
+    using Command = Msg::Request::DeltaCommand;
+
+    Transfer& transfer = client.transfer;
+    Net::AsyncConnection connection(*client.connection, scheduler, client.id);
 
-    if (fileStream.is_open() == false) [[unlikely]] {
-        std::cout << "Failed to create or open file at " << filePath << ".\n";
-        goto ignoreContent;
+    Response response {};
+    File base;
+    std::error_code error;
+
+    const size_t baseSize = std::filesystem::file_size(transfer.filePath, error);
+    if (error || baseSize == 0 || !std::filesystem::is_regular_file(transfer.filePath) || !base.Open(transfer.filePath, File::Mode::Read)) {
+        // The client uploads the file as a whole instead.
+        response.status = Response::NoBase;
+        client.state = ClientHandle::State::Packet;
+
+        if (co_await connection.SendAll(&response, sizeof(response)) == 0) {
+            CheckFail(client, connection.Fail());
+            co_return Step::Drop;
+        }
+        co_return Step::Continue;
     }
 
-    const auto beginTime = std::chrono::system_clock::now();
-    while (bytesToReceive > 0) {
-        const size_t chunkSize = std::min(DEFAULT_BUFFER_SIZE, bytesToReceive);
-        const uint received = client.connection->Receive(client.buffer, chunkSize);
+    const size_t blockSize = std::clamp<size_t>(
+        std::bit_ceil(static_cast<size_t>(std::sqrt(baseSize))), MIN_DELTA_BLOCK_SIZE, MAX_DELTA_BLOCK_SIZE
+    );
 
-        if (CheckFail(client)) [[unlikely]] {
-            fileStream.close();
-            std::filesystem::remove(filePath);
-            return false;
+    response.status = Response::Ready;
+    response.blockSize = static_cast<uint32_t>(blockSize);
+    response.blockCount = static_cast<uint32_t>((baseSize + blockSize - 1) / blockSize);
+    response.lastBlockSize = static_cast<uint32_t>(baseSize - (response.blockCount - 1) * blockSize);
+
+    if (transfer.chunk.empty()) transfer.chunk.resize(COPY_CHUNK_SIZE);
+    std::vector<Msg::Response::BlockSignature> signatures(response.blockCount);
+
+    for (uint32_t i = 0; i < response.blockCount; ++i) {
+        if ((i + 1) % HASH_BLOCKS_PER_TURN == 0) co_await connection.Yield();
+
+        const size_t size = (i + 1 == response.blockCount) ? response.lastBlockSize : blockSize;
+        if (base.Read(transfer.chunk.data(), size, i * blockSize) != size) [[unlikely]] {
+            std::cerr << "Failed to read file: " << transfer.filePath << ".\n";
+            co_return Step::Drop;
+        }
+
+        const auto* block = reinterpret_cast<const uint8_t*>(transfer.chunk.data());
+        signatures[i] = { Hash::Rolling::Of(block, size), Hash::Xxh64(block, size) };
+    }
+
+    if (
+        co_await connection.SendAll(&response, sizeof(response)) == 0 ||
+        co_await connection.SendAll(signatures.data(), signatures.size() * sizeof(signatures[0])) == 0
+    ) {
+        CheckFail(client, connection.Fail());
+        co_return Step::Drop;
+    }
+
+    // The file is rebuilt aside and replaces the old copy only when complete.
+    const std::filesystem::path partPath = transfer.filePath.string() + '.' + std::to_string(nextDeltaId++) + ".delta";
+    File& output = transfer.file;
+
+    if (!output.Open(partPath, File::Mode::Write) || !output.Reserve(transfer.totalSize)) [[unlikely]] {
+        std::cout << "Failed to create or open file at " << partPath << ".\n";
+        output.Close();
+        std::filesystem::remove(partPath, error);
+        co_return Step::Drop;
+    }
+
+    const auto removeFile = [&]() {
+        output.Close();
+        std::filesystem::remove(partPath, error);
+        return Step::Drop;
+    };
+
+    for (unsigned int steps = 1; transfer.bytesLeft > 0; ++steps) {
+        if (steps % STEPS_PER_TURN == 0) co_await connection.Yield();
+
+        size_t position = transfer.totalSize - transfer.bytesLeft;
+
+        Command command;
+        if (co_await connection.ReceiveAll(&command, sizeof(command)) == 0) {
+            CheckFail(client, connection.Fail());
+            co_return removeFile();
         }
 
-        fileStream.write(client.buffer, received);
-        bytesToReceive -= received;
+        if (command.type == Command::Copy) {
+            if (command.value >= response.blockCount) [[unlikely]] goto invalid_delta;
+
+            const size_t size = (command.value + 1 == response.blockCount) ? response.lastBlockSize : blockSize;
+            if (size > transfer.bytesLeft) [[unlikely]] goto invalid_delta;
+
+            if (
+                base.Read(transfer.chunk.data(), size, command.value * blockSize) != size ||
+                output.Write(transfer.chunk.data(), size, position) != size
+            ) [[unlikely]] {
+                std::cerr << "Failed to copy block of file: " << transfer.filePath << ".\n";
+                co_return removeFile();
+            }
+
+            transfer.bytesLeft -= size;
+        } else if (command.type == Command::Literal) {
+            if (command.value == 0 || command.value > transfer.bytesLeft) [[unlikely]] goto invalid_delta;
+
+            for (size_t left = command.value; left > 0;) {
+                const uint received = co_await connection.Receive(
+                    transfer.chunk.data(), std::min(transfer.chunk.size(), left)
+                );
+                if (received == 0) {
+                    CheckFail(client, connection.Fail());
+                    co_return removeFile();
+                }
+
+                if (output.Write(transfer.chunk.data(), received, position) != received) [[unlikely]] {
+                    std::cerr << "Failed to write file: " << partPath << ".\n";
+                    co_return removeFile();
+                }
+
+                position += received;
+                left -= received;
+                transfer.bytesLeft -= received;
+            }
+        } else [[unlikely]] {
+            goto invalid_delta;
+        }
+    }
+
+    output.Close();
+    base.Close();
+    TakeBitrate(transfer.beginTime, transfer.totalSize);
+
+    // The rebuilt file replaces the old copy only if it matches the file of the client.
+    transfer.partPath = partPath;
+    client.state = ClientHandle::State::UploadCommit;
+    co_return Step::Continue;
+
+invalid_delta:
+    std::cerr << "Invalid delta from client[" << client.identifier.ToString() << "].\n";
+    co_return removeFile();
+}
+
+static inline uint64_t MakeRingKey(const unsigned int slot, const uint8_t op, const unsigned int buffer) {
+    return (static_cast<uint64_t>(slot) << 8) | (op << 1) | buffer;
+}
+
+bool Server::EnableRing() {
+    Net::Ptr<Net::Ring> newRing = std::make_unique<Net::Ring>();
+    if (!newRing->Setup(RING_ENTRIES) || !newRing->EnableNotifier()) return false;
+
+    ringBuffers = std::make_unique<char[]>(RING_SLOTS * 2 * RING_CHUNK_SIZE);
+
+    std::vector<iovec> buffers(RING_SLOTS * 2);
+    for (unsigned int i = 0; i < buffers.size(); ++i) {
+        buffers[i].iov_base = ringBuffers.get() + i * RING_CHUNK_SIZE;
+        buffers[i].iov_len = RING_CHUNK_SIZE;
+    }
+
+    // Each slot has two files: client socket and transfered file.
+    if (!newRing->RegisterBuffers(buffers.data(), buffers.size()) || !newRing->RegisterFiles(RING_SLOTS * 2)) {
+        ringBuffers.reset();
+        return false;
+    }
+
+    ringSlots.resize(RING_SLOTS);
+    freeRingSlots.clear();
+    for (unsigned int i = RING_SLOTS; i > 0; --i) freeRingSlots.push_back(i - 1);
+
+    ring = std::move(newRing);
+    return true;
+}
+
+bool Server::AttachRing(ClientHandle& client) {
+    if (ring == nullptr || freeRingSlots.empty()) return false;
+
+    Net::Socket* socket = client.connection->GetSocket();
+    if (socket == nullptr) return false;
+
+    Transfer& transfer = client.transfer;
+    const unsigned int slotIndex = freeRingSlots.back();
+
+    if (
+        !ring->SetFile(slotIndex * 2, socket->GetOsSocket()) ||
+        !ring->SetFile(slotIndex * 2 + 1, transfer.file.GetDescriptor())
+    ) [[unlikely]] {
+        ring->SetFile(slotIndex * 2, -1);
+        return false;
+    }
+
+    freeRingSlots.pop_back();
+    transfer.ringSlot = slotIndex;
+
+    RingSlot& slot = ringSlots[slotIndex];
+    slot = RingSlot{};
+    slot.clientId = client.id;
+
+    // The ring waits for the socket readiness by itself.
+    socket->SetBlocking(true);
+
+    bool isSubmitted;
+    slot.position = transfer.startPos;
+
+    if (client.state == ClientHandle::State::Download) {
+        client.state = ClientHandle::State::RingDownload;
+        isSubmitted = SubmitDownload(client);
+    } else {
+        client.state = ClientHandle::State::RingUpload;
+        isSubmitted = SubmitReceive(client, 0);
+    }
+
+    if (isSubmitted == false) [[unlikely]] {
+        client.state = (client.state == ClientHandle::State::RingDownload) ?
+            ClientHandle::State::Download : ClientHandle::State::Upload;
+        DetachRing(client);
+        return false;
+    }
+
+    return true;
+}
+
+void Server::DetachRing(ClientHandle& client) {
+    const unsigned int slotIndex = client.transfer.ringSlot;
+
+    ring->SetFile(slotIndex * 2, -1);
+    ring->SetFile(slotIndex * 2 + 1, -1);
+
+    ringSlots[slotIndex].clientId = 0;
+    freeRingSlots.push_back(slotIndex);
+
+    client.connection->GetSocket()->SetBlocking(false);
+}
+
+bool Server::SubmitDownload(ClientHandle& client) {
+    const Transfer& transfer = client.transfer;
+    const unsigned int slotIndex = transfer.ringSlot;
+    RingSlot& slot = ringSlots[slotIndex];
+
+    if (ring->GetFreeEntries() < 4) [[unlikely]] return false;
+
+    const size_t endPosition = transfer.startPos + transfer.totalSize;
+
+    // Both buffers are chained: sends must not be reordered, and each one waits for its read.
+    for (unsigned int i = 0; i < 2 && slot.position < endPosition; ++i) {
+        const unsigned int size = std::min<size_t>(RING_CHUNK_SIZE, endPosition - slot.position);
+        const bool isLast = (i == 1 || slot.position + size == endPosition);
+        char* data = GetRingBuffer(slotIndex, i);
+
+        ring->Read(
+            slotIndex * 2 + 1, slotIndex * 2 + i, data, size, slot.position,
+            MakeRingKey(slotIndex, static_cast<uint8_t>(RingOp::Read), i), Net::Ring::Link
+        );
+        ring->Send(
+            slotIndex * 2, data, size,
+            MakeRingKey(slotIndex, static_cast<uint8_t>(RingOp::Send), i), isLast ? Net::Ring::None : Net::Ring::Link
+        );
+
+        slot.sizes[i] = size;
+        slot.position += size;
+        slot.pending += 2;
     }
 
-    TakeBitrate(beginTime, fileSize);
+    return true;
+}
+
+bool Server::SubmitReceive(ClientHandle& client, const unsigned int bufferIndex) {
+    const unsigned int slotIndex = client.transfer.ringSlot;
+    RingSlot& slot = ringSlots[slotIndex];
+
+    const unsigned int size = std::min<size_t>(RING_CHUNK_SIZE, client.transfer.bytesLeft);
+    if (!ring->Receive(
+        slotIndex * 2, GetRingBuffer(slotIndex, bufferIndex), size,
+        MakeRingKey(slotIndex, static_cast<uint8_t>(RingOp::Receive), bufferIndex)
+    )) [[unlikely]] return false;
 
-    std::cout << "File saved at " << filePath << ".\n";
+    slot.busyBuffers |= 1u << bufferIndex;
+    slot.receiving = true;
+    slot.pending++;
     return true;
-}
\ No newline at end of file
+}
+
+void Server::HandleCompletion(const Net::Ring::Completion& completion, std::vector<ClientId>& readyClients) {
+    const unsigned int slotIndex = completion.key >> 8;
+    const RingOp op = static_cast<RingOp>((completion.key >> 1) & 0x7f);
+    const unsigned int bufferIndex = completion.key & 1;
+
+    RingSlot& slot = ringSlots[slotIndex];
+    ClientHandle& client = clients.at(slot.clientId);
+    Transfer& transfer = client.transfer;
+
+    slot.pending--;
+
+    const auto fail = [&]() {
+        // Operations after the failed one are canceled, report only the cause.
+        if (slot.failed == false && completion.result < 0) {
+            const auto status = static_cast<Net::Status>(-completion.result);
+            std::cerr << "client[" << client.identifier.ToString() << "]: " << Net::GetStatusName(status) << ".\n";
+        }
+        slot.failed = true;
+    };
+
+    const bool isComplete = (completion.result == static_cast<int32_t>(slot.sizes[bufferIndex]));
+
+    switch (op) {
+        case RingOp::Read:
+            if (isComplete == false) fail();
+            break;
+        case RingOp::Send:
+            if (isComplete) {
+                transfer.bytesLeft -= slot.sizes[bufferIndex];
+                // Sends are linked, so the chunks are checksummed in order.
+                if (!transfer.fileChecksums) transfer.checksums.Update(GetRingBuffer(slotIndex, bufferIndex), slot.sizes[bufferIndex]);
+            } else {
+                fail();
+            }
+            break;
+        case RingOp::Receive: {
+            slot.receiving = false;
+
+            if (completion.result <= 0 || slot.failed) {
+                slot.busyBuffers &= ~(1u << bufferIndex);
+                fail();
+                break;
+            }
+
+            slot.sizes[bufferIndex] = completion.result;
+            slot.offsets[bufferIndex] = slot.position;
+            transfer.bytesLeft -= completion.result;
+
+            if (!ring->Write(
+                slotIndex * 2 + 1, slotIndex * 2 + bufferIndex, GetRingBuffer(slotIndex, bufferIndex),
+                completion.result, slot.position, MakeRingKey(slotIndex, static_cast<uint8_t>(RingOp::Write), bufferIndex)
+            )) [[unlikely]] {
+                slot.busyBuffers &= ~(1u << bufferIndex);
+                slot.unwritten = std::min(slot.unwritten, slot.position);
+                fail();
+                break;
+            }
+
+            slot.position += completion.result;
+            slot.pending++;
+
+            // Receive the next chunk while the current one is being written.
+            const unsigned int otherBuffer = bufferIndex ^ 1;
+            if (transfer.bytesLeft > 0 && (slot.busyBuffers & (1u << otherBuffer)) == 0) {
+                if (SubmitReceive(client, otherBuffer) == false) [[unlikely]] fail();
+            }
+        } break;
+        case RingOp::Write:
+            slot.busyBuffers &= ~(1u << bufferIndex);
+
+            if (isComplete == false) {
+                slot.unwritten = std::min(slot.unwritten, slot.offsets[bufferIndex]);
+                fail();
+            } else if (slot.failed == false && transfer.bytesLeft > 0 && slot.receiving == false) {
+                if (SubmitReceive(client, bufferIndex) == false) [[unlikely]] fail();
+            }
+            break;
+    }
+
+    if (slot.pending > 0) return;
+
+    if (client.state == ClientHandle::State::RingDownload) {
+        if (slot.failed) {
+            SaveRecoveryStamp(client, transfer.startPos + transfer.totalSize - transfer.bytesLeft);
+
+            DetachRing(client);
+            Disconnect(client.id);
+            return;
+        }
+
+        if (transfer.bytesLeft > 0 && SubmitDownload(client)) return;
+
+        // Continue within the event loop, the checksums are sent by it as well.
+        DetachRing(client);
+        client.state = ClientHandle::State::Download;
+        readyClients.push_back(client.id);
+    } else {
+        if (slot.failed) {
+            DetachRing(client);
+            // The writes complete out of order, the upload is continued from the first chunk that isn't stored.
+            SaveUploadStamp(client, std::min(slot.unwritten, slot.position));
+
+            Disconnect(client.id);
+            return;
+        }
+
+        TakeBitrate(transfer.beginTime, transfer.totalSize);
+        // The file is checked within the event loop.
+        FinishRing(client, ClientHandle::State::UploadCommit, readyClients);
+    }
+}
+
+void Server::FinishRing(ClientHandle& client, const ClientHandle::State nextState, std::vector<ClientId>& readyClients) {
+    DetachRing(client);
+    client.transfer.file.Close();
+
+    // Input might be consumed while the client was served by the ring.
+    client.state = nextState;
+    readyClients.push_back(client.id);
+}
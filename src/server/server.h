@@ -2,79 +2,371 @@
 #define _SERVER_H
 
 #include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <filesystem>
 #include <unordered_map>
 
 #include <core/server.h>
 #include <core/socket.h>
 #include <core/packet.h>
+#include <core/poller.h>
+#include <core/ring.h>
 #include <core/net.h>
+#include <core/file.h>
+#include <core/compression.h>
+#include <core/hash.h>
+#include <core/scheduler.h>
+#include <core/task.h>
+#include <core/bufferTuner.h>
+
+#include "checksumCache.h"
+#include "contentCache.h"
+#include "directoryIndex.h"
+#include "fileCache.h"
+#include "recoveryJournal.h"
 
 class Server {
 public:
-    static constexpr int INVALID_CLIENT_INDEX = -1;
+    static constexpr int INVALID_CLIENT_ID = -1;
     static constexpr size_t DEFAULT_BUFFER_SIZE = 4096 * 2;
 
     static constexpr const char* DEFAULT_FILES_DIR = "./hosted-files";
+    static constexpr const char* DEFAULT_JOURNAL_PATH = "./recovery.journal";
 private:
+    /// Max number of events taken from the poller per loop iteration.
+    static constexpr unsigned int MAX_EVENTS = 256;
+    /// Max number of steps made for one client before yielding to the others.
+    static constexpr unsigned int STEPS_PER_TURN = 16;
+    /// Poller key of the listening socket, clients are keyed by their identifiers.
+    static constexpr uint64_t LISTEN_KEY = 0;
+    /// Poller key of the ring completions notifier.
+    static constexpr uint64_t RING_KEY = ~0ull;
+
+    /// Number of bytes moved by one zero-copy call until the link of the connection is measured,
+    /// keeps the turns of the clients short.
+    static constexpr size_t SEND_FILE_CHUNK_SIZE = 1024 * 1024;
+    static constexpr size_t RECEIVE_FILE_CHUNK_SIZE = 1024 * 1024;
+    /// Max number of bytes read from the file and sent by one call, if the file can't be sent
+    /// by the os. Datagram connections send such a chunk as a batch of datagrams.
+    static constexpr size_t COPY_CHUNK_SIZE = 128 * 1024;
+
+    /// Max number of tagged downloads running on one connection at once.
+    static constexpr unsigned int MAX_STREAMS = 16;
+    /// Max size of the file part sent by one frame of the tagged download, keeps the other responses waiting short.
+    static constexpr size_t STREAM_FRAME_SIZE = 32 * 1024;
+
+    /// Max number of the files of one page of the list.
+    static constexpr unsigned int MAX_LIST_COUNT = 1024;
+    /// Max size of the page of the list, it fits one frame of the tagged response.
+    static constexpr size_t LIST_PAGE_SIZE = 32 * 1024;
+
+    /// Bounds of the block size of the delta upload, the size grows with the file so the number of the signatures stays moderate.
+    static constexpr size_t MIN_DELTA_BLOCK_SIZE = 1024;
+    static constexpr size_t MAX_DELTA_BLOCK_SIZE = 64 * 1024;
+    /// Max number of the blocks of the delta upload base hashed before yielding to the other clients.
+    static constexpr unsigned int HASH_BLOCKS_PER_TURN = 64;
+
+    /// Max number of transfers driven by the ring at once, the others are served by the event loop.
+    static constexpr unsigned int RING_SLOTS = 32;
+    static constexpr unsigned int RING_ENTRIES = RING_SLOTS * 4;
+    static constexpr unsigned int RING_CHUNK_SIZE = 64 * 1024;
+
+    using ClientId = unsigned int;
+
+    /// Result of advancing client state machine.
+    enum class Step : uint8_t {
+        Continue, // Progress made, can step further.
+        Block,    // Connection would block, wait for readiness.
+        Yield,    // Steps budget is exhausted, continue at the next turn.
+        Drop      // Client must be disconnected.
+    };
+
+    struct Transfer {
+        std::filesystem::path filePath;
+        /// Uploaded content is stored aside and replaces the file only when checked.
+        std::filesystem::path partPath;
+        File file;
+
+        size_t startPos = 0;
+        size_t totalSize = 0;
+        size_t bytesLeft = 0;
+
+        // File data copied to be sent, allocated only if the file can't be sent by the os.
+        std::vector<char> chunk;
+        // Compressed block of the file, allocated only if the content is compressed.
+        std::vector<char> packed;
+        Msg::Codec codec = Msg::Codec::None;
+        // Checksums of the sent chunks, they follow the downloaded content.
+        Hash::ChunkChecksums checksums { Msg::CHECKSUM_CHUNK_SIZE };
+        /// Cached checksums of the whole file, the sent content isn't checksummed if there are any.
+        ChecksumCache::Checksums fileChecksums;
+        ChecksumCache::Version fileVersion;
+        /// Content of the small file kept in memory, it's sent instead of the file.
+        ContentCache::Content content;
+        // Hash of the whole uploaded file and the request the check result is sent for.
+        uint64_t hash = 0;
+        uint32_t requestId = Msg::Packet::UNTAGGED;
+
+        // Upload content is received, but not stored.
+        bool discard = false;
+        // Only a range of the file is requested, it isn't resumed if interrupted.
+        bool isRange = false;
+
+        // Index of the ring slot, if the transfer is driven by the ring.
+        unsigned int ringSlot = 0;
+
+        /// Chunks the file is sent and received by, sized to the link of the connection.
+        Net::BufferTuner sendTuner { Net::BufferTuner::Direction::Send, SEND_FILE_CHUNK_SIZE };
+        Net::BufferTuner receiveTuner { Net::BufferTuner::Direction::Receive, RECEIVE_FILE_CHUNK_SIZE };
+
+        std::chrono::system_clock::time_point beginTime;
+    };
+
+    /// Tagged download, its file is sent by frames interleaved with the other responses on the connection.
+    struct Stream {
+        uint32_t requestId = Msg::Packet::UNTAGGED;
+        File file;
+        ContentCache::Content content;
+        size_t position = 0;
+        size_t bytesLeft = 0;
+    };
+
     class ClientHandle {
     public:
+        enum class State : uint8_t {
+            Handshake,
+            Packet,
+            Download,
+            Upload,
+            DeltaUpload,
+            UploadCommit,
+            RingDownload,
+            RingUpload
+        };
+
         Net::Ptr<Net::Connection> connection;
         Net::MacAddress identifier;
         char* buffer = nullptr;
+        ClientId id = 0;
+
+        State state = State::Handshake;
+        /// Number of bytes of incomplete input accumulated within the `buffer`.
+        size_t received = 0;
+        /// Output that the connection wasn't ready to accept yet.
+        std::vector<char> output;
+
+        Transfer transfer;
+        /// Coroutine running the transfer, suspended while the connection would block.
+        Net::Task<Step> task;
+
+        /// Tagged downloads served in turn, one frame each, while no requests come.
+        std::vector<Stream> streams;
+        unsigned int nextStream = 0;
+        /// Storage of the frame being sent.
+        std::vector<char> frame;
 
         ClientHandle(Net::Ptr<Net::Connection>&& connection) : connection(std::move(connection)) {
             buffer = new char[DEFAULT_BUFFER_SIZE];
         }
-        ClientHandle(ClientHandle&& other) {
+        ClientHandle(ClientHandle&& other) : transfer(std::move(other.transfer)), task(std::move(other.task)) {
             connection.reset(other.connection.release());
 
             buffer = other.buffer;
             identifier = other.identifier;
+            id = other.id;
+            state = other.state;
+            received = other.received;
+            output = std::move(other.output);
+            streams = std::move(other.streams);
+            nextStream = other.nextStream;
+            frame = std::move(other.frame);
 
             other.buffer = nullptr;
         }
 
         ~ClientHandle() { delete[] buffer; }
 
-        friend void swap(ClientHandle& a, ClientHandle& b) {
-            using std::swap;
-            swap(a.buffer,     b.buffer);
-            swap(a.identifier, b.identifier);
-        }
-
         bool operator==(const ClientHandle& other) const {
             return this == &other;
         }
     };
 
-    struct DownloadStamp {
-        std::filesystem::path filePath;
-        size_t position;
+    enum class RingOp : uint8_t {
+        Read,
+        Send,
+        Receive,
+        Write
+    };
+
+    /// Transfer driven by the ring. Each slot owns two registered buffers used in turn
+    /// and two registered files: the client socket and the transfered file.
+    struct RingSlot {
+        ClientId clientId = 0;
+        /// Number of submitted, but not completed operations.
+        unsigned int pending = 0;
+        /// Bitmask of the buffers that are in use by operations.
+        unsigned int busyBuffers = 0;
+        /// Size of the data placed into each of the buffers.
+        std::array<unsigned int, 2> sizes = {};
+        /// Offset of the next chunk within the file.
+        size_t position = 0;
+        /// Offset of the chunk written from each of the buffers.
+        std::array<size_t, 2> offsets = {};
+        /// Offset of the first received chunk that isn't written, the content before it is stored.
+        size_t unwritten = SIZE_MAX;
+
+        bool receiving = false;
+        bool failed = false;
     };
 
+    // Clients may reconnect to any of the servers sharing the port, so stamps are common for all of them.
+    static inline RecoveryJournal recoveryJournal;
+    static inline ChecksumCache checksumCache;
+    static inline FileCache fileCache;
+    static inline ContentCache contentCache;
+    static inline DirectoryIndex hostIndex;
+    /// Numbers the files rebuilt from the deltas, the clients may send the deltas of the same file at once.
+    static inline std::atomic<uint64_t> nextDeltaId = 0;
+    /// The content cache statistics are printed as the clients disconnect, set before the servers run.
+    static inline bool reportCacheStats = false;
+
     Net::Ptr<Net::Server> listenServer;
-    std::vector<ClientHandle> clients;
-    std::unordered_map<Net::MacAddress, DownloadStamp> recoveryStamps;
+    std::unordered_map<ClientId, ClientHandle> clients;
+    /// Resumes the transfer coroutines of the clients, keyed by the client identifiers.
+    Net::Scheduler scheduler;
+
+    ClientId nextClientId = LISTEN_KEY + 1;
+
+    Net::Ptr<Net::Ring> ring;
+    std::vector<RingSlot> ringSlots;
+    std::vector<unsigned int> freeRingSlots;
+    std::unique_ptr<char[]> ringBuffers;
 
     Net::Address::port_t port;
     std::filesystem::path hostDirectory;
 
-    bool CheckFail(ClientHandle& client);
-    bool HandlePacket(ClientHandle& client, const Msg::Packet* packet);
-    bool HandleDownload(ClientHandle& client, const size_t startPos, const char* fileName);
-    bool HandleUpload(ClientHandle& client, const Msg::Request::Upload* request);
+    int Listen();
+    void AcceptClients(Net::Poller& poller);
+    void Disconnect(const ClientId clientId);
+
+    void RunEventLoop(Net::Socket& listenSocket);
+    void RunSequential();
+
+    bool AttachRing(ClientHandle& client);
+    void DetachRing(ClientHandle& client);
+    bool SubmitDownload(ClientHandle& client);
+    bool SubmitReceive(ClientHandle& client, const unsigned int bufferIndex);
+    void HandleCompletion(const Net::Ring::Completion& completion, std::vector<ClientId>& readyClients);
+    void FinishRing(ClientHandle& client, const ClientHandle::State nextState, std::vector<ClientId>& readyClients);
+    inline char* GetRingBuffer(const unsigned int slot, const unsigned int buffer) {
+        return ringBuffers.get() + (slot * 2 + buffer) * RING_CHUNK_SIZE;
+    }
+
+    /// Remembers where the interrupted download stopped, so the client can resume it after reconnecting.
+    void SaveRecoveryStamp(const ClientHandle& client, const size_t position);
+    /// Keeps the part of the interrupted upload stored up to `position`, so the client can continue it.
+    void SaveUploadStamp(ClientHandle& client, const size_t position);
+    /// Takes the stamp of the upload of the same file by the client. Returns the stored size of the file, `0` if there is none.
+    size_t TakeUploadStamp(const ClientHandle& client);
+
+    Step CheckFail(ClientHandle& client);
+    Step CheckFail(const ClientHandle& client, const Net::Status status);
+    Step Drive(ClientHandle& client, unsigned int steps);
+    Step Flush(ClientHandle& client);
+    Step Reply(ClientHandle& client, const void* data, const size_t size);
+    Step ReceiveInput(ClientHandle& client, const size_t size);
+
+    Step StepHandshake(ClientHandle& client);
+    Step StepPacket(ClientHandle& client);
+    /// Starts or resumes the transfer coroutine of the client.
+    Step StepTransfer(ClientHandle& client);
+    /// Sends the file in straight-line style, each chunk is awaited on the connection.
+    Net::Task<Step> SendTransfer(ClientHandle& client);
+    /// Reads `size` bytes of the file at `position` and passes them to the checksums of the transfer,
+    /// the content kept in memory isn't read.
+    static bool ChecksumFile(Transfer& transfer, size_t position, size_t size);
+    /// Takes the checksums of the sent range from the cached ones of the whole file,
+    /// only the chunks cut by the range are read and checksummed.
+    static bool CollectChecksums(Transfer& transfer);
+    Net::Task<Step> ReceiveTransfer(ClientHandle& client);
+    /// Checks the hash of the received file and replaces the old copy by it, the result is sent to the client.
+    Net::Task<Step> CommitUpload(ClientHandle& client);
+    /// Sends the signatures of the blocks of the existing file, then rebuilds the file from the received delta.
+    Net::Task<Step> ReceiveDelta(ClientHandle& client);
+    /// Sends the next frame of the tagged downloads.
+    Step StepStreams(ClientHandle& client);
+
+    Step HandlePacket(ClientHandle& client, const Msg::Packet* packet);
+    /// Sends at most `size` bytes of the file starting at `startPos`. The file of the untagged `request`
+    /// occupies the connection until sent and is compressed by the `codec` if it's worth it,
+    /// the file of the tagged one is streamed by frames.
+    Step HandleDownload(
+        ClientHandle& client, const Msg::Packet* request,
+        const size_t startPos, const size_t size, const Msg::Codec codec, const char* fileName
+    );
+    /// Opens the file to send at most `size` bytes of it starting at `startPos`, returns the response to the request.
+    Msg::Response::Download OpenDownload(
+        const std::filesystem::path& filePath, const size_t startPos, const size_t size,
+        File& outFile, ChecksumCache::Version& outVersion
+    );
+    Step HandleUpload(ClientHandle& client, const Msg::Packet* packet, const Msg::Request::Upload* request);
+    Step HandleUploadRecovery(ClientHandle& client, const Msg::Packet* packet, const Msg::Request::UploadRecovery* request);
+    Step HandleDeltaUpload(ClientHandle& client, const Msg::Request::DeltaUpload* request);
+    /// Sends the page of the hosted files from the index, it's bounded by `MAX_LIST_COUNT` and `LIST_PAGE_SIZE`.
+    Step HandleList(ClientHandle& client, const Msg::Packet* packet);
+
+    /// Answers the `request`: the response to the tagged one is framed into the packet of the same opcode and id.
+    Step Reply(ClientHandle& client, const Msg::Packet* request, const void* data, const size_t size);
+    /// Answers the request taken earlier, it's identified by its `opcode` and `requestId`.
+    Step Reply(
+        ClientHandle& client, const Msg::Opcodes opcode, const uint32_t requestId, const void* data, const size_t size
+    );
+
+    template<typename T>
+    inline Step Reply(ClientHandle& client, const T& object) { return Reply(client, &object, sizeof(object)); }
+    template<typename T>
+    inline Step Reply(ClientHandle& client, const Msg::Packet* request, const T& object) {
+        return Reply(client, request, &object, sizeof(object));
+    }
+    template<typename T>
+    inline Step Reply(ClientHandle& client, const Msg::Opcodes opcode, const uint32_t requestId, const T& object) {
+        return Reply(client, opcode, requestId, &object, sizeof(object));
+    }
 
 public:
-    Server(const Net::Protocol protocol, const Net::Address::port_t port);
+    /// - `shared`: allows multiple servers to listen the same port, each of them
+    /// gets its own part of incoming connections.
+    Server(const Net::Protocol protocol, const Net::Address::port_t port, const bool shared = false);
 
-    int Listen();
-    bool Handle(unsigned int clientIndex);
+    /// Enables transfering files over the `io_uring`: file and socket operations of the running
+    /// transfers are submitted to the os in batches once per event loop iteration.
+    /// Returns `false` if the os doesn't support it.
+    bool EnableRing();
+
+    /// Serves clients until the process exits. Connections that can be polled
+    /// are multiplexed within the event loop, otherwise clients are served one by one.
+    void Run();
+
+    /// Keeps the stamps of the interrupted transfers within the journal at `path`, so they survive restarts.
+    /// Returns `false` if it can't be written, the stamps are kept until the process exits then.
+    static bool OpenRecoveryJournal(const std::filesystem::path& path) { return recoveryJournal.Open(path); }
+    /// Sets the max total size of the small files kept in memory, `0` sends every file from the storage.
+    static void SetContentBudget(const size_t size) { contentCache.SetBudget(size); }
+    /// Prints the hits and misses of the content cache as each client disconnects.
+    static void ReportCacheStats(const bool report) { reportCacheStats = report; }
+    /// Indexes the files of the host directory, so they are listed without walking it. The journal isn't listed
+    /// if it's kept within the directory. Returns `false` if its changes can't be watched, then it's scanned by each listing.
+    static bool IndexHostDirectory(const std::filesystem::path& path, const std::filesystem::path& journalPath) {
+        return hostIndex.Open(path, { journalPath });
+    }
 
     inline void SetHostDirectory(std::string_view path) { hostDirectory = path; }
+    inline void SetTransportOptions(const Net::TransportOptions& options) { listenServer->SetTransportOptions(options); }
 
     inline Net::Status Fail() { return listenServer->Fail(); }
-    inline Net::Status ClientFail(unsigned int clientIndex) { return clients[clientIndex].connection->Fail(); }
 };
 
-#endif
\ No newline at end of file
+#endif